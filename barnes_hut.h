@@ -0,0 +1,349 @@
+#pragma once
+
+#include "simd.h"
+#include "task_scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Barnes-Hut octree for softened self-gravity (G = 1, the same units as
+// BlackHole::getGravity). Bodies are sorted along a 30-bit Morton curve, so
+// every node is a contiguous range of the sorted arrays; the tree is built
+// top-down by splitting those ranges on successive octal digits. A far
+// node acts as a point mass at its centre of mass when
+//     distance > cellWidth / theta + offset,
+// where offset is how far the centre of mass sits from the cell centre
+// (Barnes 1994); unlike plain width/distance < theta this never accepts a
+// cell the point is inside.
+// Sorting, building and force evaluation all run on the TaskScheduler.
+
+const int OCTREE_LEAF_SIZE = 16;
+const int OCTREE_MAX_DEPTH = 10;
+const int OCTREE_TASK_BODIES = 32768;
+
+struct OctreeNode {
+    float comX, comY, comZ, mass;
+    float openRadius;  // accept as a point mass beyond this distance
+    float halfSize;
+    int firstChild;  // -1 for leaves; children are contiguous
+    int childCount;
+    int bodyBegin;   // range in the sorted arrays
+    int bodyCount;
+};
+
+class BarnesHutTree {
+public:
+    float theta;
+    float softening;
+    std::vector<OctreeNode> nodes;
+    int nodeCount;
+    int bodyCount;
+    AlignedBuffer<float> sortedX;
+    AlignedBuffer<float> sortedY;
+    AlignedBuffer<float> sortedZ;
+    AlignedBuffer<float> sortedMass;
+    AlignedBuffer<uint32_t> order;  // sorted slot -> original body index
+
+    BarnesHutTree() {
+        theta = 0.6f;
+        softening = 0.3f;
+        nodeCount = 0;
+        bodyCount = 0;
+    }
+
+    // Bodies of equal mass when `mass` is null.
+    void build(const float* x, const float* y, const float* z, const float* mass, float uniformMass,
+               int count, TaskScheduler& scheduler) {
+        bodyCount = count;
+        nodeCount = 0;
+        if (count <= 0) return;
+
+        computeBounds(x, y, z, count, scheduler);
+        mortonSort(x, y, z, count, scheduler);
+
+        scheduler.parallelFor(0, count, 16384, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                uint32_t src = order[i];
+                sortedX[i] = x[src];
+                sortedY[i] = y[src];
+                sortedZ[i] = z[src];
+                sortedMass[i] = mass ? mass[src] : uniformMass;
+            }
+        });
+
+        nodeCapacity = 2 * count / OCTREE_LEAF_SIZE * 4 + 4096;
+        if ((int)nodes.size() < nodeCapacity) nodes.resize(nodeCapacity);
+        allocated.store(1, std::memory_order_relaxed);
+        buildNode(scheduler, 0, 0, count, 0, boundsMin[0] + boundsHalf, boundsMin[1] + boundsHalf,
+                  boundsMin[2] + boundsHalf, boundsHalf);
+        nodeCount = std::min(allocated.load(std::memory_order_relaxed), nodeCapacity);
+    }
+
+    // Acceleration at a point from every body in the tree.
+    void accelerationAt(float px, float py, float pz, float& ax, float& ay, float& az) const {
+        ax = ay = az = 0;
+        if (bodyCount == 0) return;
+        float eps2 = softening * softening;
+        int stack[8 * OCTREE_MAX_DEPTH + 64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const OctreeNode& n = nodes[stack[--top]];
+            float dx = n.comX - px, dy = n.comY - py, dz = n.comZ - pz;
+            float d2 = dx * dx + dy * dy + dz * dz;
+            if (n.firstChild < 0) {
+                for (int j = n.bodyBegin; j < n.bodyBegin + n.bodyCount; j++) {
+                    float bx = sortedX[j] - px, by = sortedY[j] - py, bz = sortedZ[j] - pz;
+                    float r2 = bx * bx + by * by + bz * bz + eps2;
+                    float s = sortedMass[j] / (r2 * sqrtf(r2));
+                    ax += bx * s;
+                    ay += by * s;
+                    az += bz * s;
+                }
+            } else if (d2 > n.openRadius * n.openRadius) {
+                float r2 = d2 + eps2;
+                float s = n.mass / (r2 * sqrtf(r2));
+                ax += dx * s;
+                ay += dy * s;
+                az += dz * s;
+            } else {
+                for (int c = 0; c < n.childCount; c++) stack[top++] = n.firstChild + c;
+            }
+        }
+    }
+
+    // Accelerations of all built bodies, written by original index. Bodies
+    // are walked in Morton order so neighbouring work items share paths.
+    void computeAccelerations(TaskScheduler& scheduler, float* ax, float* ay, float* az) const {
+        scheduler.parallelFor(0, bodyCount, 1024, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                uint32_t dst = order[i];
+                accelerationAt(sortedX[i], sortedY[i], sortedZ[i], ax[dst], ay[dst], az[dst]);
+            }
+        });
+    }
+
+    // O(N) reference for one point, for accuracy checks.
+    static void directAcceleration(const float* x, const float* y, const float* z, const float* mass,
+                                   float uniformMass, int count, float softening,
+                                   float px, float py, float pz, float& ax, float& ay, float& az) {
+        double sx = 0, sy = 0, sz = 0;
+        float eps2 = softening * softening;
+        for (int j = 0; j < count; j++) {
+            float bx = x[j] - px, by = y[j] - py, bz = z[j] - pz;
+            float r2 = bx * bx + by * by + bz * bz + eps2;
+            float s = (mass ? mass[j] : uniformMass) / (r2 * sqrtf(r2));
+            sx += bx * s;
+            sy += by * s;
+            sz += bz * s;
+        }
+        ax = (float)sx;
+        ay = (float)sy;
+        az = (float)sz;
+    }
+
+private:
+    AlignedBuffer<uint32_t> codes;
+    AlignedBuffer<uint32_t> scratchCodes;
+    AlignedBuffer<uint32_t> scratchOrder;
+    float boundsMin[3];
+    float boundsHalf;
+    int nodeCapacity;
+    std::atomic<int> allocated{0};
+
+    void computeBounds(const float* x, const float* y, const float* z, int count, TaskScheduler& scheduler) {
+        float lo[3] = {x[0], y[0], z[0]};
+        float hi[3] = {x[0], y[0], z[0]};
+        std::mutex mutex;
+        scheduler.parallelFor(0, count, 16384, [&](int begin, int end) {
+            float l[3] = {x[begin], y[begin], z[begin]};
+            float h[3] = {l[0], l[1], l[2]};
+            for (int i = begin; i < end; i++) {
+                l[0] = std::min(l[0], x[i]); h[0] = std::max(h[0], x[i]);
+                l[1] = std::min(l[1], y[i]); h[1] = std::max(h[1], y[i]);
+                l[2] = std::min(l[2], z[i]); h[2] = std::max(h[2], z[i]);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int k = 0; k < 3; k++) {
+                lo[k] = std::min(lo[k], l[k]);
+                hi[k] = std::max(hi[k], h[k]);
+            }
+        });
+        float extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+        boundsHalf = 0.5f * extent * 1.0001f + 1e-6f;
+        for (int k = 0; k < 3; k++) boundsMin[k] = 0.5f * (lo[k] + hi[k]) - boundsHalf;
+    }
+
+    static uint32_t spreadBits(uint32_t v) {
+        v = (v | (v << 16)) & 0x030000FFu;
+        v = (v | (v << 8)) & 0x0300F00Fu;
+        v = (v | (v << 4)) & 0x030C30C3u;
+        v = (v | (v << 2)) & 0x09249249u;
+        return v;
+    }
+
+    // Morton codes, then a stable three-pass LSD radix sort (11/11/8 bits)
+    // with per-chunk histograms so every pass runs in parallel.
+    void mortonSort(const float* x, const float* y, const float* z, int count, TaskScheduler& scheduler) {
+        codes.resize(count);
+        order.resize(count);
+        scratchCodes.resize(count);
+        scratchOrder.resize(count);
+        sortedX.resize(count);
+        sortedY.resize(count);
+        sortedZ.resize(count);
+        sortedMass.resize(count);
+
+        float scale = (float)(1 << OCTREE_MAX_DEPTH) / (2.0f * boundsHalf);
+        const uint32_t maxCell = (1u << OCTREE_MAX_DEPTH) - 1;
+        scheduler.parallelFor(0, count, 16384, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                uint32_t cx = std::min((uint32_t)((x[i] - boundsMin[0]) * scale), maxCell);
+                uint32_t cy = std::min((uint32_t)((y[i] - boundsMin[1]) * scale), maxCell);
+                uint32_t cz = std::min((uint32_t)((z[i] - boundsMin[2]) * scale), maxCell);
+                codes[i] = (spreadBits(cx) << 2) | (spreadBits(cy) << 1) | spreadBits(cz);
+                order[i] = (uint32_t)i;
+            }
+        });
+
+        int chunks = std::max(1, std::min(scheduler.threadCount() * 4, count / 4096));
+        int chunkSize = (count + chunks - 1) / chunks;
+        const int shifts[3] = {0, 11, 22};
+        const int radix = 2048;
+        std::vector<uint32_t> offsets((size_t)chunks * radix);
+
+        uint32_t* srcCodes = codes.data();
+        uint32_t* srcOrder = order.data();
+        uint32_t* dstCodes = scratchCodes.data();
+        uint32_t* dstOrder = scratchOrder.data();
+        for (int pass = 0; pass < 3; pass++) {
+            int shift = shifts[pass];
+            std::fill(offsets.begin(), offsets.end(), 0u);
+            scheduler.parallelFor(0, chunks, 1, [&](int cb, int ce) {
+                for (int c = cb; c < ce; c++) {
+                    uint32_t* hist = offsets.data() + (size_t)c * radix;
+                    int end = std::min(count, (c + 1) * chunkSize);
+                    for (int i = c * chunkSize; i < end; i++) hist[(srcCodes[i] >> shift) & (radix - 1)]++;
+                }
+            });
+            uint32_t running = 0;
+            for (int d = 0; d < radix; d++) {
+                for (int c = 0; c < chunks; c++) {
+                    uint32_t n = offsets[(size_t)c * radix + d];
+                    offsets[(size_t)c * radix + d] = running;
+                    running += n;
+                }
+            }
+            scheduler.parallelFor(0, chunks, 1, [&](int cb, int ce) {
+                for (int c = cb; c < ce; c++) {
+                    uint32_t* next = offsets.data() + (size_t)c * radix;
+                    int end = std::min(count, (c + 1) * chunkSize);
+                    for (int i = c * chunkSize; i < end; i++) {
+                        uint32_t slot = next[(srcCodes[i] >> shift) & (radix - 1)]++;
+                        dstCodes[slot] = srcCodes[i];
+                        dstOrder[slot] = srcOrder[i];
+                    }
+                }
+            });
+            std::swap(srcCodes, dstCodes);
+            std::swap(srcOrder, dstOrder);
+        }
+        // Three passes leave the result in the scratch arrays.
+        std::swap(codes, scratchCodes);
+        std::swap(order, scratchOrder);
+    }
+
+    void makeLeaf(OctreeNode& n, int begin, int end) {
+        double mx = 0, my = 0, mz = 0, m = 0;
+        for (int i = begin; i < end; i++) {
+            mx += (double)sortedX[i] * sortedMass[i];
+            my += (double)sortedY[i] * sortedMass[i];
+            mz += (double)sortedZ[i] * sortedMass[i];
+            m += sortedMass[i];
+        }
+        n.firstChild = -1;
+        n.childCount = 0;
+        n.openRadius = 0;
+        n.mass = (float)m;
+        n.comX = m > 0 ? (float)(mx / m) : sortedX[begin];
+        n.comY = m > 0 ? (float)(my / m) : sortedY[begin];
+        n.comZ = m > 0 ? (float)(mz / m) : sortedZ[begin];
+    }
+
+    // Children are carved out of the sorted range by the octal digit at this
+    // level; large children are built as separate tasks.
+    void buildNode(TaskScheduler& scheduler, int index, int begin, int end, int level,
+                   float centerX, float centerY, float centerZ, float halfSize) {
+        OctreeNode& n = nodes[index];
+        n.bodyBegin = begin;
+        n.bodyCount = end - begin;
+        n.halfSize = halfSize;
+        if (end - begin <= OCTREE_LEAF_SIZE || level == OCTREE_MAX_DEPTH) {
+            makeLeaf(n, begin, end);
+            return;
+        }
+
+        int shift = 3 * (OCTREE_MAX_DEPTH - 1 - level);
+        int bounds[9];
+        bounds[0] = begin;
+        const uint32_t* c = codes.data();
+        for (int digit = 1; digit < 8; digit++) {
+            bounds[digit] = (int)(std::lower_bound(c + bounds[digit - 1], c + end, (uint32_t)digit,
+                [shift](uint32_t code, uint32_t d) { return ((code >> shift) & 7u) < d; }) - c);
+        }
+        bounds[8] = end;
+
+        int childCount = 0;
+        for (int digit = 0; digit < 8; digit++) {
+            if (bounds[digit + 1] > bounds[digit]) childCount++;
+        }
+        int first = allocated.fetch_add(childCount, std::memory_order_relaxed);
+        if (first + childCount > nodeCapacity) {
+            // Out of preallocated nodes: a big leaf is slower but still exact.
+            makeLeaf(n, begin, end);
+            return;
+        }
+        n.firstChild = first;
+        n.childCount = childCount;
+
+        TaskGroup group;
+        int child = first;
+        for (int digit = 0; digit < 8; digit++) {
+            int b = bounds[digit], e = bounds[digit + 1];
+            if (e == b) continue;
+            int childIndex = child++;
+            // Code bits per level are x, y, z from high to low.
+            float q = halfSize * 0.5f;
+            float cx = centerX + ((digit & 4) ? q : -q);
+            float cy = centerY + ((digit & 2) ? q : -q);
+            float cz = centerZ + ((digit & 1) ? q : -q);
+            if (e - b >= OCTREE_TASK_BODIES) {
+                scheduler.run(group, [this, &scheduler, childIndex, b, e, level, cx, cy, cz, q]() {
+                    buildNode(scheduler, childIndex, b, e, level + 1, cx, cy, cz, q);
+                });
+            } else {
+                buildNode(scheduler, childIndex, b, e, level + 1, cx, cy, cz, q);
+            }
+        }
+        scheduler.wait(group);
+
+        double mx = 0, my = 0, mz = 0, m = 0;
+        for (int k = 0; k < childCount; k++) {
+            const OctreeNode& ch = nodes[first + k];
+            mx += (double)ch.comX * ch.mass;
+            my += (double)ch.comY * ch.mass;
+            mz += (double)ch.comZ * ch.mass;
+            m += ch.mass;
+        }
+        OctreeNode& self = nodes[index];
+        self.mass = (float)m;
+        self.comX = m > 0 ? (float)(mx / m) : 0;
+        self.comY = m > 0 ? (float)(my / m) : 0;
+        self.comZ = m > 0 ? (float)(mz / m) : 0;
+        float ox = self.comX - centerX, oy = self.comY - centerY, oz = self.comZ - centerZ;
+        self.openRadius = 2.0f * halfSize / theta + sqrtf(ox * ox + oy * oy + oz * oz);
+    }
+};
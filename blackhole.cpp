@@ -1,181 +1,111 @@
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
+#include "simulation.h"
+#include "scene_geometry.h"
+#include "compact_disk.h"
+#include "lensing_table.h"
+#include "frame_capture.h"
+#include "quality_governor.h"
+#include "star_catalog.h"
+#include "snapshot.h"
+#include "derived_cache.h"
+#include <algorithm>
 #include <vector>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 
 const int SCREEN_WIDTH = 1920;
 const int SCREEN_HEIGHT = 1080;
-const float BH_PI = 3.14159265359f;
 
-struct Particle {
-    Vector3 pos;
-    float life;
-    float maxLife;
-    Color color;
-    float orbitRadius;
-    float orbitAngle;
-    float orbitSpeed;
-    float orbitHeight;
-};
-
-struct Star {
-    Vector3 pos;
-    float brightness;
-    float twinkleSpeed;
-    float twinkleOffset;
-    Color color;
-};
-
-class BlackHole {
-public:
-    Vector3 position;
+// What the field lines are traced from.
+struct FieldLineInputs {
+    Vector3 center;
     float mass;
-    float eventHorizonRadius;
-    float accretionDiskInner;
-    float accretionDiskOuter;
-    float rotationSpeed;
-    float currentRotation;
-    
-    BlackHole() {
-        position = {0, 0, 0};
-        mass = 50.0f;
-        eventHorizonRadius = 2.0f;
-        accretionDiskInner = 3.5f;
-        accretionDiskOuter = 14.0f;
-        rotationSpeed = 0.4f;
-        currentRotation = 0;
-    }
-    
-    void update(float dt) {
-        currentRotation += rotationSpeed * dt;
-    }
+    float horizon;
+    int lineCount;
+    int samplesPerLine;
+    float lineLength;
+    float tolerance;
     
-    Vector3 getGravity(Vector3 point) {
-        Vector3 dir = Vector3Subtract(position, point);
-        float dist = Vector3Length(dir);
-        if (dist < 0.1f) dist = 0.1f;
-        float strength = mass / (dist * dist);
-        return Vector3Scale(Vector3Normalize(dir), strength);
+    bool operator==(const FieldLineInputs& o) const {
+        return center.x == o.center.x && center.y == o.center.y && center.z == o.center.z && mass == o.mass &&
+               horizon == o.horizon && lineCount == o.lineCount && samplesPerLine == o.samplesPerLine &&
+               lineLength == o.lineLength && tolerance == o.tolerance;
     }
 };
 
-class SpacetimeGrid {
-public:
-    BlackHole* blackHole;
-    int gridSize;
-    float gridSpacing;
-    float warpStrength;
-    
-    SpacetimeGrid(BlackHole* bh) {
-        blackHole = bh;
-        gridSize = 30;
-        gridSpacing = 2.0f;
-        warpStrength = 8.0f;
-    }
-    
-    float getWarp(float x, float z) {
-        float dist = sqrtf(x * x + z * z);
-        if (dist < blackHole->eventHorizonRadius) return -100.0f;
-        return -warpStrength / (dist * 0.5f);
-    }
-    
-    void draw(float time) {
-        float offset = gridSize * gridSpacing * 0.5f;
-        float pulse = sinf(time * 0.5f) * 0.2f + 1.0f;
-        
-        for (int i = 0; i <= gridSize; i++) {
-            for (int j = 0; j < gridSize; j++) {
-                float x1 = i * gridSpacing - offset;
-                float z1 = j * gridSpacing - offset;
-                float z2 = (j + 1) * gridSpacing - offset;
-                
-                float y1 = getWarp(x1, z1);
-                float y2 = getWarp(x1, z2);
-                
-                if (y1 < -50 || y2 < -50) continue;
-                
-                float dist1 = sqrtf(x1 * x1 + z1 * z1);
-                float dist2 = sqrtf(x1 * x1 + z2 * z2);
-                
-                float intensity1 = 1.0f / (1.0f + dist1 * 0.1f);
-                float intensity2 = 1.0f / (1.0f + dist2 * 0.1f);
-                
-                Color c1 = {
-                    (unsigned char)(50 * intensity1 * pulse),
-                    (unsigned char)(100 * intensity1 * pulse),
-                    (unsigned char)(255 * intensity1 * pulse),
-                    (unsigned char)(100 * intensity1)
-                };
-                
-                DrawLine3D({x1, y1, z1}, {x1, y2, z2}, c1);
-            }
-        }
-        
-        for (int j = 0; j <= gridSize; j++) {
-            for (int i = 0; i < gridSize; i++) {
-                float x1 = i * gridSpacing - offset;
-                float x2 = (i + 1) * gridSpacing - offset;
-                float z1 = j * gridSpacing - offset;
-                
-                float y1 = getWarp(x1, z1);
-                float y2 = getWarp(x2, z1);
-                
-                if (y1 < -50 || y2 < -50) continue;
-                
-                float dist1 = sqrtf(x1 * x1 + z1 * z1);
-                float intensity1 = 1.0f / (1.0f + dist1 * 0.1f);
-                
-                Color c1 = {
-                    (unsigned char)(50 * intensity1 * pulse),
-                    (unsigned char)(100 * intensity1 * pulse),
-                    (unsigned char)(255 * intensity1 * pulse),
-                    (unsigned char)(100 * intensity1)
-                };
-                
-                DrawLine3D({x1, y1, z1}, {x2, y2, z1}, c1);
-            }
-        }
-    }
+struct FieldLineSet {
+    std::vector<std::vector<Vector3>> lines;
+    int forceEvaluations = 0;
 };
 
 class GravityFieldLines {
 public:
     BlackHole* blackHole;
     int lineCount;
-    std::vector<std::vector<Vector3>> fieldLines;
+    int samplesPerLine;
+    float lineLength;  // in the flow parameter of dx/ds = gravity
+    Rk45Control integrator;
+    TaskScheduler* scheduler;   // retraces in the background when set
+    DerivedCache<FieldLineInputs, FieldLineSet> cache;
     
     GravityFieldLines(BlackHole* bh) {
         blackHole = bh;
         lineCount = 24;
-        generateLines();
-    }
-    
-    void generateLines() {
-        fieldLines.clear();
-        
-        for (int i = 0; i < lineCount; i++) {
+        samplesPerLine = 100;
+        lineLength = 15.0f;
+        integrator.tolerance = 1e-5f;
+        scheduler = nullptr;
+        refresh();
+    }
+    
+    FieldLineInputs inputs() const {
+        return {blackHole->position, blackHole->mass, blackHole->eventHorizonRadius, lineCount, samplesPerLine,
+                lineLength, integrator.tolerance};
+    }
+    
+    // Retraces when the mass, horizon or line settings changed.
+    void refresh() {
+        Rk45Control control = integrator;
+        cache.refresh(inputs(), scheduler, [control](const FieldLineInputs& in, FieldLineSet& out) {
+            generateLines(in, control, out);
+        });
+    }
+    
+    // Each line follows dx/ds = gravity(x) inward from a 25-unit ring with
+    // adaptive RK45 steps, resampled to evenly spaced s for drawing, and
+    // ends before it comes within 1.2 horizon radii.
+    static void generateLines(const FieldLineInputs& in, Rk45Control control, FieldLineSet& out) {
+        BH_PROFILE_SCOPE("GravityFieldLines::generateLines");
+        out.lines.clear();
+        out.forceEvaluations = 0;
+        control.tolerance = in.tolerance;
+        BlackHole hole;
+        hole.position = in.center;
+        hole.mass = in.mass;
+        const float stopRadius = in.horizon * 1.2f;
+        auto gravity = [&hole](Vector3 p) { return hole.getGravity(p); };
+        
+        for (int i = 0; i < in.lineCount; i++) {
             std::vector<Vector3> line;
-            float angle = (float)i / lineCount * BH_PI * 2.0f;
+            float angle = (float)i / in.lineCount * BH_PI * 2.0f;
             float startDist = 25.0f;
             
             Vector3 pos = {cosf(angle) * startDist, 0, sinf(angle) * startDist};
             
-            for (int step = 0; step < 100; step++) {
-                line.push_back(pos);
-                
-                Vector3 gravity = blackHole->getGravity(pos);
-                pos = Vector3Add(pos, Vector3Scale(gravity, 0.15f));
-                
-                float dist = Vector3Length(pos);
-                if (dist < blackHole->eventHorizonRadius * 1.2f) break;
-            }
+            out.forceEvaluations += sampleRk45(pos, in.lineLength, in.samplesPerLine, control, gravity,
+                [stopRadius](Vector3 p) { return Vector3Length(p) < stopRadius; }, line);
             
-            fieldLines.push_back(line);
+            out.lines.push_back(line);
         }
     }
     
     void draw(float time) {
+        BH_PROFILE_SCOPE("GravityFieldLines::draw");
+        refresh();
+        const std::vector<std::vector<Vector3>>& fieldLines = cache.value.lines;
         for (size_t i = 0; i < fieldLines.size(); i++) {
             const auto& line = fieldLines[i];
             
@@ -196,238 +126,6 @@ public:
     }
 };
 
-class EinsteinRing {
-public:
-    BlackHole* blackHole;
-    int segments;
-    int layers;
-    
-    EinsteinRing(BlackHole* bh) {
-        blackHole = bh;
-        segments = 128;
-        layers = 5;
-    }
-    
-    void draw(float time, Camera3D camera) {
-        Vector3 toCamera = Vector3Normalize(Vector3Subtract(camera.position, blackHole->position));
-        Vector3 up = {0, 1, 0};
-        Vector3 right = Vector3Normalize(Vector3CrossProduct(up, toCamera));
-        Vector3 ringUp = Vector3Normalize(Vector3CrossProduct(toCamera, right));
-        
-        for (int layer = 0; layer < layers; layer++) {
-            float radius = blackHole->eventHorizonRadius * (2.6f + layer * 0.15f);
-            float layerT = (float)layer / layers;
-            
-            for (int i = 0; i < segments; i++) {
-                float angle1 = (float)i / segments * BH_PI * 2.0f;
-                float angle2 = (float)(i + 1) / segments * BH_PI * 2.0f;
-                
-                float flicker = sinf(time * 20.0f + angle1 * 5.0f + layer * 2.0f) * 0.3f + 0.7f;
-                float wave = sinf(angle1 * 3.0f - time * 4.0f) * 0.1f;
-                float r = radius + wave;
-                
-                Vector3 p1 = Vector3Add(blackHole->position, 
-                    Vector3Add(Vector3Scale(right, cosf(angle1) * r), Vector3Scale(ringUp, sinf(angle1) * r)));
-                Vector3 p2 = Vector3Add(blackHole->position, 
-                    Vector3Add(Vector3Scale(right, cosf(angle2) * r), Vector3Scale(ringUp, sinf(angle2) * r)));
-                
-                float brightness = flicker * (1.0f - layerT * 0.5f);
-                Color c;
-                
-                if (layer == 0) {
-                    c = {
-                        (unsigned char)(255 * brightness),
-                        (unsigned char)(220 * brightness),
-                        (unsigned char)(180 * brightness),
-                        (unsigned char)(255 * brightness)
-                    };
-                } else {
-                    c = {
-                        (unsigned char)(255 * brightness * 0.8f),
-                        (unsigned char)(200 * brightness * 0.6f),
-                        (unsigned char)(100 * brightness * 0.4f),
-                        (unsigned char)(200 * (1.0f - layerT) * brightness)
-                    };
-                }
-                
-                DrawLine3D(p1, p2, c);
-            }
-        }
-        
-        for (int i = 0; i < 50; i++) {
-            float angle = (float)rand() / RAND_MAX * BH_PI * 2.0f;
-            float r = blackHole->eventHorizonRadius * (2.5f + (float)rand() / RAND_MAX * 0.8f);
-            float flicker = sinf(time * 30.0f + i * 0.5f);
-            
-            if (flicker > 0.7f) {
-                Vector3 sparkPos = Vector3Add(blackHole->position,
-                    Vector3Add(Vector3Scale(right, cosf(angle) * r), Vector3Scale(ringUp, sinf(angle) * r)));
-                DrawPoint3D(sparkPos, WHITE);
-            }
-        }
-    }
-};
-
-class AccretionDisk {
-public:
-    std::vector<Particle> particles;
-    int particleCount;
-    BlackHole* blackHole;
-    
-    AccretionDisk(BlackHole* bh, int count) {
-        blackHole = bh;
-        particleCount = count;
-        initParticles();
-    }
-    
-    void initParticles() {
-        particles.clear();
-        particles.reserve(particleCount);
-        for (int i = 0; i < particleCount; i++) {
-            spawnParticle();
-        }
-    }
-    
-    void spawnParticle() {
-        Particle p;
-        p.orbitRadius = blackHole->accretionDiskInner + 
-            (float)rand() / RAND_MAX * (blackHole->accretionDiskOuter - blackHole->accretionDiskInner);
-        p.orbitAngle = (float)rand() / RAND_MAX * BH_PI * 2.0f;
-        p.orbitHeight = ((float)rand() / RAND_MAX - 0.5f) * 0.6f * (1.0f - (p.orbitRadius - blackHole->accretionDiskInner) / 
-            (blackHole->accretionDiskOuter - blackHole->accretionDiskInner) * 0.5f);
-        
-        p.pos.x = cosf(p.orbitAngle) * p.orbitRadius;
-        p.pos.y = p.orbitHeight;
-        p.pos.z = sinf(p.orbitAngle) * p.orbitRadius;
-        
-        float orbitVel = sqrtf(blackHole->mass / p.orbitRadius) * 0.15f;
-        p.orbitSpeed = orbitVel / p.orbitRadius;
-        
-        p.maxLife = 10.0f + (float)rand() / RAND_MAX * 20.0f;
-        p.life = (float)rand() / RAND_MAX * p.maxLife;
-        
-        float temp = 1.0f - (p.orbitRadius - blackHole->accretionDiskInner) / 
-            (blackHole->accretionDiskOuter - blackHole->accretionDiskInner);
-        
-        if (temp > 0.85f) {
-            p.color = {255, 255, 255, 255};
-        } else if (temp > 0.7f) {
-            p.color = {255, 240, 200, 255};
-        } else if (temp > 0.5f) {
-            p.color = {255, 200, 120, 255};
-        } else if (temp > 0.3f) {
-            p.color = {255, 140, 60, 255};
-        } else if (temp > 0.15f) {
-            p.color = {255, 80, 30, 255};
-        } else {
-            p.color = {180, 40, 20, 255};
-        }
-        
-        particles.push_back(p);
-    }
-    
-    void update(float dt) {
-        for (size_t i = 0; i < particles.size(); i++) {
-            Particle& p = particles[i];
-            
-            p.orbitAngle += p.orbitSpeed * dt;
-            
-            float spiralFactor = 0.02f * dt;
-            p.orbitRadius -= spiralFactor * (blackHole->mass / (p.orbitRadius * p.orbitRadius)) * 0.01f;
-            
-            p.pos.x = cosf(p.orbitAngle) * p.orbitRadius;
-            p.pos.z = sinf(p.orbitAngle) * p.orbitRadius;
-            p.pos.y = p.orbitHeight * (p.orbitRadius / blackHole->accretionDiskOuter);
-            p.pos.y += sinf(p.orbitAngle * 3.0f + p.orbitRadius) * 0.08f;
-            
-            p.life -= dt;
-            
-            if (p.life <= 0 || p.orbitRadius < blackHole->eventHorizonRadius) {
-                p.orbitRadius = blackHole->accretionDiskInner + 
-                    (float)rand() / RAND_MAX * (blackHole->accretionDiskOuter - blackHole->accretionDiskInner);
-                p.orbitAngle = (float)rand() / RAND_MAX * BH_PI * 2.0f;
-                p.life = p.maxLife;
-            }
-        }
-    }
-    
-    void draw(float time) {
-        for (const Particle& p : particles) {
-            float dopplerAngle = p.orbitAngle + BH_PI * 0.5f;
-            float doppler = 0.6f + 0.4f * sinf(dopplerAngle);
-            
-            Color c = p.color;
-            c.r = (unsigned char)(c.r * doppler);
-            c.g = (unsigned char)(c.g * doppler);
-            c.b = (unsigned char)(c.b * doppler * 0.8f);
-            
-            DrawPoint3D(p.pos, c);
-        }
-    }
-};
-
-class DiskGlow {
-public:
-    BlackHole* blackHole;
-    int segments;
-    int rings;
-    
-    DiskGlow(BlackHole* bh) {
-        blackHole = bh;
-        segments = 80;
-        rings = 25;
-    }
-    
-    void draw(float time) {
-        for (int r = 0; r < rings; r++) {
-            float radiusT = (float)r / rings;
-            float radius = blackHole->accretionDiskInner + radiusT * (blackHole->accretionDiskOuter - blackHole->accretionDiskInner);
-            
-            float temp = 1.0f - radiusT;
-            Color baseColor;
-            if (temp > 0.8f) {
-                baseColor = {255, 255, 255, 255};
-            } else if (temp > 0.5f) {
-                float t = (temp - 0.5f) / 0.3f;
-                baseColor = {255, (unsigned char)(200 + t * 55), (unsigned char)(150 + t * 105), 255};
-            } else if (temp > 0.2f) {
-                float t = (temp - 0.2f) / 0.3f;
-                baseColor = {255, (unsigned char)(100 + t * 100), (unsigned char)(30 + t * 120), 255};
-            } else {
-                float t = temp / 0.2f;
-                baseColor = {(unsigned char)(150 + t * 105), (unsigned char)(30 + t * 70), (unsigned char)(10 + t * 20), 255};
-            }
-            
-            for (int s = 0; s < segments; s++) {
-                float angle1 = (float)s / segments * BH_PI * 2.0f + time * blackHole->rotationSpeed;
-                float angle2 = (float)(s + 1) / segments * BH_PI * 2.0f + time * blackHole->rotationSpeed;
-                
-                float height1 = sinf(angle1 * 2.0f + radius) * 0.12f * (1.0f - radiusT);
-                float height2 = sinf(angle2 * 2.0f + radius) * 0.12f * (1.0f - radiusT);
-                
-                Vector3 p1 = {cosf(angle1) * radius, height1, sinf(angle1) * radius};
-                Vector3 p2 = {cosf(angle2) * radius, height2, sinf(angle2) * radius};
-                
-                float dopplerAngle = angle1 + BH_PI * 0.5f;
-                float doppler = 0.5f + 0.5f * sinf(dopplerAngle);
-                doppler = 0.4f + doppler * 0.6f;
-                
-                float brightness = (sinf(angle1 * 8.0f - time * 4.0f + radius * 2.0f) * 0.3f + 0.7f);
-                brightness *= doppler;
-                brightness *= (1.0f - radiusT * 0.5f);
-                
-                Color c = baseColor;
-                c.r = (unsigned char)(c.r * brightness);
-                c.g = (unsigned char)(c.g * brightness);
-                c.b = (unsigned char)(c.b * brightness);
-                c.a = (unsigned char)(220 * (1.0f - radiusT * 0.6f));
-                
-                DrawLine3D(p1, p2, c);
-            }
-        }
-    }
-};
-
 class PhotonSphere {
 public:
     BlackHole* blackHole;
@@ -435,23 +133,48 @@ public:
     std::vector<float> angles;
     std::vector<float> speeds;
     std::vector<float> phases;
+    CounterRng rng;
     
     PhotonSphere(BlackHole* bh) {
         blackHole = bh;
         particleCount = 150;
+        rng = CounterRng(bh->seed, RNG_STREAM_PHOTONS);
         
         for (int i = 0; i < particleCount; i++) {
-            angles.push_back((float)rand() / RAND_MAX * BH_PI * 2.0f);
-            speeds.push_back(3.0f + (float)rand() / RAND_MAX * 3.0f);
-            phases.push_back((float)rand() / RAND_MAX * BH_PI * 2.0f);
+            RandomBlock r = rng.block(i, 0);
+            angles.push_back(r.uniform(0) * BH_PI * 2.0f);
+            speeds.push_back(3.0f + r.uniform(1) * 3.0f);
+            phases.push_back(r.uniform(2) * BH_PI * 2.0f);
         }
     }
     
-    void draw(float time) {
+    // Culled in CULL_SECTORS wedges around the orbit; the half behind the
+    // horizon drops out through its occlusion cone.
+    static const int CULL_SECTORS = 8;
+    
+    void draw(float time, ViewCuller* culler = nullptr) {
+        BH_PROFILE_SCOPE("PhotonSphere::draw");
         float radius = blackHole->eventHorizonRadius * 1.5f;
         
+        bool visible[CULL_SECTORS];
+        int sectorsCulled = 0;
+        for (int k = 0; k < CULL_SECTORS; k++) {
+            visible[k] = true;
+            if (!culler) continue;
+            float a0 = BH_PI * 2.0f * k / CULL_SECTORS;
+            float a1 = BH_PI * 2.0f * (k + 1) / CULL_SECTORS;
+            visible[k] = culler->sphereVisible(wedgeBound({0, 0, 0}, 0, radius, a0, a1, -0.3f * radius, 0.3f * radius));
+            sectorsCulled += !visible[k];
+        }
+        
+        int skipped = 0;
         for (int i = 0; i < particleCount; i++) {
             float angle = angles[i] + time * speeds[i];
+            int sector = (int)(angle * (CULL_SECTORS / (BH_PI * 2.0f))) & (CULL_SECTORS - 1);
+            if (!visible[sector]) {
+                skipped++;
+                continue;
+            }
             float heightAngle = phases[i] + time * speeds[i] * 0.7f;
             
             float x = cosf(angle) * radius * cosf(heightAngle * 0.5f);
@@ -468,282 +191,283 @@ public:
             
             DrawPoint3D({x, y, z}, c);
         }
+        if (culler) culler->count(CULL_PHOTONS, particleCount - skipped, skipped, CULL_SECTORS, sectorsCulled);
     }
 };
 
-class Starfield {
-public:
-    std::vector<Star> stars;
-    int starCount;
-    
-    Starfield(int count) {
-        starCount = count;
-        generateStars();
-    }
-    
-    void generateStars() {
-        stars.reserve(starCount);
-        for (int i = 0; i < starCount; i++) {
-            Star s;
-            float theta = (float)rand() / RAND_MAX * BH_PI * 2.0f;
-            float phi = acosf(2.0f * (float)rand() / RAND_MAX - 1.0f);
-            float radius = 80.0f + (float)rand() / RAND_MAX * 40.0f;
-            
-            s.pos.x = radius * sinf(phi) * cosf(theta);
-            s.pos.y = radius * sinf(phi) * sinf(theta);
-            s.pos.z = radius * cosf(phi);
-            
-            s.brightness = 0.3f + (float)rand() / RAND_MAX * 0.7f;
-            s.twinkleSpeed = 1.0f + (float)rand() / RAND_MAX * 4.0f;
-            s.twinkleOffset = (float)rand() / RAND_MAX * BH_PI * 2.0f;
-            
-            float colorRand = (float)rand() / RAND_MAX;
-            if (colorRand > 0.9f) {
-                s.color = {255, 200, 150, 255};
-            } else if (colorRand > 0.8f) {
-                s.color = {150, 180, 255, 255};
-            } else {
-                s.color = {255, 255, 255, 255};
-            }
-            
-            stars.push_back(s);
-        }
-    }
-    
-    void draw(float time) {
-        for (const Star& s : stars) {
-            float twinkle = 0.7f + 0.3f * sinf(time * s.twinkleSpeed + s.twinkleOffset);
-            float b = s.brightness * twinkle;
-            
-            Color c = {
-                (unsigned char)(s.color.r * b),
-                (unsigned char)(s.color.g * b),
-                (unsigned char)(s.color.b * b),
-                255
-            };
-            
-            DrawPoint3D(s.pos, c);
+inline void snapshotSave(SnapshotWriter& writer, const PhotonSphere& photons) {
+    writer.add(SNAPSHOT_PHOTON_ANGLE, photons.angles);
+    writer.add(SNAPSHOT_PHOTON_SPEED, photons.speeds);
+    writer.add(SNAPSHOT_PHOTON_PHASE, photons.phases);
+}
+
+inline bool snapshotLoad(SnapshotReader& reader, PhotonSphere& photons) {
+    long long n = reader.count<float>(SNAPSHOT_PHOTON_ANGLE);
+    if (n < 0 || reader.count<float>(SNAPSHOT_PHOTON_SPEED) != n || reader.count<float>(SNAPSHOT_PHOTON_PHASE) != n) {
+        return false;
+    }
+    reader.copy(SNAPSHOT_PHOTON_ANGLE, photons.angles);
+    reader.copy(SNAPSHOT_PHOTON_SPEED, photons.speeds);
+    reader.copy(SNAPSHOT_PHOTON_PHASE, photons.phases);
+    photons.particleCount = (int)n;
+    return true;
+}
+
+void JetStream::draw(ViewCuller* culler) {
+    BH_PROFILE_SCOPE("JetStream::draw");
+    const std::vector<JetParticle>& particles = pipelined ? frontParticles : this->particles;
+    const Vector3* slabMin = pipelined ? frontSlabMin : this->slabMin;
+    const Vector3* slabMax = pipelined ? frontSlabMax : this->slabMax;
+    bool visible[JET_SLABS];
+    int slabsCulled = 0;
+    for (int k = 0; k < JET_SLABS; k++) {
+        visible[k] = true;
+        if (!culler || slabMin[k].x > slabMax[k].x) continue;
+        BoundingSphere bound;
+        bound.center = Vector3Scale(Vector3Add(slabMin[k], slabMax[k]), 0.5f);
+        bound.radius = Vector3Distance(slabMin[k], slabMax[k]) * 0.5f + CULL_POINT_LENGTH;
+        visible[k] = culler->sphereVisible(bound);
+        slabsCulled += !visible[k];
+    }
+    
+    int skipped = 0;
+    for (const JetParticle& p : particles) {
+        if (culler && !visible[slabOf(p.pos)]) {
+            skipped++;
+            continue;
         }
-    }
-};
+        float t = p.life / p.maxLife;
+        Color c = {
+            (unsigned char)(120 + 135 * t),
+            (unsigned char)(180 + 75 * t),
+            255,
+            (unsigned char)(t * 255)
+        };
+        DrawPoint3D(p.pos, c);
+    }
+    if (culler) culler->count(CULL_JETS, (int)particles.size() - skipped, skipped, JET_SLABS, slabsCulled);
+}
 
-class InfallingMatter {
+// The horizon is opaque, so levels cannot cross-fade; instead every level
+// is only used while its silhouette is within LOD_MAX_PIXEL_ERROR of a true
+// sphere, which keeps each switch below a pixel. The meshes are unit spheres
+// scaled to the horizon when drawn, so a new radius needs no new mesh.
+class EventHorizon {
 public:
-    struct Streamer {
-        Vector3 pos;
-        Vector3 vel;
-        std::vector<Vector3> trail;
-        int maxTrail;
-        Color color;
-        bool active;
-        float life;
-    };
-    
-    std::vector<Streamer> streamers;
     BlackHole* blackHole;
-    int maxStreamers;
+    static const int LOD_LEVELS = 5;
+    static constexpr int LOD_SLICES[LOD_LEVELS] = {32, 24, 16, 12, 8};
+    Model sphereModels[LOD_LEVELS];
+    LodSelector lod;
     
-    InfallingMatter(BlackHole* bh, int count) {
+    EventHorizon(BlackHole* bh) {
         blackHole = bh;
-        maxStreamers = count;
-        
-        for (int i = 0; i < maxStreamers; i++) {
-            spawnStreamer();
+        for (int i = 0; i < LOD_LEVELS; i++) {
+            sphereModels[i] = LoadModelFromMesh(GenMeshSphere(1.0f, LOD_SLICES[i], LOD_SLICES[i]));
         }
     }
     
-    void spawnStreamer() {
-        Streamer s;
-        float angle = (float)rand() / RAND_MAX * BH_PI * 2.0f;
-        float dist = 18.0f + (float)rand() / RAND_MAX * 12.0f;
-        float height = ((float)rand() / RAND_MAX - 0.5f) * 8.0f;
-        
-        s.pos = {cosf(angle) * dist, height, sinf(angle) * dist};
-        
-        Vector3 toCenter = Vector3Normalize(Vector3Subtract(blackHole->position, s.pos));
-        Vector3 perpendicular = Vector3CrossProduct(toCenter, {0, 1, 0});
-        perpendicular = Vector3Normalize(perpendicular);
-        
-        float tangentStrength = 0.5f + (float)rand() / RAND_MAX * 0.5f;
-        s.vel = Vector3Add(
-            Vector3Scale(toCenter, 2.0f),
-            Vector3Scale(perpendicular, tangentStrength * 3.0f)
-        );
-        
-        s.maxTrail = 30;
-        s.active = true;
-        s.life = 15.0f + (float)rand() / RAND_MAX * 10.0f;
-        
-        float colorChoice = (float)rand() / RAND_MAX;
-        if (colorChoice > 0.7f) {
-            s.color = {255, 220, 150, 255};
-        } else if (colorChoice > 0.4f) {
-            s.color = {255, 160, 80, 255};
-        } else {
-            s.color = {255, 100, 50, 255};
-        }
-        
-        s.trail.reserve(s.maxTrail);
-        streamers.push_back(s);
+    ~EventHorizon() {
+        for (int i = 0; i < LOD_LEVELS; i++) UnloadModel(sphereModels[i]);
     }
     
-    void update(float dt) {
-        for (size_t i = 0; i < streamers.size(); i++) {
-            Streamer& s = streamers[i];
-            
-            if (!s.active) continue;
-            
-            Vector3 gravity = blackHole->getGravity(s.pos);
-            s.vel = Vector3Add(s.vel, Vector3Scale(gravity, dt));
-            s.pos = Vector3Add(s.pos, Vector3Scale(s.vel, dt));
-            
-            s.trail.push_back(s.pos);
-            if (s.trail.size() > (size_t)s.maxTrail) {
-                s.trail.erase(s.trail.begin());
-            }
-            
-            s.life -= dt;
-            
-            float dist = Vector3Length(s.pos);
-            if (dist < blackHole->eventHorizonRadius || s.life <= 0 || dist > 50.0f) {
-                s.trail.clear();
-                float angle = (float)rand() / RAND_MAX * BH_PI * 2.0f;
-                float spawnDist = 18.0f + (float)rand() / RAND_MAX * 12.0f;
-                float height = ((float)rand() / RAND_MAX - 0.5f) * 8.0f;
-                s.pos = {cosf(angle) * spawnDist, height, sinf(angle) * spawnDist};
-                
-                Vector3 toCenter = Vector3Normalize(Vector3Subtract(blackHole->position, s.pos));
-                Vector3 perpendicular = Vector3CrossProduct(toCenter, {0, 1, 0});
-                perpendicular = Vector3Normalize(perpendicular);
-                float tangentStrength = 0.5f + (float)rand() / RAND_MAX * 0.5f;
-                s.vel = Vector3Add(Vector3Scale(toCenter, 2.0f), Vector3Scale(perpendicular, tangentStrength * 3.0f));
-                s.life = 15.0f + (float)rand() / RAND_MAX * 10.0f;
-            }
+    int coarsestLevel(float unitPixels) const {
+        for (int level = LOD_LEVELS - 1; level > 0; level--) {
+            if (circleErrorPixels(blackHole->eventHorizonRadius * unitPixels, LOD_SLICES[level]) <= LOD_MAX_PIXEL_ERROR) return level;
         }
+        return 0;
+    }
+    
+    void updateLod(const Camera3D& camera, float screenHeight, float dt) {
+        float unitPixels = pixelsPerUnit(camera, blackHole->position, screenHeight);
+        lod.update(coarsestLevel(unitPixels), coarsestLevel(unitPixels * LOD_HYSTERESIS), dt);
     }
     
     void draw() {
-        for (const Streamer& s : streamers) {
-            if (!s.active || s.trail.size() < 2) continue;
-            
-            for (size_t i = 1; i < s.trail.size(); i++) {
-                float t = (float)i / s.trail.size();
-                Color c = s.color;
-                c.r = (unsigned char)(c.r * (0.3f + t * 0.7f));
-                c.g = (unsigned char)(c.g * (0.2f + t * 0.8f));
-                c.b = (unsigned char)(c.b * (0.1f + t * 0.9f));
-                c.a = (unsigned char)(t * 255);
-                DrawLine3D(s.trail[i-1], s.trail[i], c);
-            }
-            
-            DrawPoint3D(s.pos, s.color);
-        }
+        BH_PROFILE_SCOPE("EventHorizon::draw");
+        DrawModel(sphereModels[lod.level], blackHole->position, blackHole->eventHorizonRadius, BLACK);
     }
 };
 
-class JetStream {
+// glDrawArrays and glReadPixels are exported by every GL loader we link
+// against (opengl32 on Windows, libGL elsewhere); rlgl only offers
+// triangle-list array draws and an allocating screen readback.
+#if defined(_WIN32)
+#define BH_GL_APIENTRY __stdcall
+#else
+#define BH_GL_APIENTRY
+#endif
+extern "C" void BH_GL_APIENTRY glDrawArrays(unsigned int mode, int first, int count);
+extern "C" void BH_GL_APIENTRY glReadPixels(int x, int y, int width, int height,
+                                            unsigned int format, unsigned int type, void* pixels);
+const unsigned int BH_GL_RGBA = 0x1908;
+const unsigned int BH_GL_UNSIGNED_BYTE = 0x1401;
+
+// Uploads a VertexBatch into one dynamic VBO pair per frame and draws spans of
+// it as GL_LINES with raylib's default shader.
+class BatchRenderer {
 public:
-    struct JetParticle {
-        Vector3 pos;
-        Vector3 vel;
-        float life;
-        float maxLife;
-    };
-    
-    std::vector<JetParticle> particles;
-    BlackHole* blackHole;
-    int maxParticles;
-    bool topJet;
-    
-    JetStream(BlackHole* bh, bool top, int count) {
-        blackHole = bh;
-        topJet = top;
-        maxParticles = count;
-        particles.reserve(maxParticles);
-    }
-    
-    void update(float dt, float time) {
-        if ((int)particles.size() < maxParticles) {
-            JetParticle p;
-            float angle = (float)rand() / RAND_MAX * BH_PI * 2.0f;
-            float radius = 0.2f + (float)rand() / RAND_MAX * 0.4f;
-            
-            p.pos = blackHole->position;
-            p.pos.x += cosf(angle) * radius;
-            p.pos.z += sinf(angle) * radius;
-            p.pos.y += topJet ? blackHole->eventHorizonRadius : -blackHole->eventHorizonRadius;
-            
-            float speed = 10.0f + (float)rand() / RAND_MAX * 5.0f;
-            float spread = 0.15f;
-            p.vel = {
-                ((float)rand() / RAND_MAX - 0.5f) * spread,
-                topJet ? speed : -speed,
-                ((float)rand() / RAND_MAX - 0.5f) * spread
-            };
-            
-            p.maxLife = 2.5f + (float)rand() / RAND_MAX * 1.5f;
-            p.life = p.maxLife;
-            
-            particles.push_back(p);
-        }
-        
-        for (size_t i = 0; i < particles.size(); i++) {
-            JetParticle& p = particles[i];
-            
-            p.pos = Vector3Add(p.pos, Vector3Scale(p.vel, dt));
-            p.life -= dt;
-            
-            p.vel.x += sinf(time * 6.0f + p.pos.y) * 0.08f * dt;
-            p.vel.z += cosf(time * 6.0f + p.pos.y) * 0.08f * dt;
-            
-            if (p.life <= 0) {
-                p.life = p.maxLife;
-                float angle = (float)rand() / RAND_MAX * BH_PI * 2.0f;
-                float radius = 0.2f + (float)rand() / RAND_MAX * 0.4f;
-                p.pos = blackHole->position;
-                p.pos.x += cosf(angle) * radius;
-                p.pos.z += sinf(angle) * radius;
-                p.pos.y += topJet ? blackHole->eventHorizonRadius : -blackHole->eventHorizonRadius;
-                float speed = 10.0f + (float)rand() / RAND_MAX * 5.0f;
-                p.vel = {((float)rand() / RAND_MAX - 0.5f) * 0.15f, topJet ? speed : -speed, ((float)rand() / RAND_MAX - 0.5f) * 0.15f};
-            }
+    unsigned int vao;
+    unsigned int positionVbo;
+    unsigned int colorVbo;
+    int capacity;
+    
+    BatchRenderer() {
+        vao = 0;
+        positionVbo = 0;
+        colorVbo = 0;
+        capacity = 0;
+    }
+    
+    ~BatchRenderer() {
+        release();
+    }
+    
+    void release() {
+        if (vao == 0) return;
+        rlUnloadVertexBuffer(positionVbo);
+        rlUnloadVertexBuffer(colorVbo);
+        rlUnloadVertexArray(vao);
+        vao = 0;
+        capacity = 0;
+    }
+    
+    void upload(const VertexBatch& batch) {
+        BH_PROFILE_SCOPE("BatchRenderer::upload");
+        if (batch.vertexCount == 0) return;
+        if (batch.vertexCount > capacity) {
+            release();
+            capacity = batch.vertexCount + batch.vertexCount / 2;
+            int* locs = rlGetShaderLocsDefault();
+            
+            vao = rlLoadVertexArray();
+            rlEnableVertexArray(vao);
+            positionVbo = rlLoadVertexBuffer(nullptr, capacity * (int)sizeof(Vector3), true);
+            rlSetVertexAttribute(locs[RL_SHADER_LOC_VERTEX_POSITION], 3, RL_FLOAT, false, 0, 0);
+            rlEnableVertexAttribute(locs[RL_SHADER_LOC_VERTEX_POSITION]);
+            colorVbo = rlLoadVertexBuffer(nullptr, capacity * (int)sizeof(Color), true);
+            rlSetVertexAttribute(locs[RL_SHADER_LOC_VERTEX_COLOR], 4, RL_UNSIGNED_BYTE, true, 0, 0);
+            rlEnableVertexAttribute(locs[RL_SHADER_LOC_VERTEX_COLOR]);
+            rlDisableVertexArray();
         }
+        rlUpdateVertexBuffer(positionVbo, batch.positions.data(), batch.vertexCount * (int)sizeof(Vector3), 0);
+        rlUpdateVertexBuffer(colorVbo, batch.colors.data(), batch.vertexCount * (int)sizeof(Color), 0);
     }
     
-    void draw() {
-        for (const JetParticle& p : particles) {
-            float t = p.life / p.maxLife;
-            Color c = {
-                (unsigned char)(120 + 135 * t),
-                (unsigned char)(180 + 75 * t),
-                255,
-                (unsigned char)(t * 255)
-            };
-            DrawPoint3D(p.pos, c);
-        }
+    // Must be called inside BeginMode3D so the current matrices are the camera's.
+    void draw(BatchRange range) {
+        BH_PROFILE_SCOPE("BatchRenderer::draw");
+        if (range.count == 0 || vao == 0) return;
+        
+        // Flush rlgl's own batch first so primitives keep their draw order.
+        rlDrawRenderBatchActive();
+        
+        int* locs = rlGetShaderLocsDefault();
+        float white[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        rlEnableShader(rlGetShaderIdDefault());
+        rlSetUniformMatrix(locs[RL_SHADER_LOC_MATRIX_MVP], MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection()));
+        rlSetUniform(locs[RL_SHADER_LOC_COLOR_DIFFUSE], white, RL_SHADER_UNIFORM_VEC4, 1);
+        rlActiveTextureSlot(0);
+        rlEnableTexture(rlGetTextureIdDefault());
+        
+        rlEnableVertexArray(vao);
+        glDrawArrays(RL_LINES, range.first, range.count);
+        rlDisableVertexArray();
+        
+        rlDisableTexture();
+        rlDisableShader();
     }
 };
 
-class EventHorizon {
-public:
-    BlackHole* blackHole;
-    Model sphereModel;
-    
-    EventHorizon(BlackHole* bh) {
-        blackHole = bh;
-        sphereModel = LoadModelFromMesh(GenMeshSphere(blackHole->eventHorizonRadius, 32, 32));
+#if BH_PROFILE
+// Per-zone frame times over the profiler's rolling window, slowest first.
+static void drawProfilerOverlay(int x, int y) {
+    Profiler& profiler = Profiler::instance();
+    int count = profiler.zoneCount();
+    std::vector<std::pair<ProfileStats, int>> rows;
+    for (int i = 0; i < count; i++) rows.push_back({profiler.stats(i), i});
+    std::sort(rows.begin(), rows.end(), [](const std::pair<ProfileStats, int>& a, const std::pair<ProfileStats, int>& b) {
+        return a.first.mean > b.first.mean;
+    });
+    
+    DrawRectangle(x, y, 460, 44 + count * 16, {0, 0, 0, 180});
+    DrawText(TextFormat("PROFILER (ms, last %d frames)", PROFILE_HISTORY), x + 10, y + 8, 14, WHITE);
+    const char* headers[4] = {"mean", "p50", "p95", "p99"};
+    for (int c = 0; c < 4; c++) DrawText(headers[c], x + 250 + c * 52, y + 26, 12, GRAY);
+    for (int r = 0; r < count; r++) {
+        const ProfileStats& s = rows[r].first;
+        int rowY = y + 42 + r * 16;
+        float values[4] = {s.mean, s.p50, s.p95, s.p99};
+        DrawText(profiler.zoneName(rows[r].second), x + 10, rowY, 12, {200, 200, 200, 255});
+        for (int c = 0; c < 4; c++) {
+            Color color = values[c] > 8.0f ? RED : values[c] > 2.0f ? ORANGE : GREEN;
+            DrawText(TextFormat("%.3f", values[c]), x + 250 + c * 52, rowY, 12, color);
+        }
     }
-    
-    ~EventHorizon() {
-        UnloadModel(sphereModel);
+}
+#endif
+
+int main(int argc, char** argv) {
+    int threadCount = 0;
+    uint64_t seed = DEFAULT_SCENE_SEED;
+    const char* lensingPath = "lensing.bhlt";
+    const char* catalogPath = nullptr;
+    StarCatalog catalog;
+    const char* snapshotPath = nullptr;
+    bool pipelineEnabled = false;
+    bool multirateEnabled = false;
+    FrameCapture capture;
+    bool captureEnabled = false;
+    long long captureLimit = 0;
+    float captureFps = 60.0f;
+    const char* tracePath = nullptr;
+    int gridSize = 30;
+    int streamerCount = 25;
+    float theta = 0.6f;
+    int diskCount = 20000;
+    bool compactDisk = false;
+    float startTime = 0;
+    QualityGovernor governor;
+    bool governorEnabled = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threadCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--lensing") == 0 && i + 1 < argc) lensingPath = argv[++i];
+        else if (strcmp(argv[i], "--catalog") == 0 && i + 1 < argc) catalogPath = argv[++i];
+        else if (strcmp(argv[i], "--catalog-mag") == 0 && i + 1 < argc) catalog.baseMagnitude = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) snapshotPath = argv[++i];
+        else if (strcmp(argv[i], "--pipeline") == 0) pipelineEnabled = true;
+        else if (strcmp(argv[i], "--multirate") == 0) multirateEnabled = true;
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            captureEnabled = parseCaptureFormat(argv[++i], capture.format);
+            if (!captureEnabled) TraceLog(LOG_WARNING, "CAPTURE: Unknown format %s", argv[i]);
+        }
+        else if (strcmp(argv[i], "--capture-out") == 0 && i + 1 < argc) capture.pattern = argv[++i];
+        else if (strcmp(argv[i], "--capture-pipe") == 0 && i + 1 < argc) capture.pipeCommand = argv[++i];
+        else if (strcmp(argv[i], "--capture-ring") == 0 && i + 1 < argc) capture.ringSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--capture-writers") == 0 && i + 1 < argc) capture.writerCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--capture-frames") == 0 && i + 1 < argc) captureLimit = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--capture-fps") == 0 && i + 1 < argc) captureFps = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--capture-drop") == 0) capture.dropWhenFull = true;
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+        else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) gridSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--streamers") == 0 && i + 1 < argc) streamerCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--theta") == 0 && i + 1 < argc) theta = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--disk") == 0 && i + 1 < argc) diskCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--compact-disk") == 0) compactDisk = true;
+        else if (strcmp(argv[i], "--start-time") == 0 && i + 1 < argc) startTime = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc) {
+            governor.targetMs = (float)atof(argv[++i]);
+            governorEnabled = governor.targetMs > 0;
+        }
     }
+#if BH_PROFILE
+    if (tracePath) Profiler::instance().startTrace();
+#else
+    if (tracePath) TraceLog(LOG_WARNING, "PROFILER: Built with BH_PROFILE=0, --trace ignored");
+#endif
+    TaskScheduler scheduler(threadCount);
     
-    void draw() {
-        DrawModel(sphereModel, blackHole->position, 1.0f, BLACK);
-    }
-};
-
-int main() {
     SetConfigFlags(FLAG_MSAA_4X_HINT);
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Black Hole Simulation - Press ESC to exit");
     
@@ -756,36 +480,258 @@ int main() {
     
     DisableCursor();
     
+    // Resume from the snapshot when there is one. The reader is declared
+    // before the scene because the disk arrays stay mapped from it; the
+    // subsystems are built empty and filled from the file.
+    SnapshotReader snapshot;
+    double snapshotStart = GetTime();
+    bool resumed = snapshotPath && snapshot.open(snapshotPath);
+    
     BlackHole blackHole;
+    blackHole.seed = seed;
+    if (resumed && !snapshotLoad(snapshot, blackHole)) {
+        TraceLog(LOG_WARNING, "SNAPSHOT: %s has no black hole, starting fresh", snapshotPath);
+        snapshot.close();
+        resumed = false;
+    }
+    if (resumed) {
+        seed = blackHole.seed;
+        compactDisk = snapshot.count<uint16_t>(SNAPSHOT_COMPACT_ANGLE) > 0;
+        diskCount = 0;
+        streamerCount = 0;
+    }
     SpacetimeGrid spacetimeGrid(&blackHole);
+    spacetimeGrid.gridSize = gridSize;
+    spacetimeGrid.scheduler = &scheduler;
     GravityFieldLines gravityField(&blackHole);
+    gravityField.scheduler = &scheduler;
     EinsteinRing einsteinRing(&blackHole);
-    AccretionDisk accretionDisk(&blackHole, 20000);
+    AccretionDisk accretionDisk(&blackHole, compactDisk ? 0 : diskCount);
+    CompactAccretionDisk compactAccretionDisk(&blackHole, compactDisk ? diskCount : 0);
     DiskGlow diskGlow(&blackHole);
+    diskGlow.colorTable.scheduler = &scheduler;
+    accretionDisk.colorTable.scheduler = &scheduler;
+    compactAccretionDisk.colorTable.scheduler = &scheduler;
     PhotonSphere photonSphere(&blackHole);
-    Starfield starfield(3000);
-    InfallingMatter infallingMatter(&blackHole, 25);
+    Starfield starfield(resumed ? 0 : 3000, seed);
+    InfallingMatter infallingMatter(&blackHole, streamerCount);
+    infallingMatter.tree.theta = theta;
     JetStream topJet(&blackHole, true, 400);
     JetStream bottomJet(&blackHole, false, 400);
     EventHorizon eventHorizon(&blackHole);
+    if (resumed) {
+        bool complete = snapshotLoad(snapshot, accretionDisk) & snapshotLoad(snapshot, compactAccretionDisk) &
+            snapshotLoad(snapshot, photonSphere) & snapshotLoad(snapshot, starfield) &
+            snapshotLoad(snapshot, infallingMatter) & snapshotLoad(snapshot, topJet) & snapshotLoad(snapshot, bottomJet);
+        if (complete) {
+            TraceLog(LOG_INFO, "SNAPSHOT: Mapped %s (%d disk particles, %.1f MB) in %.2f ms", snapshotPath,
+                     accretionDisk.particleCount + compactAccretionDisk.particleCount,
+                     snapshot.bytes() / (1024.0 * 1024.0), (GetTime() - snapshotStart) * 1000.0);
+        } else {
+            TraceLog(LOG_WARNING, "SNAPSHOT: %s is missing sections, some subsystems start empty", snapshotPath);
+        }
+    }
+    VertexBatch geometry;
+    BatchRenderer batchRenderer;
+    
+    // Map the deflection table, or build and save it on first run.
+    LensingTable lensingTable;
+    LensedSky lensedSky;
+    double lensingStart = GetTime();
+    if (lensingTable.load(lensingPath)) {
+        TraceLog(LOG_INFO, "LENSING: Mapped %s in %.2f ms", lensingPath, (GetTime() - lensingStart) * 1000.0);
+    } else {
+        lensingTable.generate(scheduler);
+        TraceLog(LOG_INFO, "LENSING: Generated table in %.2f ms", (GetTime() - lensingStart) * 1000.0);
+        if (!lensingTable.save(lensingPath)) TraceLog(LOG_WARNING, "LENSING: Cannot write %s", lensingPath);
+    }
+    
+    if (catalogPath) {
+        double catalogStart = GetTime();
+        if (catalog.load(catalogPath)) {
+            TraceLog(LOG_INFO, "CATALOG: Mapped %s (%u stars, %d tiles) in %.2f ms", catalogPath,
+                     catalog.starCount, catalog.tileCount, (GetTime() - catalogStart) * 1000.0);
+        } else {
+            TraceLog(LOG_WARNING, "CATALOG: Cannot load %s, using generated stars", catalogPath);
+        }
+    }
+    
+    // Captured runs step at a fixed rate so the footage plays back at the
+    // right speed however long each frame took to render.
+    if (captureEnabled && !capture.start(GetRenderWidth(), GetRenderHeight())) {
+        TraceLog(LOG_WARNING, "CAPTURE: Cannot start %s capture", capture.format == CAPTURE_PIPE ? "pipe" : "file");
+        captureEnabled = false;
+    }
+    
+    // Scales every tunable subsystem to the governor's level, relative to
+    // the sizes configured on the command line.
+    auto applyQuality = [&](const QualityLevel& q, float now) {
+        accretionDisk.setActiveCount((int)(accretionDisk.particleCount * q.diskFraction), now, scheduler);
+        compactAccretionDisk.setActiveCount((int)(compactAccretionDisk.particleCount * q.diskFraction), now, scheduler);
+        starfield.activeCount = (int)(starfield.starCount * q.starFraction);
+        // Catalog star counts grow about 10^(0.4 m), so this keeps the same fraction.
+        catalog.magnitudeOffset = 2.5f * log10f(q.starFraction);
+        diskGlow.segments = std::max(12, (int)(80 * q.glowFraction));
+        diskGlow.rings = std::max(6, (int)(25 * q.glowFraction));
+        einsteinRing.segments = std::max(16, (int)(128 * q.ringFraction));
+        einsteinRing.layers = q.ringLayers;
+        spacetimeGrid.gridSize = std::max(6, (int)(gridSize * q.gridFraction));
+    };
     
     float time = 0;
+    if (startTime > 0 && !resumed) {
+        time = startTime;
+        accretionDisk.seek(time, scheduler);
+        compactAccretionDisk.seek(time, scheduler);
+    }
+    float frontTime = time;         // clock of the state being drawn
     bool autoRotate = true;
     float autoRotateSpeed = 0.08f;
     float cameraAngle = 0;
     float cameraHeight = 8.0f;
     float cameraDistance = 28.0f;
+    SnapshotView view;
+    if (resumed && snapshotLoad(snapshot, view)) {
+        camera = view.camera;
+        time = view.time;
+        frontTime = time;
+        cameraAngle = view.cameraAngle;
+        cameraHeight = view.cameraHeight;
+        cameraDistance = view.cameraDistance;
+        autoRotateSpeed = view.autoRotateSpeed;
+        autoRotate = view.autoRotate != 0;
+    }
+    
+    // Streams the whole scene out; the mapped arrays are copied first so
+    // the file can be replaced.
+    auto saveSnapshot = [&]() {
+        double saveStart = GetTime();
+        snapshot.detach();
+        accretionDisk.synchronize(scheduler);
+        view = {camera, frontTime, cameraAngle, cameraHeight, cameraDistance, autoRotateSpeed, autoRotate ? 1 : 0};
+        SnapshotWriter writer;
+        snapshotSave(writer, view);
+        snapshotSave(writer, blackHole);
+        snapshotSave(writer, accretionDisk);
+        snapshotSave(writer, compactAccretionDisk);
+        snapshotSave(writer, photonSphere);
+        snapshotSave(writer, starfield);
+        snapshotSave(writer, infallingMatter);
+        snapshotSave(writer, topJet);
+        snapshotSave(writer, bottomJet);
+        if (writer.write(snapshotPath)) {
+            TraceLog(LOG_INFO, "SNAPSHOT: Wrote %s (%.1f MB) in %.2f ms", snapshotPath,
+                     writer.bytes() / (1024.0 * 1024.0), (GetTime() - saveStart) * 1000.0);
+        } else {
+            TraceLog(LOG_WARNING, "SNAPSHOT: Cannot write %s", snapshotPath);
+        }
+    };
+    
+    // Pipelined mode: the step for the next frame runs on the workers while
+    // this frame is drawn from the front buffers, and the buffers swap at the
+    // top of the next frame. The state on screen is one step older, so
+    // simulation latency grows by about a frame while the frame time drops
+    // towards max(update, draw).
+    TaskGroup stepTasks;
+    bool stepInFlight = false;
+    float stepTime = time;          // clock of the step in flight
+    double stepLaunch = 0;          // when it was launched
+    double frontLaunch = 0;         // when the drawn state's step was launched
+    float frameMsAvg = 0;
+    float latencyMsAvg = 0;
+    auto setPipelined = [&](bool enabled) {
+        accretionDisk.setPipelined(enabled);
+        compactAccretionDisk.setPipelined(enabled);
+        infallingMatter.setPipelined(enabled);
+        topJet.setPipelined(enabled);
+        bottomJet.setPipelined(enabled);
+    };
+    auto swapBuffers = [&]() {
+        accretionDisk.swapBuffers();
+        compactAccretionDisk.swapBuffers();
+        infallingMatter.swapBuffers();
+        topJet.swapBuffers();
+        bottomJet.swapBuffers();
+    };
+    auto pipelineBytes = [&]() {
+        return accretionDisk.pipelineBytes() + compactAccretionDisk.pipelineBytes() +
+            infallingMatter.pipelineBytes() + topJet.pipelineBytes() + bottomJet.pipelineBytes();
+    };
+    if (pipelineEnabled) setPipelined(true);
+    if (multirateEnabled) accretionDisk.setMultirate(true, scheduler);
     
     bool showGrid = true;
     bool showFieldLines = true;
+    bool showLensing = true;
+    bool showProfiler = false;
+    bool viewCulling = true;
+    BlackHoleParameter editedParameter = BH_PARAM_MASS;
+    ViewCuller viewCuller;
+    float updateMsAvg = 0;
     
     while (!WindowShouldClose()) {
-        float dt = GetFrameTime();
+        BH_PROFILE_END_FRAME();
+        BH_PROFILE_SCOPE("Frame");
+        // Sync point: the step launched last frame becomes the front buffer.
+        // Everything below may touch the simulation again.
+        if (stepInFlight) {
+            BH_PROFILE_SCOPE("PipelineSync");
+            double syncStart = GetTime();
+            scheduler.wait(stepTasks);
+            swapBuffers();
+            stepInFlight = false;
+            frontTime = stepTime;
+            frontLaunch = stepLaunch;
+            updateMsAvg += ((float)((GetTime() - syncStart) * 1000.0) - updateMsAvg) * 0.05f;
+        }
+        float dt = captureEnabled && captureFps > 0 ? 1.0f / captureFps : GetFrameTime();
+        // Scrub the disk in closed form: [ and ] jump 10 s, 60 s with shift.
+        // The update below then steps it to the new time + dt like any frame.
+        if (IsKeyPressed(KEY_LEFT_BRACKET) || IsKeyPressed(KEY_RIGHT_BRACKET)) {
+            float jump = IsKeyDown(KEY_LEFT_SHIFT) ? 60.0f : 10.0f;
+            time = std::max(0.0f, time + (IsKeyPressed(KEY_LEFT_BRACKET) ? -jump : jump));
+            accretionDisk.seek(time, scheduler);
+            compactAccretionDisk.seek(time, scheduler);
+            frontTime = time;
+        }
         time += dt;
         
         if (IsKeyPressed(KEY_SPACE)) autoRotate = !autoRotate;
         if (IsKeyPressed(KEY_G)) showGrid = !showGrid;
         if (IsKeyPressed(KEY_F)) showFieldLines = !showFieldLines;
+        if (IsKeyPressed(KEY_L)) showLensing = !showLensing;
+        if (IsKeyPressed(KEY_P)) showProfiler = !showProfiler;
+        if (IsKeyPressed(KEY_N)) infallingMatter.selfGravity = !infallingMatter.selfGravity;
+        if (IsKeyPressed(KEY_C)) viewCulling = !viewCulling;
+        if (IsKeyPressed(KEY_F5) && snapshotPath) saveSnapshot();
+        if (IsKeyPressed(KEY_M)) {
+            multirateEnabled = !multirateEnabled;
+            accretionDisk.setMultirate(multirateEnabled, scheduler);
+        }
+        if (IsKeyPressed(KEY_V)) {
+            pipelineEnabled = !pipelineEnabled;
+            setPipelined(pipelineEnabled);
+            updateMsAvg = 0;
+        }
+        if (IsKeyPressed(KEY_Q)) {
+            governorEnabled = !governorEnabled;
+            governor.reset(QUALITY_LEVEL_COUNT - 1);
+            applyQuality(governor.settings(), time);
+        }
+        
+        // Governed on the real frame time, also while capturing at a fixed step.
+        if (governorEnabled && governor.update(GetFrameTime() * 1000.0f)) {
+            applyQuality(governor.settings(), time);
+            TraceLog(LOG_INFO, "QUALITY: %s", governor.lastDecision);
+        }
+        // Live tuning: Tab picks a parameter, - and = scale it by 50% a second
+        // while held. No step is in flight here; the disk, grid, glow and
+        // field lines pick the change up themselves.
+        if (IsKeyPressed(KEY_TAB)) editedParameter = (BlackHoleParameter)((editedParameter + 1) % BH_PARAM_COUNT);
+        if (IsKeyDown(KEY_MINUS) != IsKeyDown(KEY_EQUAL)) {
+            float rate = IsKeyDown(KEY_EQUAL) ? 0.5f : -0.5f;
+            blackHole.setParameter(editedParameter, *blackHole.parameter(editedParameter) * expf(rate * dt));
+        }
         if (IsKeyPressed(KEY_UP)) autoRotateSpeed += 0.02f;
         if (IsKeyPressed(KEY_DOWN)) autoRotateSpeed -= 0.02f;
         
@@ -813,44 +759,187 @@ int main() {
             camera.target = blackHole.position;
         }
         
+        float screenHeight = (float)GetScreenHeight();
+        diskGlow.updateLod(camera, screenHeight, dt);
+        einsteinRing.updateLod(camera, screenHeight, dt);
+        eventHorizon.updateLod(camera, screenHeight, dt);
+        
+        if (IsKeyPressed(KEY_T)) {
+            spacetimeGrid.cache.finish();
+            gravityField.cache.finish();
+            diskGlow.colorTable.cache.finish();
+            accretionDisk.colorTable.cache.finish();
+            compactAccretionDisk.colorTable.cache.finish();
+            int next = scheduler.threadCount() * 2;
+            if (scheduler.threadCount() == TaskScheduler::hardwareThreads()) next = 1;
+            scheduler.resize(next < TaskScheduler::hardwareThreads() ? next : TaskScheduler::hardwareThreads());
+        }
+        
+        double updateStart = GetTime();
         blackHole.update(dt);
-        accretionDisk.update(dt);
-        infallingMatter.update(dt);
-        topJet.update(dt, time);
-        bottomJet.update(dt, time);
+        
+        // dt and the clock are copied: in pipelined mode the tasks outlive
+        // this iteration.
+        stepTime = time;
+        if (compactDisk) {
+            compactAccretionDisk.requantize(scheduler);
+            scheduler.run(stepTasks, [&, dt]() { compactAccretionDisk.update(dt, scheduler); });
+        } else {
+            accretionDisk.rebucket(scheduler);
+            scheduler.run(stepTasks, [&, dt]() { accretionDisk.update(dt, scheduler); });
+        }
+        scheduler.run(stepTasks, [&, dt]() { infallingMatter.update(dt, scheduler); });
+        scheduler.run(stepTasks, [&, dt, stepTime]() { topJet.update(dt, stepTime); });
+        scheduler.run(stepTasks, [&, dt, stepTime]() { bottomJet.update(dt, stepTime); });
+        if (pipelineEnabled) {
+            stepInFlight = true;
+            stepLaunch = updateStart;
+        } else {
+            scheduler.wait(stepTasks);
+            frontTime = time;
+            frontLaunch = updateStart;
+            float updateMs = (float)((GetTime() - updateStart) * 1000.0);
+            updateMsAvg += (updateMs - updateMsAvg) * 0.05f;
+        }
+        
+        viewCuller.setup(camera, (float)GetScreenWidth() / GetScreenHeight(),
+                         blackHole.position, blackHole.eventHorizonRadius);
+        ViewCuller* culler = viewCulling ? &viewCuller : nullptr;
+        
+        geometry.clear();
+        if (showLensing) lensedSky.prepare(lensingTable, blackHole, camera.position);
+        if (catalog.valid()) catalog.draw(geometry, frontTime, camera.fovy, showLensing ? &lensedSky : nullptr, culler);
+        else starfield.draw(geometry, frontTime, showLensing ? &lensedSky : nullptr, culler);
+        BatchRange starRange = geometry.endRange();
+        if (showGrid) spacetimeGrid.draw(geometry, frontTime);
+        BatchRange gridRange = geometry.endRange();
+        diskGlow.draw(geometry, frontTime, camera);
+        if (compactDisk) compactAccretionDisk.draw(geometry, camera, scheduler, culler);
+        else accretionDisk.draw(geometry, frontTime, camera, culler);
+        BatchRange diskRange = geometry.endRange();
+        einsteinRing.draw(geometry, frontTime, camera);
+        BatchRange ringRange = geometry.endRange();
+        infallingMatter.draw(geometry);
+        BatchRange infallRange = geometry.endRange();
+        batchRenderer.upload(geometry);
         
         BeginDrawing();
         ClearBackground({1, 1, 4, 255});
         
         BeginMode3D(camera);
         
-        starfield.draw(time);
-        if (showGrid) spacetimeGrid.draw(time);
-        if (showFieldLines) gravityField.draw(time);
-        diskGlow.draw(time);
-        accretionDisk.draw(time);
-        photonSphere.draw(time);
-        infallingMatter.draw();
-        topJet.draw();
-        bottomJet.draw();
-        einsteinRing.draw(time, camera);
+        batchRenderer.draw(starRange);
+        batchRenderer.draw(gridRange);
+        if (showFieldLines) gravityField.draw(frontTime);
+        batchRenderer.draw(diskRange);
+        photonSphere.draw(frontTime, culler);
+        batchRenderer.draw(infallRange);
+        topJet.draw(culler);
+        bottomJet.draw(culler);
+        batchRenderer.draw(ringRange);
         eventHorizon.draw();
         
         EndMode3D();
         
-        DrawRectangle(10, 10, 300, 180, {0, 0, 0, 180});
+        // Read back the scene before the HUD goes on top.
+        if (captureEnabled) {
+            rlDrawRenderBatchActive();
+            unsigned char* pixels = capture.acquire();
+            if (pixels) {
+                glReadPixels(0, 0, capture.frameWidth(), capture.frameHeight(), BH_GL_RGBA, BH_GL_UNSIGNED_BYTE, pixels);
+                capture.submit();
+            }
+        }
+        
+        int hudBottom = 269;
+        DrawRectangle(10, 10, 300, 259 + (viewCulling ? 51 : 34) + (governorEnabled ? 34 : 0) + (pipelineEnabled ? 34 : 17) + 34 +
+                      (captureEnabled ? 17 : 0),
+                      {0, 0, 0, 180});
         DrawText("BLACK HOLE", 20, 20, 28, WHITE);
         DrawText(TextFormat("FPS: %d", GetFPS()), 20, 55, 20, GREEN);
-        DrawText(TextFormat("Particles: %d", (int)accretionDisk.particles.size()), 20, 80, 16, {200, 200, 200, 255});
-        DrawText("---------------------------", 20, 100, 12, GRAY);
-        DrawText("WASD - Camera | Scroll - Zoom", 20, 115, 14, GRAY);
-        DrawText("SPACE - Auto Rotate", 20, 132, 14, GRAY);
-        DrawText("G - Toggle Grid", 20, 149, 14, showGrid ? GREEN : GRAY);
-        DrawText("F - Toggle Field Lines", 20, 166, 14, showFieldLines ? GREEN : GRAY);
+        DrawText(TextFormat("Particles: %d", accretionDisk.particleCount + compactAccretionDisk.particleCount), 20, 80, 16, {200, 200, 200, 255});
+        DrawText(TextFormat("%s: %.2f ms (%d threads) | t %.0f s", pipelineEnabled ? "Sync wait" : "Update",
+                            updateMsAvg, scheduler.threadCount(), frontTime), 20, 98, 16, {200, 200, 200, 255});
+        DrawText("---------------------------", 20, 118, 12, GRAY);
+        DrawText("WASD - Camera | Scroll - Zoom", 20, 133, 14, GRAY);
+        DrawText("SPACE - Auto Rotate", 20, 150, 14, GRAY);
+        DrawText("G - Toggle Grid", 20, 167, 14, showGrid ? GREEN : GRAY);
+        DrawText("F - Toggle Field Lines", 20, 184, 14, showFieldLines ? GREEN : GRAY);
+        DrawText("L - Toggle Star Lensing", 20, 201, 14, showLensing ? GREEN : GRAY);
+        DrawText("T - Cycle Update Threads", 20, 218, 14, GRAY);
+        DrawText("P - Profiler Overlay", 20, 235, 14, showProfiler ? GREEN : GRAY);
+        DrawText("N - Toggle Gas Self-Gravity", 20, 252, 14, infallingMatter.selfGravity ? GREEN : GRAY);
+        DrawText("C - View Culling", 20, hudBottom, 14, viewCulling ? GREEN : GRAY);
+        hudBottom += 17;
+        if (viewCulling) {
+            CullStats culled = viewCuller.total();
+            long long points = culled.submitted + culled.culled;
+            DrawText(TextFormat("Culled %lld of %lld pts | %d/%d bins", culled.culled, points,
+                                culled.binsCulled, culled.bins), 20, hudBottom, 14, YELLOW);
+            hudBottom += 17;
+        }
+        DrawText("Q - Quality Governor", 20, hudBottom, 14, governorEnabled ? GREEN : GRAY);
+        hudBottom += 17;
+        if (governorEnabled) {
+            DrawText(TextFormat("Quality %d/%d | %.1f of %.1f ms", governor.level, QUALITY_LEVEL_COUNT - 1,
+                                governor.averageMs, governor.targetMs), 20, hudBottom, 14, YELLOW);
+            DrawText(governor.lastDecision, 20, hudBottom + 17, 10, GRAY);
+            hudBottom += 34;
+        }
+        DrawText(multirateEnabled && accretionDisk.activeCount > 0 ?
+                 TextFormat("M - Multirate Disk (%.0f%% stepped)", 100.0 * accretionDisk.stepped / accretionDisk.activeCount) :
+                 "M - Multirate Disk", 20, hudBottom, 14, multirateEnabled ? GREEN : GRAY);
+        hudBottom += 17;
+        DrawText(TextFormat("Tab -/= - %s: %.2f", BH_PARAM_NAMES[editedParameter], *blackHole.parameter(editedParameter)),
+                 20, hudBottom, 14, IsKeyDown(KEY_MINUS) || IsKeyDown(KEY_EQUAL) ? GREEN : GRAY);
+        hudBottom += 17;
+        DrawText("V - Pipelined Update", 20, hudBottom, 14, pipelineEnabled ? GREEN : GRAY);
+        hudBottom += 17;
+        if (pipelineEnabled) {
+            DrawText(TextFormat("Frame %.2f ms | latency %.2f ms | +%.1f MB", frameMsAvg, latencyMsAvg,
+                                pipelineBytes() / (1024.0 * 1024.0)), 20, hudBottom, 14, YELLOW);
+            hudBottom += 17;
+        }
+        if (captureEnabled) {
+            DrawText(TextFormat("REC %lld | %lld dropped | %lld stalls", capture.submitted(), capture.dropped(), capture.stalls()),
+                     20, hudBottom, 14, RED);
+        }
+#if BH_PROFILE
+        if (showProfiler) drawProfilerOverlay(SCREEN_WIDTH - 470, 10);
+#endif
+        
+        {
+            BH_PROFILE_SCOPE("EndDrawing");
+            EndDrawing();
+        }
+        // Latency: from launching the drawn state's step to presenting it.
+        frameMsAvg += (GetFrameTime() * 1000.0f - frameMsAvg) * 0.05f;
+        latencyMsAvg += ((float)((GetTime() - frontLaunch) * 1000.0) - latencyMsAvg) * 0.05f;
         
-        EndDrawing();
+        if (captureEnabled && captureLimit > 0 && capture.submitted() + capture.dropped() >= captureLimit) break;
     }
     
+    if (stepInFlight) {
+        scheduler.wait(stepTasks);
+        swapBuffers();
+        frontTime = stepTime;
+    }
+    if (snapshotPath) saveSnapshot();
+    if (captureEnabled) {
+        capture.stop();
+        TraceLog(LOG_INFO, "CAPTURE: %lld frames written, %lld failed, %lld dropped, %lld stalls (%.1f ms waiting)",
+                 capture.written(), capture.failed(), capture.dropped(), capture.stalls(), capture.stallMs());
+    }
+#if BH_PROFILE
+    if (tracePath) {
+        if (Profiler::instance().writeTrace(tracePath)) {
+            TraceLog(LOG_INFO, "PROFILER: Wrote %s (%lld events dropped)", tracePath, Profiler::instance().traceDropped());
+        } else {
+            TraceLog(LOG_WARNING, "PROFILER: Cannot write %s", tracePath);
+        }
+    }
+#endif
+    batchRenderer.release();
     CloseWindow();
     return 0;
 }
\ No newline at end of file
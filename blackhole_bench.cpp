@@ -0,0 +1,1302 @@
+#include "simulation.h"
+#include "scene_geometry.h"
+#include "compact_disk.h"
+#include "platform.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Headless benchmark: steps the simulation without a window and prints the
+// results as JSON. Needs only the raylib headers, not the library.
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double elapsedNs(BenchClock::time_point start) {
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+}
+
+struct BenchConfig {
+    int steps = 600;
+    int warmup = 60;
+    float dt = 1.0f / 60.0f;
+    int diskParticles = 20000;
+    int streamers = 25;
+    int jetParticles = 400;
+    int geometryFrames = 60;
+    int gridSize = 30;
+    std::vector<int> nbodyCounts;
+    float theta = 0.6f;
+    int nbodySample = 1000;
+    bool compactDisk = false;
+    int compactCheck = 100000;
+    float seekTime = 0;
+    int pipelineFrames = 0;
+    int integratorStreamers = 0;
+    bool multirate = false;
+    int retuneFrames = 0;
+    int colorSamples = 0;
+    float cameraDistance = 0;
+    bool viewCulling = true;
+    uint64_t seed = DEFAULT_SCENE_SEED;
+    std::vector<int> threads;
+    const char* outPath = nullptr;
+};
+
+struct SubsystemTiming {
+    const char* name;
+    double totalNs = 0;
+    double particleSteps = 0;
+};
+
+struct RunResult {
+    int threads;
+    SubsystemTiming blackHole = {"black_hole"};
+    SubsystemTiming disk = {"accretion_disk"};
+    SubsystemTiming infall = {"infalling_matter"};
+    SubsystemTiming jets = {"jet_streams"};
+    std::vector<double> stepNs;
+    double geometryNs = 0;
+    long long geometryVertices = 0;
+    int glowLod = 0;
+    int ringLod = 0;
+    long long pointsSubmitted = 0;
+    long long pointsCulled = 0;
+    long long binsCulled = 0;
+    long long bins = 0;
+    long long diskStepped = 0;
+};
+
+static RunResult runBench(const BenchConfig& config, int threads) {
+    RunResult result;
+    result.threads = threads;
+
+    TaskScheduler scheduler(threads);
+    BlackHole blackHole;
+    blackHole.seed = config.seed;
+    AccretionDisk accretionDisk(&blackHole, config.compactDisk ? 0 : config.diskParticles);
+    CompactAccretionDisk compactDisk(&blackHole, config.compactDisk ? config.diskParticles : 0);
+    InfallingMatter infallingMatter(&blackHole, config.streamers);
+    JetStream topJet(&blackHole, true, config.jetParticles);
+    JetStream bottomJet(&blackHole, false, config.jetParticles);
+    accretionDisk.setMultirate(config.multirate, scheduler);
+
+    float time = 0;
+    result.stepNs.reserve(config.steps);
+
+    for (int step = 0; step < config.warmup + config.steps; step++) {
+        bool measured = step >= config.warmup;
+        float dt = config.dt;
+        time += dt;
+
+        BenchClock::time_point stepStart = BenchClock::now();
+        BenchClock::time_point t = stepStart;
+        blackHole.update(dt);
+        double blackHoleNs = elapsedNs(t);
+
+        t = BenchClock::now();
+        if (config.compactDisk) compactDisk.update(dt, scheduler);
+        else accretionDisk.update(dt, scheduler);
+        double diskNs = elapsedNs(t);
+
+        t = BenchClock::now();
+        infallingMatter.update(dt, scheduler);
+        double infallNs = elapsedNs(t);
+
+        t = BenchClock::now();
+        topJet.update(dt, time);
+        bottomJet.update(dt, time);
+        double jetNs = elapsedNs(t);
+        double stepNs = elapsedNs(stepStart);
+
+        if (!measured) continue;
+        result.blackHole.totalNs += blackHoleNs;
+        result.blackHole.particleSteps += 1;
+        result.disk.totalNs += diskNs;
+        result.disk.particleSteps += config.diskParticles;
+        result.diskStepped += config.compactDisk ? config.diskParticles : accretionDisk.stepped.load();
+        result.infall.totalNs += infallNs;
+        result.infall.particleSteps += infallingMatter.streamers.size();
+        result.jets.totalNs += jetNs;
+        result.jets.particleSteps += topJet.particles.size() + bottomJet.particles.size();
+        result.stepNs.push_back(stepNs);
+    }
+
+    // CPU half of the batched renderer: the same vertex building the
+    // interactive build does each frame, minus the upload.
+    Starfield starfield(3000, config.seed);
+    SpacetimeGrid spacetimeGrid(&blackHole);
+    spacetimeGrid.gridSize = config.gridSize;
+    DiskGlow diskGlow(&blackHole);
+    EinsteinRing einsteinRing(&blackHole);
+    Camera3D camera = {0};
+    camera.position = {0, 8, 25};
+    camera.target = {0, 0, 0};
+    camera.up = {0, 1, 0};
+    camera.fovy = 60.0f;
+    camera.projection = CAMERA_PERSPECTIVE;
+    if (config.cameraDistance > 0) {
+        camera.position = Vector3Scale(Vector3Normalize(camera.position), config.cameraDistance);
+    }
+    // Settle the level of detail for a 1080-line screen before timing.
+    const float screenHeight = 1080.0f;
+    diskGlow.updateLod(camera, screenHeight, 1.0f);
+    einsteinRing.updateLod(camera, screenHeight, 1.0f);
+    result.glowLod = diskGlow.lod.level;
+    result.ringLod = einsteinRing.lod.level;
+    VertexBatch geometry;
+    ViewCuller viewCuller;
+    ViewCuller* culler = config.viewCulling ? &viewCuller : nullptr;
+
+    for (int frame = 0; frame < config.geometryFrames; frame++) {
+        BenchClock::time_point t = BenchClock::now();
+        geometry.clear();
+        diskGlow.updateLod(camera, screenHeight, config.dt);
+        einsteinRing.updateLod(camera, screenHeight, config.dt);
+        viewCuller.setup(camera, 16.0f / 9.0f, blackHole.position, blackHole.eventHorizonRadius);
+        starfield.draw(geometry, time, nullptr, culler);
+        spacetimeGrid.draw(geometry, time);
+        diskGlow.draw(geometry, time, camera);
+        if (config.compactDisk) compactDisk.draw(geometry, camera, scheduler, culler);
+        else accretionDisk.draw(geometry, time, camera, culler);
+        einsteinRing.draw(geometry, time, camera);
+        infallingMatter.draw(geometry);
+        result.geometryNs += elapsedNs(t);
+        result.geometryVertices += geometry.vertexCount;
+        CullStats culled = viewCuller.total();
+        result.pointsSubmitted += culled.submitted;
+        result.pointsCulled += culled.culled;
+        result.bins += culled.bins;
+        result.binsCulled += culled.binsCulled;
+    }
+
+    return result;
+}
+
+struct NBodyResult {
+    int bodies;
+    double buildMs = 0;
+    double forceMs = 0;
+    double directMs = 0;
+    bool directMeasured = false;
+    double rmsError = 0;
+    double maxError = 0;
+    int nodes = 0;
+};
+
+// Barnes-Hut against direct summation over the disk's particle positions.
+// Direct summation is timed in full up to 20k bodies; above that, its cost
+// is extrapolated from the sampled bodies used for the error check.
+static NBodyResult runNBody(const BenchConfig& config, int bodies, TaskScheduler& scheduler) {
+    NBodyResult result;
+    result.bodies = bodies;
+    BlackHole blackHole;
+    blackHole.seed = config.seed;
+    AccretionDisk disk(&blackHole, bodies);
+    disk.update(config.dt, scheduler);
+    const float* x = disk.posX.data();
+    const float* y = disk.posY.data();
+    const float* z = disk.posZ.data();
+    float mass = 10.0f / bodies;
+
+    BarnesHutTree tree;
+    tree.theta = config.theta;
+    AlignedBuffer<float> ax(bodies), ay(bodies), az(bodies);
+    for (int rep = 0; rep < 3; rep++) {
+        BenchClock::time_point t = BenchClock::now();
+        tree.build(x, y, z, nullptr, mass, bodies, scheduler);
+        double buildNs = elapsedNs(t);
+        t = BenchClock::now();
+        tree.computeAccelerations(scheduler, ax.data(), ay.data(), az.data());
+        double forceNs = elapsedNs(t);
+        if (rep == 0 || buildNs * 1e-6 < result.buildMs) result.buildMs = buildNs * 1e-6;
+        if (rep == 0 || forceNs * 1e-6 < result.forceMs) result.forceMs = forceNs * 1e-6;
+    }
+    result.nodes = tree.nodeCount;
+
+    int sample = std::min(bodies, config.nbodySample);
+    bool full = bodies <= 20000;
+    int checked = full ? bodies : sample;
+    std::vector<float> dx(checked), dy(checked), dz(checked);
+    BenchClock::time_point t = BenchClock::now();
+    scheduler.parallelFor(0, checked, 64, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            int i = full ? k : (int)((long long)k * bodies / checked);
+            BarnesHutTree::directAcceleration(x, y, z, nullptr, mass, bodies, tree.softening,
+                                              x[i], y[i], z[i], dx[k], dy[k], dz[k]);
+        }
+    });
+    double directNs = elapsedNs(t);
+    result.directMeasured = full;
+    result.directMs = directNs * 1e-6 * bodies / checked;
+
+    double sumSq = 0;
+    for (int k = 0; k < checked; k++) {
+        int i = full ? k : (int)((long long)k * bodies / checked);
+        double ex = ax[i] - dx[k], ey = ay[i] - dy[k], ez = az[i] - dz[k];
+        double ref = sqrt((double)dx[k] * dx[k] + (double)dy[k] * dy[k] + (double)dz[k] * dz[k]);
+        double rel = ref > 0 ? sqrt(ex * ex + ey * ey + ez * ez) / ref : 0;
+        sumSq += rel * rel;
+        result.maxError = std::max(result.maxError, rel);
+    }
+    result.rmsError = sqrt(sumSq / checked);
+    return result;
+}
+
+// Compact disk against the float path from the same seed, over the longest
+// particle lifetime (30 s). Quantization alone stays around 0.01 units; most
+// of the remaining error is the compact disk's orbital speed following the
+// slowly decaying radius, where the float path keeps the speed it spawned
+// with. Particles that have respawned in either disk are skipped: respawns
+// can land a step apart after quantization, and the compact disk re-derives
+// speed from the new radius. The bound is the length of one drawn point.
+// Colors are compared at the compact particle's own position: on the
+// approaching side a drift well inside the position bound moves the line of
+// sight enough to change the Doppler color by several levels.
+const float COMPACT_MAX_POSITION_ERROR = 0.1f;
+const int COMPACT_MAX_COLOR_ERROR = 4;
+
+struct CompactCheckResult {
+    int particles = 0;
+    int steps = 0;
+    long long compared = 0;
+    double initialMaxError = 0;
+    double rmsError = 0;
+    double maxError = 0;
+    int maxColorError = 0;
+    bool pass = false;
+};
+
+static int colorError(Color a, Color b) {
+    int e = std::max(abs(a.r - b.r), abs(a.g - b.g));
+    return std::max(e, abs(a.b - b.b));
+}
+
+// Accumulates the error of every particle neither disk has respawned yet.
+static void comparePositions(const VertexBatch& a, const VertexBatch& b, const AccretionDisk& disk,
+                             const CompactAccretionDisk& compact, CompactCheckResult& result,
+                             double& sumSq, long long& samples) {
+    for (int i = 0; i < result.particles; i++) {
+        if (disk.generation[i] != 0 || compact.generation[i] != 0) continue;
+        Vector3 p = a.positions[i * 2];
+        Vector3 q = b.positions[i * 2];
+        double dx = p.x - q.x, dy = p.y - q.y, dz = p.z - q.z;
+        double e = sqrt(dx * dx + dy * dy + dz * dz);
+        result.maxError = std::max(result.maxError, e);
+        Color expected = disk.colorTable.shade(q.x, q.z, compact.radiusAt(i));
+        result.maxColorError = std::max(result.maxColorError, colorError(expected, b.colors[i * 2]));
+        sumSq += e * e;
+        samples++;
+    }
+}
+
+static CompactCheckResult runCompactCheck(const BenchConfig& config, TaskScheduler& scheduler) {
+    CompactCheckResult result;
+    result.particles = std::min(config.diskParticles, config.compactCheck);
+    result.steps = (int)ceilf(30.0f / config.dt);
+    BlackHole blackHole;
+    blackHole.seed = config.seed;
+    AccretionDisk disk(&blackHole, result.particles);
+    CompactAccretionDisk compact(&blackHole, result.particles);
+    Camera3D camera = {0};
+    camera.position = {0, 8, 25};
+    VertexBatch a, b;
+    double sumSq = 0;
+    long long samples = 0;
+
+    // Sampled once a second from the first update on; the float path only
+    // applies the wobble once it has been updated.
+    for (int step = 0; step < result.steps; step++) {
+        disk.update(config.dt, scheduler);
+        compact.update(config.dt, scheduler);
+        if (step % 60 != 0 && step + 1 != result.steps) continue;
+        a.clear();
+        b.clear();
+        disk.draw(a, 0, camera);
+        compact.draw(b, camera, scheduler);
+        comparePositions(a, b, disk, compact, result, sumSq, samples);
+        if (step == 0) result.initialMaxError = result.maxError;
+    }
+    result.compared = samples;
+    result.rmsError = samples ? sqrt(sumSq / samples) : 0;
+    result.pass = samples > 0 && result.maxError <= COMPACT_MAX_POSITION_ERROR &&
+                  result.maxColorError <= COMPACT_MAX_COLOR_ERROR;
+    return result;
+}
+
+// Disk color table against diskColor() at random (radius, u) from the
+// horizon to the outer edge. Each fetch is held to a bound derived from the
+// table steps: a fetch reads its nearest row and the column of its step of
+// u, so the bound is twice the largest gap between that node's color and
+// the exact one over a 3 x 3 grid spanning half a row either side and the
+// step of u, plus 1 level for rounding the node and the exact color.
+struct ColorTableResult {
+    int samples = 0;
+    double buildMs = 0;
+    double fetchNs = 0;
+    double exactNs = 0;
+    double rmsError = 0;
+    double rmsBound = 0;
+    int maxError = 0;
+    double maxBound = 0;
+    int overBound = 0;        // samples past their bound
+    bool pass = false;
+};
+
+static double colorStepBound(const DiskColorInputs& in, const DiskColorTable& table, int ri, int j) {
+    double expected[3], exact[3];
+    diskColorLevels(in, DiskColorTable::nodeRadius(in, ri), DiskColorTable::nodeSpeed(table.column[j]), expected);
+    double speedStep = 2.0 / DISK_COLOR_SPEED_STEPS;
+    double worst = 0;
+    for (int a = 0; a < 3; a++) {
+        // Rows are uniform in (r - start)^1/2; below the first row is black.
+        double t = std::max(ri + (a - 1) * 0.5, 0.0) / DiskColorTable::radiusAxisScale(in);
+        double r = DiskColorTable::radiusStart(in) + t * t;
+        for (int b = 0; b < 3; b++) {
+            diskColorLevels(in, r, -1.0 + (j + b * 0.5) * speedStep, exact);
+            for (int c = 0; c < 3; c++) worst = std::max(worst, fabs(exact[c] - expected[c]));
+        }
+    }
+    return 2.0 * worst + 1.0;
+}
+
+static ColorTableResult runColorTable(const BenchConfig& config) {
+    ColorTableResult result;
+    result.samples = config.colorSamples;
+    BlackHole blackHole;
+    DiskColorInputs in = blackHole.colorInputs();
+    DiskColorTable table;
+    BenchClock::time_point t = BenchClock::now();
+    table.refresh(in);
+    result.buildMs = elapsedNs(t) * 1e-6;
+
+    CounterRng rng(config.seed, RNG_STREAM_DISK);
+    std::vector<float> radii(result.samples), speeds(result.samples);
+    for (int i = 0; i < result.samples; i++) {
+        RandomBlock r = rng.block(i, 0);
+        radii[i] = in.horizon + r.uniform(0) * (in.outer - in.horizon);
+        speeds[i] = r.uniform(1) * 2.0f - 1.0f;
+    }
+    std::vector<Color> fetched(result.samples), exact(result.samples);
+    t = BenchClock::now();
+    for (int i = 0; i < result.samples; i++) fetched[i] = table.fetch(radii[i], speeds[i]);
+    result.fetchNs = elapsedNs(t) / std::max(1, result.samples);
+    t = BenchClock::now();
+    for (int i = 0; i < result.samples; i++) exact[i] = diskColor(in, radii[i], speeds[i]);
+    result.exactNs = elapsedNs(t) / std::max(1, result.samples);
+
+    std::vector<double> stepBounds(DISK_COLOR_RADII * DISK_COLOR_SPEED_STEPS, -1.0);
+    double sumSq = 0, boundSq = 0;
+    for (int i = 0; i < result.samples; i++) {
+        int ri, j;
+        table.locate(radii[i], speeds[i], ri, j);
+        double& bound = stepBounds[ri * DISK_COLOR_SPEED_STEPS + j];
+        if (bound < 0) bound = colorStepBound(in, table, ri, j);
+        int e = colorError(fetched[i], exact[i]);
+        sumSq += (double)e * e;
+        boundSq += bound * bound;
+        result.maxError = std::max(result.maxError, e);
+        result.maxBound = std::max(result.maxBound, bound);
+        result.overBound += e > bound;
+    }
+    result.rmsError = result.samples ? sqrt(sumSq / result.samples) : 0;
+    result.rmsBound = result.samples ? sqrt(boundSq / result.samples) : 0;
+    result.pass = result.samples > 0 && result.overBound == 0;
+    return result;
+}
+
+// Closed-form seek against replaying every step up to the same time. Replay
+// respawns on the first step after a life runs out and drops the remainder,
+// so each generation starts up to one step late and the gap grows with the
+// number of respawns; it shrinks with --dt. Errors are in the disk plane.
+struct SeekResult {
+    int particles = 0;
+    double time = 0;
+    double seekMs = 0;
+    double replayMs = 0;
+    double generationMatch = 0;
+    double rmsError = 0;
+    double maxError = 0;
+};
+
+static SeekResult runSeek(const BenchConfig& config, TaskScheduler& scheduler) {
+    SeekResult result;
+    result.particles = config.diskParticles;
+    int steps = (int)ceil(config.seekTime / config.dt);
+    result.time = (double)steps * config.dt;
+    BlackHole blackHole;
+    blackHole.seed = config.seed;
+    AccretionDisk seeked(&blackHole, result.particles);
+    AccretionDisk replayed(&blackHole, result.particles);
+
+    for (int rep = 0; rep < 3; rep++) {
+        BenchClock::time_point t = BenchClock::now();
+        seeked.seek(result.time, scheduler);
+        double ms = elapsedNs(t) * 1e-6;
+        if (rep == 0 || ms < result.seekMs) result.seekMs = ms;
+    }
+    BenchClock::time_point t = BenchClock::now();
+    for (int step = 0; step < steps; step++) replayed.update(config.dt, scheduler);
+    result.replayMs = elapsedNs(t) * 1e-6;
+
+    double sumSq = 0;
+    int matched = 0;
+    for (int i = 0; i < result.particles; i++) {
+        if (seeked.generation[i] != replayed.generation[i]) continue;
+        // From the orbit state: a particle that respawned on the last step
+        // still has its old position cached until the next update.
+        double ra = seeked.orbitRadius[i], rb = replayed.orbitRadius[i];
+        double dAngle = seeked.orbitAngle[i] - replayed.orbitAngle[i];
+        double e = sqrt(ra * ra + rb * rb - 2.0 * ra * rb * cos(dAngle));
+        sumSq += e * e;
+        result.maxError = std::max(result.maxError, e);
+        matched++;
+    }
+    result.generationMatch = result.particles ? (double)matched / result.particles : 0;
+    result.rmsError = matched ? sqrt(sumSq / matched) : 0;
+    return result;
+}
+
+struct MultirateResult {
+    int particles = 0;
+    int steps = 0;
+    double fullMs = 0;
+    double multirateMs = 0;
+    double steppedFraction = 0;
+    double generationMatch = 0;
+    double rmsError = 0;
+    double maxError = 0;
+    double rmsErrorUnlagged = 0;
+    double maxErrorUnlagged = 0;
+};
+
+// Steps a multirate disk next to a full-rate one and compares the drawn
+// points of each particle (found by id) every 10 steps, with and without
+// carrying them forward by their lag. Particles whose respawn the multirate
+// disk has not caught up with yet are skipped. Halfway through the warm-up
+// both drop to a third of their particles, as the quality governor would,
+// and get the rest back when it ends, so the measured steps include the
+// reactivated particles.
+static MultirateResult runMultirateCheck(const BenchConfig& config, TaskScheduler& scheduler) {
+    MultirateResult result;
+    result.particles = config.diskParticles;
+    result.steps = config.steps;
+    BlackHole blackHole;
+    blackHole.seed = config.seed;
+    AccretionDisk full(&blackHole, result.particles);
+    AccretionDisk multirate(&blackHole, result.particles);
+    multirate.setMultirate(true, scheduler);
+
+    std::vector<int> indexOf(result.particles);
+    double sumSq = 0, sumSqUnlagged = 0, stepped = 0;
+    long long matched = 0, compared = 0;
+    for (int step = 0; step < config.warmup + config.steps; step++) {
+        bool measured = step >= config.warmup;
+        if (step == config.warmup / 2 || step == config.warmup) {
+            int count = step == config.warmup ? result.particles : result.particles / 3;
+            full.setActiveCount(count, step * config.dt, scheduler);
+            multirate.setActiveCount(count, step * config.dt, scheduler);
+        }
+        BenchClock::time_point t = BenchClock::now();
+        full.update(config.dt, scheduler);
+        double fullNs = elapsedNs(t);
+        t = BenchClock::now();
+        multirate.update(config.dt, scheduler);
+        double multirateNs = elapsedNs(t);
+        if (!measured) continue;
+        result.fullMs += fullNs * 1e-6;
+        result.multirateMs += multirateNs * 1e-6;
+        stepped += multirate.stepped;
+        if (step % 10 != 0) continue;
+
+        for (int i = 0; i < result.particles; i++) indexOf[multirate.particleId[i]] = i;
+        for (int id = 0; id < result.particles; id++) {
+            int i = indexOf[id];
+            compared++;
+            if (full.generation[id] != multirate.generation[i]) continue;
+            Vector3 expected[2], drawn[2], unlagged[2];
+            Color colors[2];
+            full.drawParticle(id, expected, colors);
+            multirate.drawParticle(i, drawn, colors, multirate.schedule.lagOf(i, multirate.rateSlot.data()));
+            multirate.drawParticle(i, unlagged, colors);
+            double e = Vector3Distance(drawn[0], expected[0]);
+            double u = Vector3Distance(unlagged[0], expected[0]);
+            sumSq += e * e;
+            sumSqUnlagged += u * u;
+            result.maxError = std::max(result.maxError, e);
+            result.maxErrorUnlagged = std::max(result.maxErrorUnlagged, u);
+            matched++;
+        }
+    }
+    result.fullMs /= std::max(1, config.steps);
+    result.multirateMs /= std::max(1, config.steps);
+    result.steppedFraction = result.particles ? stepped / ((double)result.particles * std::max(1, config.steps)) : 0;
+    result.generationMatch = compared ? (double)matched / compared : 0;
+    result.rmsError = matched ? sqrt(sumSq / matched) : 0;
+    result.rmsErrorUnlagged = matched ? sqrt(sumSqUnlagged / matched) : 0;
+    return result;
+}
+
+struct PipelineResult {
+    std::vector<double> frameMs;
+    std::vector<double> latencyMs;
+    size_t extraBytes = 0;
+    int stepsDuringDraw = 0;    // step tasks the drawing thread ran itself
+};
+
+// Frames of update plus vertex building, as the interactive loop runs them,
+// sequentially or with the next step overlapping this frame's vertex
+// building. Latency runs from launching a step to the end of the frame that
+// draws it; there is no GPU here, so both exclude the upload and present.
+// Step tasks that the drawing thread picks up while waiting inside a draw
+// are counted: they stall the frame on simulation work.
+static PipelineResult runPipeline(const BenchConfig& config, TaskScheduler& scheduler, bool pipelined, bool compact) {
+    PipelineResult result;
+    BlackHole blackHole;
+    blackHole.seed = config.seed;
+    AccretionDisk accretionDisk(&blackHole, compact ? 0 : config.diskParticles);
+    CompactAccretionDisk compactDisk(&blackHole, compact ? config.diskParticles : 0);
+    InfallingMatter infallingMatter(&blackHole, config.streamers);
+    JetStream topJet(&blackHole, true, config.jetParticles);
+    JetStream bottomJet(&blackHole, false, config.jetParticles);
+    Starfield starfield(3000, config.seed);
+    SpacetimeGrid spacetimeGrid(&blackHole);
+    spacetimeGrid.gridSize = config.gridSize;
+    DiskGlow diskGlow(&blackHole);
+    EinsteinRing einsteinRing(&blackHole);
+    Camera3D camera = {0};
+    camera.position = {0, 8, 25};
+    camera.target = {0, 0, 0};
+    camera.up = {0, 1, 0};
+    camera.fovy = 60.0f;
+    camera.projection = CAMERA_PERSPECTIVE;
+    if (config.cameraDistance > 0) {
+        camera.position = Vector3Scale(Vector3Normalize(camera.position), config.cameraDistance);
+    }
+    VertexBatch geometry;
+    ViewCuller viewCuller;
+    ViewCuller* culler = config.viewCulling ? &viewCuller : nullptr;
+
+    accretionDisk.setMultirate(config.multirate, scheduler);
+    accretionDisk.setPipelined(pipelined);
+    compactDisk.setPipelined(pipelined);
+    infallingMatter.setPipelined(pipelined);
+    topJet.setPipelined(pipelined);
+    bottomJet.setPipelined(pipelined);
+    result.extraBytes = accretionDisk.pipelineBytes() + compactDisk.pipelineBytes() +
+        infallingMatter.pipelineBytes() + topJet.pipelineBytes() + bottomJet.pipelineBytes();
+
+    TaskGroup stepTasks;
+    bool stepInFlight = false;
+    BenchClock::time_point stepLaunch, frontLaunch;
+    float time = 0, frontTime = 0;
+    const float dt = config.dt;
+    const std::thread::id drawThread = std::this_thread::get_id();
+    std::atomic<bool> drawing{false};
+    std::atomic<int> stepsDuringDraw{0};
+    auto runStep = [&](TaskScheduler::Task task) {
+        scheduler.run(stepTasks, [&, task]() {
+            if (drawing.load() && std::this_thread::get_id() == drawThread) stepsDuringDraw++;
+            task();
+        });
+    };
+    for (int frame = 0; frame < config.warmup + config.pipelineFrames; frame++) {
+        BenchClock::time_point frameStart = BenchClock::now();
+        if (stepInFlight) {
+            scheduler.wait(stepTasks);
+            accretionDisk.swapBuffers();
+            compactDisk.swapBuffers();
+            infallingMatter.swapBuffers();
+            topJet.swapBuffers();
+            bottomJet.swapBuffers();
+            frontTime = time;
+            frontLaunch = stepLaunch;
+        }
+        time += dt;
+        float stepTime = time;
+        blackHole.update(dt);
+        stepLaunch = BenchClock::now();
+        if (compact) runStep([&]() { compactDisk.update(dt, scheduler); });
+        else runStep([&]() { accretionDisk.update(dt, scheduler); });
+        runStep([&]() { infallingMatter.update(dt, scheduler); });
+        runStep([&, stepTime]() { topJet.update(dt, stepTime); });
+        runStep([&, stepTime]() { bottomJet.update(dt, stepTime); });
+        if (pipelined) {
+            stepInFlight = true;
+        } else {
+            scheduler.wait(stepTasks);
+            frontTime = time;
+            frontLaunch = stepLaunch;
+        }
+
+        drawing = true;
+        geometry.clear();
+        diskGlow.updateLod(camera, 1080.0f, dt);
+        einsteinRing.updateLod(camera, 1080.0f, dt);
+        viewCuller.setup(camera, 16.0f / 9.0f, blackHole.position, blackHole.eventHorizonRadius);
+        starfield.draw(geometry, frontTime, nullptr, culler);
+        spacetimeGrid.draw(geometry, frontTime);
+        diskGlow.draw(geometry, frontTime, camera);
+        if (compact) compactDisk.draw(geometry, camera, scheduler, culler);
+        else accretionDisk.draw(geometry, frontTime, camera, culler);
+        einsteinRing.draw(geometry, frontTime, camera);
+        infallingMatter.draw(geometry);
+        drawing = false;
+
+        if (frame < config.warmup || frame == 0) continue;
+        BenchClock::time_point frameEnd = BenchClock::now();
+        result.frameMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+        result.latencyMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - frontLaunch).count());
+    }
+    if (stepInFlight) scheduler.wait(stepTasks);
+    result.stepsDuringDraw = stepsDuringDraw;
+    return result;
+}
+
+struct RetuneResult {
+    std::vector<double> frameMs;
+    int gridRebuilds = 0;
+    int staleFrames = 0;    // frames drawn with a grid built for older parameters
+    int maxLagFrames = 0;   // how many frames old those parameters were at worst
+};
+
+// A background rebuild must keep up with the edits. Single-threaded the
+// grid is built inline, so nothing may be stale. Otherwise a rebuild lands
+// about one build time after it started, and the bench frames are
+// unthrottled: a 300-cell grid takes ~7 ms against 3-4 ms frames, and
+// twice that when the worker shares a core.
+const int RETUNE_MAX_LAG_FRAMES = 16;
+
+// Frames of disk update plus vertex building while the mass and horizon
+// swing every frame, as when tuning live. The grid is rebuilt inline or on
+// the scheduler; `edit` false gives the untouched baseline.
+static RetuneResult runRetune(const BenchConfig& config, TaskScheduler& scheduler, bool edit, bool background) {
+    RetuneResult result;
+    BlackHole blackHole;
+    blackHole.seed = config.seed;
+    AccretionDisk accretionDisk(&blackHole, config.diskParticles);
+    SpacetimeGrid spacetimeGrid(&blackHole);
+    spacetimeGrid.gridSize = config.gridSize;
+    spacetimeGrid.scheduler = background ? &scheduler : nullptr;
+    DiskGlow diskGlow(&blackHole);
+    diskGlow.colorTable.scheduler = spacetimeGrid.scheduler;
+    accretionDisk.colorTable.scheduler = spacetimeGrid.scheduler;
+    Camera3D camera = {0};
+    camera.position = {0, 8, 25};
+    VertexBatch geometry;
+    std::vector<GridInputs> requested;    // per frame
+    float time = 0;
+    const float dt = config.dt;
+    for (int frame = 0; frame < config.warmup + config.retuneFrames; frame++) {
+        BenchClock::time_point frameStart = BenchClock::now();
+        if (edit) {
+            blackHole.setParameter(BH_PARAM_MASS, 50.0f * (1.0f + 0.3f * sinf(frame * 0.05f)));
+            blackHole.setParameter(BH_PARAM_HORIZON, 2.0f * (1.0f + 0.25f * sinf(frame * 0.07f)));
+        }
+        time += dt;
+        blackHole.update(dt);
+        accretionDisk.update(dt, scheduler);
+        geometry.clear();
+        spacetimeGrid.draw(geometry, time);
+        diskGlow.draw(geometry, time, camera);
+        accretionDisk.draw(geometry, time, camera);
+
+        double frameMs = std::chrono::duration<double, std::milli>(BenchClock::now() - frameStart).count();
+        requested.push_back(spacetimeGrid.inputs());
+        int lag = 0;
+        while (lag < frame && !(requested[frame - lag] == spacetimeGrid.cache.inputs)) lag++;
+        if (frame < config.warmup) continue;
+        result.frameMs.push_back(frameMs);
+        result.staleFrames += lag > 0;
+        result.maxLagFrames = std::max(result.maxLagFrames, lag);
+    }
+    result.gridRebuilds = spacetimeGrid.cache.rebuilds;
+    return result;
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static void writeSubsystem(FILE* out, const SubsystemTiming& s, int steps, bool last) {
+    fprintf(out, "        \"%s\": {\"total_ms\": %.4f, \"ms_per_step\": %.6f, \"ns_per_particle_step\": %.4f}%s\n",
+        s.name, s.totalNs * 1e-6, steps ? s.totalNs * 1e-6 / steps : 0.0,
+        s.particleSteps > 0 ? s.totalNs / s.particleSteps : 0.0, last ? "" : ",");
+}
+
+struct IntegratorRow {
+    const char* scheme;
+    float frameRate;   // orbits only
+    float parameter;   // eta, step or tolerance
+    double evaluations = 0;
+    double rmsError = 0;
+    double maxError = 0;
+    int outcomeMismatches = 0;
+};
+
+struct IntegratorResult {
+    int streamers = 0;
+    int absorbed = 0;  // by the reference
+    float seconds = 0;
+    std::vector<IntegratorRow> orbits;
+    std::vector<IntegratorRow> fieldLines;
+};
+
+const float INTEGRATOR_SECONDS = 25.0f;
+const float INTEGRATOR_SAMPLE_SECONDS = 0.2f;
+
+// A streamer's path in double precision with RK4 at 1e-4 s, sampled every
+// INTEGRATOR_SAMPLE_SECONDS until it crosses the horizon.
+struct ReferenceOrbit {
+    std::vector<Vector3> samples;
+    bool absorbed = false;
+};
+
+static ReferenceOrbit referenceOrbit(const BlackHole& blackHole, Vector3 pos, Vector3 vel) {
+    ReferenceOrbit orbit;
+    double x[6] = {pos.x, pos.y, pos.z, vel.x, vel.y, vel.z};
+    const double h = 1e-4;
+    const int stepsPerSample = (int)lround(INTEGRATOR_SAMPLE_SECONDS / h);
+    const int samples = (int)lround(INTEGRATOR_SECONDS / INTEGRATOR_SAMPLE_SECONDS);
+    const double mass = blackHole.mass;
+    auto deriv = [mass](const double* s, double* d) {
+        double r = sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+        double scale = -mass / (std::max(r, 0.1) * std::max(r, 0.1) * r);
+        d[0] = s[3]; d[1] = s[4]; d[2] = s[5];
+        d[3] = s[0] * scale; d[4] = s[1] * scale; d[5] = s[2] * scale;
+    };
+    orbit.samples.push_back(pos);
+    for (int sample = 0; sample < samples; sample++) {
+        for (int step = 0; step < stepsPerSample; step++) {
+            double k1[6], k2[6], k3[6], k4[6], t[6];
+            deriv(x, k1);
+            for (int c = 0; c < 6; c++) t[c] = x[c] + 0.5 * h * k1[c];
+            deriv(t, k2);
+            for (int c = 0; c < 6; c++) t[c] = x[c] + 0.5 * h * k2[c];
+            deriv(t, k3);
+            for (int c = 0; c < 6; c++) t[c] = x[c] + h * k3[c];
+            deriv(t, k4);
+            for (int c = 0; c < 6; c++) x[c] += h / 6 * (k1[c] + 2 * k2[c] + 2 * k3[c] + k4[c]);
+            if (sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]) < blackHole.eventHorizonRadius) {
+                orbit.absorbed = true;
+                return orbit;
+            }
+        }
+        orbit.samples.push_back({(float)x[0], (float)x[1], (float)x[2]});
+    }
+    return orbit;
+}
+
+// Steps every streamer with `step` at the given frame rate and compares the
+// sampled positions with the reference while both are outside the horizon.
+// step(pos, vel, dt) returns the force evaluations it used.
+template <typename Step>
+static IntegratorRow measureOrbits(const char* scheme, float frameRate, float parameter, const BlackHole& blackHole,
+                                   const std::vector<InfallingMatter::Streamer>& starts,
+                                   const std::vector<ReferenceOrbit>& references, const Step& step) {
+    IntegratorRow row = {scheme, frameRate, parameter};
+    const float dt = 1.0f / frameRate;
+    const int framesPerSample = (int)lround(INTEGRATOR_SAMPLE_SECONDS * frameRate);
+    const int samples = (int)lround(INTEGRATOR_SECONDS / INTEGRATOR_SAMPLE_SECONDS);
+    long long evaluations = 0, compared = 0;
+    double sumSq = 0;
+    for (size_t i = 0; i < starts.size(); i++) {
+        Vector3 pos = starts[i].pos, vel = starts[i].vel;
+        const ReferenceOrbit& reference = references[i];
+        bool absorbed = false;
+        for (int sample = 1; sample <= samples && !absorbed; sample++) {
+            for (int frame = 0; frame < framesPerSample && !absorbed; frame++) {
+                evaluations += step(pos, vel, dt);
+                absorbed = Vector3Length(pos) < blackHole.eventHorizonRadius;
+            }
+            if (absorbed || sample >= (int)reference.samples.size()) continue;
+            double error = Vector3Distance(pos, reference.samples[sample]);
+            sumSq += error * error;
+            row.maxError = std::max(row.maxError, error);
+            compared++;
+        }
+        if (absorbed != reference.absorbed) row.outcomeMismatches++;
+    }
+    row.evaluations = (double)evaluations / (starts.size() * INTEGRATOR_SECONDS);
+    row.rmsError = compared ? sqrt(sumSq / compared) : 0;
+    return row;
+}
+
+// Field lines of a point mass run straight inward with r^3 = r0^3 - 3Ms,
+// so every sampled point can be checked exactly.
+static IntegratorRow measureFieldLines(const char* scheme, float parameter, const BlackHole& blackHole,
+                                       const std::vector<std::vector<Vector3>>& lines, long long evaluations) {
+    IntegratorRow row = {scheme, 0, parameter};
+    const float length = 15.0f;
+    long long compared = 0;
+    double sumSq = 0;
+    for (const std::vector<Vector3>& line : lines) {
+        if (line.empty()) continue;
+        double r0 = Vector3Length(line[0]);
+        for (size_t j = 0; j < line.size(); j++) {
+            double s = length * j / 100;
+            double r = cbrt(std::max(r0 * r0 * r0 - 3.0 * blackHole.mass * s, 0.0));
+            Vector3 exact = Vector3Scale(Vector3Normalize(line[0]), (float)r);
+            double error = Vector3Distance(line[j], exact);
+            sumSq += error * error;
+            row.maxError = std::max(row.maxError, error);
+            compared++;
+        }
+    }
+    row.evaluations = (double)evaluations / lines.size();
+    row.rmsError = compared ? sqrt(sumSq / compared) : 0;
+    return row;
+}
+
+static IntegratorResult runIntegrator(const BenchConfig& config) {
+    IntegratorResult result;
+    result.streamers = config.integratorStreamers;
+    result.seconds = INTEGRATOR_SECONDS;
+    BlackHole blackHole;
+    blackHole.seed = config.seed;
+    InfallingMatter matter(&blackHole, config.integratorStreamers);
+    // Every other streamer loses most of its launch speed, so it falls in on
+    // a near-radial orbit and exercises the steps close to the horizon.
+    std::vector<InfallingMatter::Streamer> starts = matter.streamers;
+    for (size_t i = 1; i < starts.size(); i += 2) starts[i].vel = Vector3Scale(starts[i].vel, 0.25f);
+    std::vector<ReferenceOrbit> references;
+    for (const InfallingMatter::Streamer& s : starts) {
+        references.push_back(referenceOrbit(blackHole, s.pos, s.vel));
+        if (references.back().absorbed) result.absorbed++;
+    }
+
+    auto gravity = [&blackHole](Vector3 p) { return blackHole.getGravity(p); };
+    const float frameRates[] = {60, 30, 15};
+    for (float frameRate : frameRates) {
+        result.orbits.push_back(measureOrbits("euler", frameRate, 0, blackHole, starts, references,
+            [&](Vector3& pos, Vector3& vel, float dt) {
+                vel = Vector3Add(vel, Vector3Scale(blackHole.getGravity(pos), dt));
+                pos = Vector3Add(pos, Vector3Scale(vel, dt));
+                return 1;
+            }));
+    }
+    const float etas[] = {0.2f, 0.1f, 0.05f, 0.02f};
+    for (float frameRate : frameRates) {
+        for (float eta : etas) {
+            LeapfrogControl control;
+            control.eta = eta;
+            result.orbits.push_back(measureOrbits("leapfrog", frameRate, eta, blackHole, starts, references,
+                [&](Vector3& pos, Vector3& vel, float dt) {
+                    return integrateLeapfrog(pos, vel, dt, blackHole.position, blackHole.mass, control, gravity,
+                        [&](Vector3 p) { return Vector3Length(p) < blackHole.eventHorizonRadius; });
+                }));
+        }
+    }
+
+    // Field lines as GravityFieldLines draws them: 24 lines of 100 points
+    // from a 25-unit ring, the old way and with RK45.
+    const float stopRadius = blackHole.eventHorizonRadius * 1.2f;
+    auto traceLines = [&](auto trace) {
+        std::vector<std::vector<Vector3>> lines(24);
+        long long evaluations = 0;
+        for (int i = 0; i < 24; i++) {
+            float angle = (float)i / 24 * BH_PI * 2.0f;
+            evaluations += trace(Vector3{cosf(angle) * 25.0f, 0, sinf(angle) * 25.0f}, lines[i]);
+        }
+        return std::make_pair(lines, evaluations);
+    };
+    auto euler = traceLines([&](Vector3 pos, std::vector<Vector3>& line) {
+        int evaluations = 0;
+        for (int step = 0; step < 100; step++) {
+            line.push_back(pos);
+            pos = Vector3Add(pos, Vector3Scale(blackHole.getGravity(pos), 0.15f));
+            evaluations++;
+            if (Vector3Length(pos) < stopRadius) break;
+        }
+        return evaluations;
+    });
+    result.fieldLines.push_back(measureFieldLines("euler", 0.15f, blackHole, euler.first, euler.second));
+    const float tolerances[] = {1e-3f, 1e-4f, 1e-5f, 1e-6f};
+    for (float tolerance : tolerances) {
+        Rk45Control control;
+        control.tolerance = tolerance;
+        auto rk45 = traceLines([&](Vector3 pos, std::vector<Vector3>& line) {
+            return sampleRk45(pos, 15.0f, 100, control, gravity,
+                [stopRadius](Vector3 p) { return Vector3Length(p) < stopRadius; }, line);
+        });
+        result.fieldLines.push_back(measureFieldLines("rk45", tolerance, blackHole, rk45.first, rk45.second));
+    }
+    return result;
+}
+
+// The cheapest row of `scheme` at least as accurate as `baseline`, by RMS
+// error; null if none is.
+static const IntegratorRow* cheapestMatching(const std::vector<IntegratorRow>& rows, const char* scheme,
+                                             const IntegratorRow& baseline) {
+    const IntegratorRow* best = nullptr;
+    for (const IntegratorRow& row : rows) {
+        if (strcmp(row.scheme, scheme) != 0 || row.rmsError > baseline.rmsError) continue;
+        if (row.outcomeMismatches > baseline.outcomeMismatches) continue;
+        if (!best || row.evaluations < best->evaluations) best = &row;
+    }
+    return best;
+}
+
+static void writeIntegratorRows(FILE* out, const char* name, const std::vector<IntegratorRow>& rows, bool orbits) {
+    fprintf(out, "    \"%s\": [\n", name);
+    for (size_t r = 0; r < rows.size(); r++) {
+        const IntegratorRow& row = rows[r];
+        fprintf(out, "      {\"scheme\": \"%s\", ", row.scheme);
+        if (orbits) fprintf(out, "\"frame_rate\": %.0f, \"eta\": %.3f, ", row.frameRate, row.parameter);
+        else fprintf(out, "\"%s\": %g, ", strcmp(row.scheme, "euler") == 0 ? "step" : "tolerance", row.parameter);
+        fprintf(out, "\"%s\": %.2f, \"rms_error\": %.6f, \"max_error\": %.6f",
+            orbits ? "evaluations_per_second" : "evaluations_per_line", row.evaluations, row.rmsError, row.maxError);
+        if (orbits) fprintf(out, ", \"outcome_mismatches\": %d", row.outcomeMismatches);
+        fprintf(out, "}%s\n", r + 1 < rows.size() ? "," : "");
+    }
+    fprintf(out, "    ],\n");
+}
+
+static double mean(const std::vector<double>& values) {
+    double total = 0;
+    for (double v : values) total += v;
+    return values.empty() ? 0 : total / values.size();
+}
+
+static void writePipelineMode(FILE* out, const char* name, const PipelineResult& r) {
+    fprintf(out, "      \"%s\": {\"frame_mean_ms\": %.4f, \"frame_p95_ms\": %.4f, \"frames_per_second\": %.1f, "
+        "\"latency_mean_ms\": %.4f, \"latency_p95_ms\": %.4f, \"extra_bytes\": %zu, \"steps_during_draw\": %d},\n",
+        name, mean(r.frameMs), percentile(r.frameMs, 0.95), mean(r.frameMs) > 0 ? 1000.0 / mean(r.frameMs) : 0.0,
+        mean(r.latencyMs), percentile(r.latencyMs, 0.95), r.extraBytes, r.stepsDuringDraw);
+}
+
+static void writePipelineLayout(FILE* out, const char* name, const PipelineResult& sequential,
+                                const PipelineResult& pipelined, bool last) {
+    fprintf(out, "    \"%s\": {\n", name);
+    writePipelineMode(out, "sequential", sequential);
+    writePipelineMode(out, "pipelined", pipelined);
+    fprintf(out, "      \"throughput_gain\": %.3f,\n      \"added_latency_ms\": %.4f\n    }%s\n",
+        mean(pipelined.frameMs) > 0 ? mean(sequential.frameMs) / mean(pipelined.frameMs) : 0.0,
+        mean(pipelined.latencyMs) - mean(sequential.latencyMs), last ? "" : ",");
+}
+
+static void writeJson(FILE* out, const BenchConfig& config, const std::vector<RunResult>& runs,
+                      const std::vector<NBodyResult>& nbody, const CompactCheckResult* compact,
+                      const SeekResult* seek, const PipelineResult* pipeline, const IntegratorResult* integrator,
+                      const MultirateResult* multirate, const RetuneResult* retune,
+                      const ColorTableResult* colors) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"blackhole_bench\",\n");
+    fprintf(out, "  \"format_version\": 1,\n");
+    fprintf(out, "  \"simd\": \"%s\",\n", simdLevelName(detectSimdLevel()));
+    fprintf(out, "  \"hardware_threads\": %d,\n", TaskScheduler::hardwareThreads());
+    fprintf(out, "  \"config\": {\"steps\": %d, \"warmup\": %d, \"dt\": %.6f, \"seed\": %llu, "
+        "\"disk_particles\": %d, \"streamers\": %d, \"jet_particles\": %d, \"geometry_frames\": %d, "
+        "\"grid_size\": %d, \"disk_layout\": \"%s\", \"multirate\": %s, \"camera_distance\": %.2f},\n",
+        config.steps, config.warmup, config.dt, (unsigned long long)config.seed,
+        config.diskParticles, config.streamers, config.jetParticles, config.geometryFrames, config.gridSize,
+        config.compactDisk ? "compact" : "float", config.multirate ? "true" : "false",
+        config.cameraDistance > 0 ? config.cameraDistance : Vector3Length({0, 8, 25}));
+    fprintf(out, "  \"runs\": [\n");
+    for (size_t r = 0; r < runs.size(); r++) {
+        const RunResult& run = runs[r];
+        double total = 0;
+        for (double ns : run.stepNs) total += ns;
+        double particleSteps = run.disk.particleSteps + run.infall.particleSteps + run.jets.particleSteps;
+        int steps = (int)run.stepNs.size();
+
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"threads\": %d,\n", run.threads);
+        fprintf(out, "      \"step\": {\"total_ms\": %.4f, \"mean_ms\": %.6f, \"p50_ms\": %.6f, \"p95_ms\": %.6f, "
+            "\"max_ms\": %.6f, \"ns_per_particle_step\": %.4f},\n",
+            total * 1e-6, steps ? total * 1e-6 / steps : 0.0,
+            percentile(run.stepNs, 0.50) * 1e-6, percentile(run.stepNs, 0.95) * 1e-6,
+            percentile(run.stepNs, 1.0) * 1e-6, particleSteps > 0 ? total / particleSteps : 0.0);
+        fprintf(out, "      \"subsystems\": {\n");
+        writeSubsystem(out, run.blackHole, steps, false);
+        writeSubsystem(out, run.disk, steps, false);
+        writeSubsystem(out, run.infall, steps, false);
+        writeSubsystem(out, run.jets, steps, true);
+        fprintf(out, "      },\n");
+        int diskBytes = config.compactDisk ? CompactAccretionDisk::UPDATE_BYTES_PER_PARTICLE
+                                           : AccretionDisk::UPDATE_BYTES_PER_PARTICLE;
+        fprintf(out, "      \"disk_update_gb_per_s\": %.3f,\n",
+            run.disk.totalNs > 0 ? run.diskStepped * diskBytes / run.disk.totalNs : 0.0);
+        fprintf(out, "      \"disk_stepped_fraction\": %.4f,\n",
+            run.disk.particleSteps > 0 ? run.diskStepped / run.disk.particleSteps : 0.0);
+        fprintf(out, "      \"geometry\": {\"vertices_per_frame\": %lld, \"ms_per_frame\": %.6f, \"ns_per_vertex\": %.4f, "
+            "\"glow_lod\": %d, \"ring_lod\": %d, \"culling\": %s, \"points_submitted_per_frame\": %lld, "
+            "\"points_culled_per_frame\": %lld, \"bins_culled_per_frame\": %lld, \"bins_per_frame\": %lld}\n",
+            config.geometryFrames ? run.geometryVertices / config.geometryFrames : 0,
+            config.geometryFrames ? run.geometryNs * 1e-6 / config.geometryFrames : 0.0,
+            run.geometryVertices ? run.geometryNs / run.geometryVertices : 0.0, run.glowLod, run.ringLod,
+            config.viewCulling ? "true" : "false",
+            config.geometryFrames ? run.pointsSubmitted / config.geometryFrames : 0,
+            config.geometryFrames ? run.pointsCulled / config.geometryFrames : 0,
+            config.geometryFrames ? run.binsCulled / config.geometryFrames : 0,
+            config.geometryFrames ? run.bins / config.geometryFrames : 0);
+        fprintf(out, "    }%s\n", r + 1 < runs.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    if (!nbody.empty()) {
+        fprintf(out, "  \"nbody\": {\"theta\": %.3f, \"threads\": %d, \"results\": [\n", config.theta,
+            config.threads.empty() ? TaskScheduler::hardwareThreads() : config.threads.back());
+        for (size_t r = 0; r < nbody.size(); r++) {
+            const NBodyResult& n = nbody[r];
+            fprintf(out, "    {\"bodies\": %d, \"nodes\": %d, \"build_ms\": %.4f, \"force_ms\": %.4f, "
+                "\"direct_ms\": %.4f, \"direct_measured\": %s, \"speedup\": %.2f, "
+                "\"rms_rel_error\": %.6f, \"max_rel_error\": %.6f}%s\n",
+                n.bodies, n.nodes, n.buildMs, n.forceMs, n.directMs, n.directMeasured ? "true" : "false",
+                n.buildMs + n.forceMs > 0 ? n.directMs / (n.buildMs + n.forceMs) : 0.0,
+                n.rmsError, n.maxError, r + 1 < nbody.size() ? "," : "");
+        }
+        fprintf(out, "  ]},\n");
+    }
+    fprintf(out, "  \"disk_layout\": {\"float_bytes_per_particle\": %d, \"compact_bytes_per_particle\": %d, "
+        "\"float_update_bytes_per_particle_step\": %d, \"compact_update_bytes_per_particle_step\": %d},\n",
+        AccretionDisk::BYTES_PER_PARTICLE, CompactAccretionDisk::BYTES_PER_PARTICLE,
+        AccretionDisk::UPDATE_BYTES_PER_PARTICLE, CompactAccretionDisk::UPDATE_BYTES_PER_PARTICLE);
+    if (compact) {
+        fprintf(out, "  \"compact_check\": {\"particles\": %d, \"steps\": %d, \"samples\": %lld, "
+            "\"initial_max_error\": %.6f, \"rms_error\": %.6f, \"max_error\": %.6f, \"max_error_bound\": %.3f, "
+            "\"max_color_error\": %d, \"max_color_error_bound\": %d, \"pass\": %s},\n",
+            compact->particles, compact->steps, compact->compared, compact->initialMaxError,
+            compact->rmsError, compact->maxError, COMPACT_MAX_POSITION_ERROR,
+            compact->maxColorError, COMPACT_MAX_COLOR_ERROR, compact->pass ? "true" : "false");
+    }
+    if (colors) {
+        fprintf(out, "  \"color_table\": {\"radii\": %d, \"speeds\": %d, \"bytes\": %zu, \"samples\": %d, "
+            "\"build_ms\": %.4f, \"fetch_ns\": %.3f, \"exact_ns\": %.3f, \"rms_error\": %.4f, "
+            "\"rms_bound\": %.4f, \"max_error\": %d, \"max_bound\": %.2f, \"over_bound\": %d, \"pass\": %s},\n",
+            DISK_COLOR_RADII, DISK_COLOR_SPEEDS, DISK_COLOR_RADII * DISK_COLOR_SPEEDS * sizeof(Color),
+            colors->samples, colors->buildMs, colors->fetchNs, colors->exactNs, colors->rmsError,
+            colors->rmsBound, colors->maxError, colors->maxBound, colors->overBound,
+            colors->pass ? "true" : "false");
+    }
+    if (seek) {
+        fprintf(out, "  \"seek\": {\"particles\": %d, \"time_s\": %.3f, \"seek_ms\": %.4f, \"replay_ms\": %.4f, "
+            "\"speedup\": %.1f, \"generation_match\": %.6f, \"rms_error\": %.6f, \"max_error\": %.6f},\n",
+            seek->particles, seek->time, seek->seekMs, seek->replayMs,
+            seek->seekMs > 0 ? seek->replayMs / seek->seekMs : 0.0,
+            seek->generationMatch, seek->rmsError, seek->maxError);
+    }
+    if (pipeline) {
+        fprintf(out, "  \"pipeline\": {\n    \"frames\": %d,\n    \"threads\": %d,\n", config.pipelineFrames,
+            config.threads.back());
+        writePipelineLayout(out, "float", pipeline[0], pipeline[1], false);
+        writePipelineLayout(out, "compact", pipeline[2], pipeline[3], true);
+        fprintf(out, "  },\n");
+    }
+    if (multirate) {
+        fprintf(out, "  \"multirate\": {\"particles\": %d, \"steps\": %d, \"full_ms_per_step\": %.4f, "
+            "\"multirate_ms_per_step\": %.4f, \"speedup\": %.2f, \"stepped_fraction\": %.4f, "
+            "\"generation_match\": %.6f, \"rms_error\": %.6f, \"max_error\": %.6f, "
+            "\"rms_error_without_lag\": %.6f, \"max_error_without_lag\": %.6f},\n",
+            multirate->particles, multirate->steps, multirate->fullMs, multirate->multirateMs,
+            multirate->multirateMs > 0 ? multirate->fullMs / multirate->multirateMs : 0.0, multirate->steppedFraction,
+            multirate->generationMatch, multirate->rmsError, multirate->maxError,
+            multirate->rmsErrorUnlagged, multirate->maxErrorUnlagged);
+    }
+    if (retune) {
+        fprintf(out, "  \"retune\": {\n    \"frames\": %d,\n    \"grid_size\": %d,\n", config.retuneFrames, config.gridSize);
+        const char* names[3] = {"steady", "inline", "background"};
+        for (int k = 0; k < 3; k++) {
+            const RetuneResult& r = retune[k];
+            fprintf(out, "    \"%s\": {\"frame_mean_ms\": %.4f, \"frame_p99_ms\": %.4f, \"frame_max_ms\": %.4f, "
+                "\"grid_rebuilds\": %d, \"stale_frames\": %d, \"max_lag_frames\": %d}%s\n",
+                names[k], mean(r.frameMs), percentile(r.frameMs, 0.99),
+                r.frameMs.empty() ? 0.0 : *std::max_element(r.frameMs.begin(), r.frameMs.end()),
+                r.gridRebuilds, r.staleFrames, r.maxLagFrames, ",");
+        }
+        fprintf(out, "    \"max_lag_bound\": %d\n  },\n", config.threads.back() == 1 ? 0 : RETUNE_MAX_LAG_FRAMES);
+    }
+    if (integrator) {
+        fprintf(out, "  \"integrator\": {\n    \"streamers\": %d,\n    \"absorbed\": %d,\n    \"seconds\": %.1f,\n",
+            integrator->streamers, integrator->absorbed, integrator->seconds);
+        writeIntegratorRows(out, "orbits", integrator->orbits, true);
+        writeIntegratorRows(out, "field_lines", integrator->fieldLines, false);
+        // Savings at the old schemes' own accuracy: Euler at 60 fps for
+        // orbits, 0.15 steps for field lines.
+        const IntegratorRow* orbit = cheapestMatching(integrator->orbits, "leapfrog", integrator->orbits[0]);
+        const IntegratorRow* line = cheapestMatching(integrator->fieldLines, "rk45", integrator->fieldLines[0]);
+        fprintf(out, "    \"orbit_evaluation_ratio\": %.3f,\n    \"field_line_evaluation_ratio\": %.3f\n  },\n",
+            orbit ? orbit->evaluations / integrator->orbits[0].evaluations : 0.0,
+            line ? line->evaluations / integrator->fieldLines[0].evaluations : 0.0);
+    }
+    fprintf(out, "  \"peak_rss_bytes\": %zu\n", peakResidentBytes());
+    fprintf(out, "}\n");
+}
+
+static std::vector<int> parseIntList(const char* text) {
+    std::vector<int> values;
+    std::string s(text);
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t comma = s.find(',', start);
+        if (comma == std::string::npos) comma = s.size();
+        if (comma > start) values.push_back(atoi(s.substr(start, comma - start).c_str()));
+        start = comma + 1;
+    }
+    return values;
+}
+
+static void printUsage() {
+    fprintf(stderr,
+        "usage: blackhole_bench [options]\n"
+        "  --steps N          measured steps (600)\n"
+        "  --warmup N         unmeasured steps first (60)\n"
+        "  --dt S             fixed step in seconds (1/60)\n"
+        "  --disk N           accretion disk particles (20000)\n"
+        "  --streamers N      infalling streamers (25)\n"
+        "  --jet N            particles per jet (400)\n"
+        "  --geometry N       vertex-building frames, 0 to skip (60)\n"
+        "  --grid N           spacetime grid cells per side (30)\n"
+        "  --threads A,B,...  one run per thread count (all cores)\n"
+        "  --seed N           scene seed for the counter-based RNG (1)\n"
+        "  --nbody A,B,...    also compare Barnes-Hut with direct summation at these body counts\n"
+        "  --theta T          Barnes-Hut opening angle (0.6)\n"
+        "  --nbody-sample N   bodies checked against direct summation above 20k (1000)\n"
+        "  --compact          use the quantized disk and check it against the float path\n"
+        "  --compact-check N  particles in that check (100000)\n"
+        "  --camera-distance D  camera distance for the geometry frames and LOD (26.2)\n"
+        "  --no-cull          submit every disk particle and star in the geometry frames\n"
+        "  --seek T           time a closed-form disk seek to T seconds against replaying to T\n"
+        "  --pipeline N       N frames of update plus vertex building, sequential and pipelined\n"
+        "  --multirate        step the float disk by orbital timescale and check it against full rate\n"
+        "  --colors N         check the disk color table against the exact formula at N points\n"
+        "  --retune N         N frames of disk update and vertex building while the mass and horizon\n"
+        "                     change every frame, with the grid rebuilt inline and in the background\n"
+        "  --integrator N     compare Euler with leapfrog and RK45 on N streamers and the field lines\n"
+        "  --out FILE         write JSON to FILE instead of stdout\n");
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--steps") == 0 && hasValue) config.steps = atoi(argv[++i]);
+        else if (strcmp(arg, "--warmup") == 0 && hasValue) config.warmup = atoi(argv[++i]);
+        else if (strcmp(arg, "--dt") == 0 && hasValue) config.dt = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--disk") == 0 && hasValue) config.diskParticles = atoi(argv[++i]);
+        else if (strcmp(arg, "--streamers") == 0 && hasValue) config.streamers = atoi(argv[++i]);
+        else if (strcmp(arg, "--jet") == 0 && hasValue) config.jetParticles = atoi(argv[++i]);
+        else if (strcmp(arg, "--geometry") == 0 && hasValue) config.geometryFrames = atoi(argv[++i]);
+        else if (strcmp(arg, "--grid") == 0 && hasValue) config.gridSize = atoi(argv[++i]);
+        else if (strcmp(arg, "--threads") == 0 && hasValue) config.threads = parseIntList(argv[++i]);
+        else if (strcmp(arg, "--seed") == 0 && hasValue) config.seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(arg, "--nbody") == 0 && hasValue) config.nbodyCounts = parseIntList(argv[++i]);
+        else if (strcmp(arg, "--theta") == 0 && hasValue) config.theta = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--nbody-sample") == 0 && hasValue) config.nbodySample = atoi(argv[++i]);
+        else if (strcmp(arg, "--compact") == 0) config.compactDisk = true;
+        else if (strcmp(arg, "--compact-check") == 0 && hasValue) config.compactCheck = atoi(argv[++i]);
+        else if (strcmp(arg, "--camera-distance") == 0 && hasValue) config.cameraDistance = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--no-cull") == 0) config.viewCulling = false;
+        else if (strcmp(arg, "--seek") == 0 && hasValue) config.seekTime = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--pipeline") == 0 && hasValue) config.pipelineFrames = atoi(argv[++i]);
+        else if (strcmp(arg, "--multirate") == 0) config.multirate = true;
+        else if (strcmp(arg, "--colors") == 0 && hasValue) config.colorSamples = atoi(argv[++i]);
+        else if (strcmp(arg, "--retune") == 0 && hasValue) config.retuneFrames = atoi(argv[++i]);
+        else if (strcmp(arg, "--integrator") == 0 && hasValue) config.integratorStreamers = atoi(argv[++i]);
+        else if (strcmp(arg, "--out") == 0 && hasValue) config.outPath = argv[++i];
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (config.threads.empty()) config.threads.push_back(TaskScheduler::hardwareThreads());
+
+    std::vector<RunResult> runs;
+    for (int threads : config.threads) {
+        runs.push_back(runBench(config, threads));
+    }
+    
+    std::vector<NBodyResult> nbody;
+    if (!config.nbodyCounts.empty()) {
+        TaskScheduler scheduler(config.threads.back());
+        for (int bodies : config.nbodyCounts) {
+            if (bodies > 1) nbody.push_back(runNBody(config, bodies, scheduler));
+        }
+    }
+
+    CompactCheckResult compact;
+    if (config.compactDisk) {
+        TaskScheduler scheduler(config.threads.back());
+        compact = runCompactCheck(config, scheduler);
+    }
+
+    SeekResult seek;
+    if (config.seekTime > 0) {
+        TaskScheduler scheduler(config.threads.back());
+        seek = runSeek(config, scheduler);
+    }
+
+    // Float disk, then compact disk, each sequential and pipelined.
+    PipelineResult pipeline[4];
+    if (config.pipelineFrames > 0) {
+        TaskScheduler scheduler(config.threads.back());
+        for (int layout = 0; layout < 2; layout++) {
+            pipeline[layout * 2] = runPipeline(config, scheduler, false, layout == 1);
+            pipeline[layout * 2 + 1] = runPipeline(config, scheduler, true, layout == 1);
+        }
+    }
+
+    IntegratorResult integrator;
+    if (config.integratorStreamers > 0) integrator = runIntegrator(config);
+
+    MultirateResult multirate;
+    bool multirateCheck = config.multirate && !config.compactDisk;
+    if (multirateCheck) {
+        TaskScheduler scheduler(config.threads.back());
+        multirate = runMultirateCheck(config, scheduler);
+    }
+
+    ColorTableResult colors;
+    if (config.colorSamples > 0) colors = runColorTable(config);
+
+    RetuneResult retune[3];
+    if (config.retuneFrames > 0) {
+        TaskScheduler scheduler(config.threads.back());
+        retune[0] = runRetune(config, scheduler, false, true);
+        retune[1] = runRetune(config, scheduler, true, false);
+        retune[2] = runRetune(config, scheduler, true, true);
+    }
+
+    FILE* out = stdout;
+    if (config.outPath) {
+        out = fopen(config.outPath, "w");
+        if (!out) {
+            fprintf(stderr, "blackhole_bench: cannot open %s\n", config.outPath);
+            return 1;
+        }
+    }
+    writeJson(out, config, runs, nbody, config.compactDisk ? &compact : nullptr,
+              config.seekTime > 0 ? &seek : nullptr, config.pipelineFrames > 0 ? pipeline : nullptr,
+              config.integratorStreamers > 0 ? &integrator : nullptr, multirateCheck ? &multirate : nullptr,
+              config.retuneFrames > 0 ? retune : nullptr, config.colorSamples > 0 ? &colors : nullptr);
+    if (out != stdout) fclose(out);
+    if (config.compactDisk && !compact.pass) {
+        fprintf(stderr, "blackhole_bench: compact disk error %.4f (color %d) exceeds the bound\n",
+            compact.maxError, compact.maxColorError);
+        return 1;
+    }
+    if (config.pipelineFrames > 0 && pipeline[1].stepsDuringDraw + pipeline[3].stepsDuringDraw > 0) {
+        fprintf(stderr, "blackhole_bench: the drawing thread ran %d pipelined step tasks\n",
+            pipeline[1].stepsDuringDraw + pipeline[3].stepsDuringDraw);
+        return 1;
+    }
+    int lagBound = config.threads.back() == 1 ? 0 : RETUNE_MAX_LAG_FRAMES;
+    if (config.retuneFrames > 0 && retune[2].maxLagFrames > lagBound) {
+        fprintf(stderr, "blackhole_bench: background grid rebuilds trail the edits by %d frames (bound %d)\n",
+            retune[2].maxLagFrames, lagBound);
+        return 1;
+    }
+    if (config.colorSamples > 0 && !colors.pass) {
+        fprintf(stderr, "blackhole_bench: %d disk color fetches exceed their error bound\n",
+            colors.overBound);
+        return 1;
+    }
+    return 0;
+}
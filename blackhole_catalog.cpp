@@ -0,0 +1,208 @@
+#include "star_catalog.h"
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Converts a CSV star catalog (HYG, Gaia exports) into the tiled binary sky
+// format the interactive build maps with --catalog. Needs only the raylib
+// headers, not the library. The first row must name the columns; fields are
+// split on commas without quote handling, which both catalogs' numeric
+// columns allow.
+
+typedef std::chrono::steady_clock ConvertClock;
+
+static double elapsedMs(ConvertClock::time_point start) {
+    return std::chrono::duration<double, std::milli>(ConvertClock::now() - start).count();
+}
+
+static void printUsage() {
+    fprintf(stderr,
+        "usage: blackhole_catalog --in FILE [options]\n"
+        "  --in FILE          CSV catalog with a header row\n"
+        "  --ra NAME          right ascension column (ra)\n"
+        "  --dec NAME         declination column (dec)\n"
+        "  --mag NAME         magnitude column (first of mag, phot_g_mean_mag, vmag, gmag)\n"
+        "  --color NAME       color index column (first of ci, bp_rp, b_v, bv; 0.65 if none)\n"
+        "  --ra-hours         right ascension is in hours (HYG) instead of degrees (Gaia)\n"
+        "  --min-mag M        drop brighter entries, e.g. the Sun in HYG (-2)\n"
+        "  --max-mag M        drop fainter entries (no limit)\n"
+        "  --face-tiles N     tiles per cube face side (32)\n"
+        "  --out FILE         output catalog (stars.bhsc)\n");
+}
+
+static std::vector<std::string> splitFields(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t comma = line.find(',', start);
+        fields.push_back(line.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    for (std::string& f : fields) {
+        while (!f.empty() && (f.back() == '\r' || f.back() == '\n' || f.back() == ' ')) f.pop_back();
+        while (!f.empty() && f.front() == ' ') f.erase(f.begin());
+        if (f.size() >= 2 && f.front() == '"' && f.back() == '"') f = f.substr(1, f.size() - 2);
+        for (char& c : f) c = (char)tolower((unsigned char)c);
+    }
+    return fields;
+}
+
+static int findColumn(const std::vector<std::string>& header, const char* const* names, int nameCount) {
+    for (int n = 0; n < nameCount; n++) {
+        if (!names[n]) continue;
+        for (size_t c = 0; c < header.size(); c++) {
+            if (header[c] == names[n]) return (int)c;
+        }
+    }
+    return -1;
+}
+
+// Reads one line of any length; false at end of file.
+static bool readLine(FILE* f, std::string& line) {
+    line.clear();
+    char buffer[4096];
+    while (fgets(buffer, sizeof(buffer), f)) {
+        line += buffer;
+        if (!line.empty() && line.back() == '\n') return true;
+    }
+    return !line.empty();
+}
+
+// Parses field `column` of a comma-separated line in place; false if empty
+// or not a number.
+static bool parseField(const char* line, int column, float& value) {
+    const char* p = line;
+    for (int c = 0; c < column; c++) {
+        p = strchr(p, ',');
+        if (!p) return false;
+        p++;
+    }
+    if (*p == '"') p++;
+    char* end;
+    double v = strtod(p, &end);
+    if (end == p) return false;
+    value = (float)v;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* inPath = nullptr;
+    const char* outPath = "stars.bhsc";
+    std::string raName = "ra", decName = "dec";
+    const char* magName = nullptr;
+    const char* colorName = nullptr;
+    bool raHours = false;
+    float minMag = -2.0f;
+    float maxMag = 1e30f;
+    int faceTiles = 32;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--in") == 0 && hasValue) inPath = argv[++i];
+        else if (strcmp(arg, "--out") == 0 && hasValue) outPath = argv[++i];
+        else if (strcmp(arg, "--ra") == 0 && hasValue) raName = argv[++i];
+        else if (strcmp(arg, "--dec") == 0 && hasValue) decName = argv[++i];
+        else if (strcmp(arg, "--mag") == 0 && hasValue) magName = argv[++i];
+        else if (strcmp(arg, "--color") == 0 && hasValue) colorName = argv[++i];
+        else if (strcmp(arg, "--ra-hours") == 0) raHours = true;
+        else if (strcmp(arg, "--min-mag") == 0 && hasValue) minMag = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--max-mag") == 0 && hasValue) maxMag = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--face-tiles") == 0 && hasValue) faceTiles = atoi(argv[++i]);
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (!inPath || faceTiles < 1 || faceTiles > 1024) {
+        printUsage();
+        return 2;
+    }
+
+    FILE* in = fopen(inPath, "rb");
+    if (!in) {
+        fprintf(stderr, "blackhole_catalog: cannot read %s\n", inPath);
+        return 1;
+    }
+    ConvertClock::time_point start = ConvertClock::now();
+    std::string line;
+    if (!readLine(in, line)) {
+        fprintf(stderr, "blackhole_catalog: %s is empty\n", inPath);
+        fclose(in);
+        return 1;
+    }
+    std::vector<std::string> header = splitFields(line);
+    for (char& c : raName) c = (char)tolower((unsigned char)c);
+    for (char& c : decName) c = (char)tolower((unsigned char)c);
+    std::string magLower = magName ? magName : "", colorLower = colorName ? colorName : "";
+    for (char& c : magLower) c = (char)tolower((unsigned char)c);
+    for (char& c : colorLower) c = (char)tolower((unsigned char)c);
+
+    const char* raNames[] = {raName.c_str()};
+    const char* decNames[] = {decName.c_str()};
+    const char* magNames[] = {magName ? magLower.c_str() : "mag", "phot_g_mean_mag", "vmag", "gmag"};
+    const char* colorNames[] = {colorName ? colorLower.c_str() : "ci", "bp_rp", "b_v", "bv"};
+    int raColumn = findColumn(header, raNames, 1);
+    int decColumn = findColumn(header, decNames, 1);
+    int magColumn = findColumn(header, magNames, magName ? 1 : 4);
+    int colorColumn = findColumn(header, colorNames, colorName ? 1 : 4);
+    if (raColumn < 0 || decColumn < 0 || magColumn < 0) {
+        fprintf(stderr, "blackhole_catalog: %s has no %s column\n", inPath,
+                raColumn < 0 ? "right ascension" : decColumn < 0 ? "declination" : "magnitude");
+        fclose(in);
+        return 1;
+    }
+
+    const float raScale = (raHours ? 15.0f : 1.0f) * BH_PI / 180.0f;
+    std::vector<CatalogEntry> entries;
+    long long rows = 0, skipped = 0;
+    while (readLine(in, line)) {
+        rows++;
+        CatalogEntry e;
+        if (!parseField(line.c_str(), raColumn, e.ra) || !parseField(line.c_str(), decColumn, e.dec) ||
+            !parseField(line.c_str(), magColumn, e.magnitude) || e.magnitude < minMag || e.magnitude > maxMag) {
+            skipped++;
+            continue;
+        }
+        if (colorColumn < 0 || !parseField(line.c_str(), colorColumn, e.colorIndex)) e.colorIndex = 0.65f;
+        e.ra *= raScale;
+        e.dec *= BH_PI / 180.0f;
+        entries.push_back(e);
+    }
+    fclose(in);
+    double parseMs = elapsedMs(start);
+
+    start = ConvertClock::now();
+    if (!writeStarCatalog(outPath, entries, faceTiles)) {
+        fprintf(stderr, "blackhole_catalog: cannot write %s\n", outPath);
+        return 1;
+    }
+    double writeMs = elapsedMs(start);
+
+    StarCatalog catalog;
+    start = ConvertClock::now();
+    bool ok = catalog.load(outPath);
+    double loadMs = elapsedMs(start);
+    if (!ok) {
+        fprintf(stderr, "blackhole_catalog: %s did not load back\n", outPath);
+        return 1;
+    }
+
+    // Stars over the whole sky at the default limit, for choosing --max-mag.
+    long long atLimit = 0;
+    float limit = catalog.magnitudeLimit(STAR_CATALOG_FOV);
+    for (int t = 0; t < catalog.tileCount; t++) atLimit += catalog.visibleCount(t, limit);
+
+    printf("{\"rows\": %lld, \"stars\": %u, \"skipped\": %lld, \"face_tiles\": %d, \"tiles\": %d, "
+        "\"bytes\": %zu, \"brightest\": %.2f, \"faintest\": %.2f, \"parse_ms\": %.1f, \"write_ms\": %.1f, "
+        "\"load_ms\": %.3f, \"default_limit\": %.2f, \"stars_within_limit\": %lld, \"out\": \"%s\"}\n",
+        rows, catalog.starCount, skipped, catalog.faceTiles, catalog.tileCount,
+        sizeof(StarCatalogHeader) + catalog.tileCount * sizeof(StarCatalogTile) + catalog.starCount * sizeof(CatalogStar),
+        catalog.brightestMagnitude, catalog.faintestMagnitude, parseMs, writeMs, loadMs, limit, atLimit, outPath);
+    return 0;
+}
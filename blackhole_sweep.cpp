@@ -0,0 +1,359 @@
+#include "simulation.h"
+#include "platform.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Parameter sweeps: runs every combination of the values in a sweep spec as
+// an independent headless scene, one scene per task on all cores, and writes
+// one row of summary statistics per scene to a CSV or JSON file. Needs only
+// the raylib headers, not the library.
+//
+// The spec has one `key = values` line per swept parameter; values are a
+// comma-separated list or `first:last:count`, count values spread evenly from
+// first to last. Missing keys keep the interactive defaults. `#` starts a
+// comment.
+//
+//     mass = 30, 50, 80
+//     disk_outer = 10:20:3
+//     disk = 20000, 100000
+
+typedef std::chrono::steady_clock SweepClock;
+
+static double elapsedMs(SweepClock::time_point start) {
+    return std::chrono::duration<double, std::milli>(SweepClock::now() - start).count();
+}
+
+enum SweepKey {
+    SWEEP_MASS,
+    SWEEP_HORIZON,
+    SWEEP_DISK_INNER,
+    SWEEP_DISK_OUTER,
+    SWEEP_ROTATION_SPEED,
+    SWEEP_DISK,
+    SWEEP_STREAMERS,
+    SWEEP_JETS,
+    SWEEP_STEPS,
+    SWEEP_DT,
+    SWEEP_SEED,
+    SWEEP_KEY_COUNT
+};
+
+static const char* const SWEEP_KEY_NAMES[SWEEP_KEY_COUNT] = {
+    "mass", "horizon", "disk_inner", "disk_outer", "rotation_speed",
+    "disk", "streamers", "jets", "steps", "dt", "seed"
+};
+
+static const double SWEEP_DEFAULTS[SWEEP_KEY_COUNT] = {
+    50.0, 2.0, 3.5, 14.0, 0.4, 20000, 25, 400, 1800, 1.0 / 60.0, 1
+};
+
+struct SweepRun {
+    double params[SWEEP_KEY_COUNT];
+    double cost;            // particle steps, for ordering the tasks
+
+    long long diskRespawns;
+    long long diskAccreted;
+    long long infallAbsorbed;
+    long long infallExpired;
+    long long infallEscaped;
+    long long jetRespawns;
+    double simulatedSeconds;
+    double stepMeanMs;
+    double stepP50Ms;
+    double stepP95Ms;
+    double stepMaxMs;
+    double runMs;
+};
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static std::string trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return "";
+    size_t last = s.find_last_not_of(" \t\r\n");
+    return s.substr(first, last - first + 1);
+}
+
+static bool parseNumber(const std::string& text, double& value) {
+    std::string s = trim(text);
+    char* end;
+    value = strtod(s.c_str(), &end);
+    return !s.empty() && *end == '\0';
+}
+
+// `a, b, c` or `first:last:count`; false on a malformed value.
+static bool parseValues(const std::string& text, std::vector<double>& values) {
+    values.clear();
+    size_t colon = text.find(':');
+    if (colon != std::string::npos) {
+        size_t second = text.find(':', colon + 1);
+        double first, last, count;
+        if (second == std::string::npos || !parseNumber(text.substr(0, colon), first) ||
+            !parseNumber(text.substr(colon + 1, second - colon - 1), last) ||
+            !parseNumber(text.substr(second + 1), count) || count < 1 || count != (int)count) {
+            return false;
+        }
+        for (int i = 0; i < (int)count; i++) {
+            values.push_back(count > 1 ? first + (last - first) * i / (count - 1) : first);
+        }
+        return true;
+    }
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        double v;
+        if (!parseNumber(text.substr(start, comma - start), v)) return false;
+        values.push_back(v);
+        start = comma + 1;
+    }
+    return !values.empty();
+}
+
+static bool readSpec(const char* path, std::vector<double> (&axes)[SWEEP_KEY_COUNT]) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "blackhole_sweep: cannot read %s\n", path);
+        return false;
+    }
+    char buffer[4096];
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(buffer, sizeof(buffer), f)) {
+        lineNumber++;
+        std::string line = buffer;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.resize(hash);
+        line = trim(line);
+        if (line.empty()) continue;
+
+        size_t equals = line.find('=');
+        std::string key = trim(line.substr(0, equals == std::string::npos ? line.size() : equals));
+        int k = 0;
+        while (k < SWEEP_KEY_COUNT && key != SWEEP_KEY_NAMES[k]) k++;
+        if (equals == std::string::npos || k == SWEEP_KEY_COUNT) {
+            fprintf(stderr, "blackhole_sweep: %s:%d: unknown key '%s'\n", path, lineNumber, key.c_str());
+            ok = false;
+        } else if (!parseValues(line.substr(equals + 1), axes[k])) {
+            fprintf(stderr, "blackhole_sweep: %s:%d: bad values for %s\n", path, lineNumber, key.c_str());
+            ok = false;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+static bool validRun(const double* p) {
+    return p[SWEEP_MASS] > 0 && p[SWEEP_HORIZON] > 0 && p[SWEEP_HORIZON] < p[SWEEP_DISK_INNER] &&
+        p[SWEEP_DISK_INNER] < p[SWEEP_DISK_OUTER] && p[SWEEP_DISK] >= 0 && p[SWEEP_STREAMERS] >= 0 &&
+        p[SWEEP_JETS] >= 0 && p[SWEEP_STEPS] >= 1 && p[SWEEP_DT] > 0;
+}
+
+// One scene, stepped on the calling thread so runs scale across cores
+// instead of contending for them.
+static void runScene(SweepRun& run) {
+    const double* p = run.params;
+    SweepClock::time_point runStart = SweepClock::now();
+
+    BlackHole blackHole;
+    blackHole.mass = (float)p[SWEEP_MASS];
+    blackHole.eventHorizonRadius = (float)p[SWEEP_HORIZON];
+    blackHole.accretionDiskInner = (float)p[SWEEP_DISK_INNER];
+    blackHole.accretionDiskOuter = (float)p[SWEEP_DISK_OUTER];
+    blackHole.rotationSpeed = (float)p[SWEEP_ROTATION_SPEED];
+    blackHole.seed = (uint64_t)p[SWEEP_SEED];
+    AccretionDisk accretionDisk(&blackHole, (int)p[SWEEP_DISK]);
+    InfallingMatter infallingMatter(&blackHole, (int)p[SWEEP_STREAMERS]);
+    JetStream topJet(&blackHole, true, (int)p[SWEEP_JETS]);
+    JetStream bottomJet(&blackHole, false, (int)p[SWEEP_JETS]);
+
+    int steps = (int)p[SWEEP_STEPS];
+    float dt = (float)p[SWEEP_DT];
+    float time = 0;
+    std::vector<double> stepMs;
+    stepMs.reserve(steps);
+    for (int step = 0; step < steps; step++) {
+        time += dt;
+        SweepClock::time_point stepStart = SweepClock::now();
+        blackHole.update(dt);
+        accretionDisk.update(dt);
+        infallingMatter.update(dt);
+        topJet.update(dt, time);
+        bottomJet.update(dt, time);
+        stepMs.push_back(elapsedMs(stepStart));
+    }
+
+    run.diskRespawns = 0;
+    for (int i = 0; i < accretionDisk.particleCount; i++) run.diskRespawns += accretionDisk.generation[i];
+    run.diskAccreted = accretionDisk.accreted.load();
+    run.infallAbsorbed = infallingMatter.absorbed.load();
+    run.infallExpired = infallingMatter.expired.load();
+    run.infallEscaped = infallingMatter.escaped.load();
+    run.jetRespawns = 0;
+    for (const JetStream::JetParticle& j : topJet.particles) run.jetRespawns += j.generation;
+    for (const JetStream::JetParticle& j : bottomJet.particles) run.jetRespawns += j.generation;
+    run.simulatedSeconds = (double)steps * dt;
+
+    double total = 0;
+    for (double ms : stepMs) total += ms;
+    run.stepMeanMs = total / steps;
+    run.stepP50Ms = percentile(stepMs, 0.50);
+    run.stepP95Ms = percentile(stepMs, 0.95);
+    run.stepMaxMs = *std::max_element(stepMs.begin(), stepMs.end());
+    run.runMs = elapsedMs(runStart);
+}
+
+static void writeCsv(FILE* out, const std::vector<SweepRun>& runs) {
+    for (int k = 0; k < SWEEP_KEY_COUNT; k++) fprintf(out, "%s,", SWEEP_KEY_NAMES[k]);
+    fprintf(out, "disk_respawns,disk_accreted,disk_accretion_rate,infall_absorbed,infall_expired,"
+        "infall_escaped,infall_rate,jet_respawns,step_mean_ms,step_p50_ms,step_p95_ms,step_max_ms,run_ms\n");
+    for (const SweepRun& r : runs) {
+        for (int k = 0; k < SWEEP_KEY_COUNT; k++) fprintf(out, "%g,", r.params[k]);
+        fprintf(out, "%lld,%lld,%.4f,%lld,%lld,%lld,%.4f,%lld,%.4f,%.4f,%.4f,%.4f,%.1f\n",
+            r.diskRespawns, r.diskAccreted, r.diskAccreted / r.simulatedSeconds,
+            r.infallAbsorbed, r.infallExpired, r.infallEscaped, r.infallAbsorbed / r.simulatedSeconds,
+            r.jetRespawns, r.stepMeanMs, r.stepP50Ms, r.stepP95Ms, r.stepMaxMs, r.runMs);
+    }
+}
+
+static void writeJson(FILE* out, const std::vector<SweepRun>& runs, int threads, double wallMs) {
+    fprintf(out, "{\n  \"benchmark\": \"blackhole_sweep\",\n  \"threads\": %d,\n  \"wall_ms\": %.1f,\n  \"runs\": [\n",
+        threads, wallMs);
+    for (size_t i = 0; i < runs.size(); i++) {
+        const SweepRun& r = runs[i];
+        fprintf(out, "    {");
+        for (int k = 0; k < SWEEP_KEY_COUNT; k++) fprintf(out, "\"%s\": %g, ", SWEEP_KEY_NAMES[k], r.params[k]);
+        fprintf(out, "\"disk_respawns\": %lld, \"disk_accreted\": %lld, \"disk_accretion_rate\": %.4f, "
+            "\"infall_absorbed\": %lld, \"infall_expired\": %lld, \"infall_escaped\": %lld, \"infall_rate\": %.4f, "
+            "\"jet_respawns\": %lld, \"step_mean_ms\": %.4f, \"step_p50_ms\": %.4f, \"step_p95_ms\": %.4f, "
+            "\"step_max_ms\": %.4f, \"run_ms\": %.1f}%s\n",
+            r.diskRespawns, r.diskAccreted, r.diskAccreted / r.simulatedSeconds,
+            r.infallAbsorbed, r.infallExpired, r.infallEscaped, r.infallAbsorbed / r.simulatedSeconds,
+            r.jetRespawns, r.stepMeanMs, r.stepP50Ms, r.stepP95Ms, r.stepMaxMs, r.runMs,
+            i + 1 < runs.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void printUsage() {
+    fprintf(stderr,
+        "usage: blackhole_sweep --spec FILE [options]\n"
+        "  --spec FILE        sweep spec, one `key = a, b, c` or `key = first:last:count` per line\n"
+        "                     keys: mass horizon disk_inner disk_outer rotation_speed disk streamers\n"
+        "                           jets steps dt seed\n"
+        "  --threads N        scenes run at once (all cores)\n"
+        "  --format csv|json  results format (from the --out extension, else csv)\n"
+        "  --out FILE         results file (sweep.csv)\n");
+}
+
+int main(int argc, char** argv) {
+    const char* specPath = nullptr;
+    const char* outPath = "sweep.csv";
+    const char* format = nullptr;
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--spec") == 0 && hasValue) specPath = argv[++i];
+        else if (strcmp(arg, "--threads") == 0 && hasValue) threads = atoi(argv[++i]);
+        else if (strcmp(arg, "--format") == 0 && hasValue) format = argv[++i];
+        else if (strcmp(arg, "--out") == 0 && hasValue) outPath = argv[++i];
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (!format) {
+        size_t length = strlen(outPath);
+        format = length >= 5 && strcmp(outPath + length - 5, ".json") == 0 ? "json" : "csv";
+    }
+    if (!specPath || threads < 0 || (strcmp(format, "csv") != 0 && strcmp(format, "json") != 0)) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<double> axes[SWEEP_KEY_COUNT];
+    if (!readSpec(specPath, axes)) return 1;
+    for (int k = 0; k < SWEEP_KEY_COUNT; k++) {
+        if (axes[k].empty()) axes[k].push_back(SWEEP_DEFAULTS[k]);
+    }
+
+    // Cartesian product, the last key varying fastest.
+    std::vector<SweepRun> runs;
+    long long skipped = 0;
+    int index[SWEEP_KEY_COUNT] = {0};
+    while (true) {
+        SweepRun run = {};
+        for (int k = 0; k < SWEEP_KEY_COUNT; k++) run.params[k] = axes[k][index[k]];
+        if (validRun(run.params)) {
+            run.cost = run.params[SWEEP_STEPS] *
+                (run.params[SWEEP_DISK] + run.params[SWEEP_STREAMERS] + 2 * run.params[SWEEP_JETS]);
+            runs.push_back(run);
+        } else {
+            skipped++;
+        }
+        int k = SWEEP_KEY_COUNT - 1;
+        while (k >= 0 && ++index[k] == (int)axes[k].size()) index[k--] = 0;
+        if (k < 0) break;
+    }
+    if (skipped) {
+        fprintf(stderr, "blackhole_sweep: skipped %lld combinations (need 0 < horizon < disk_inner < disk_outer, "
+            "mass, steps and dt > 0)\n", skipped);
+    }
+
+    // One task per scene, but a task runs whichever scene is next on a
+    // shared cursor over the scenes sorted costliest first. The owner pops
+    // from the back and thieves from the front, so tasks start in no useful
+    // order; the cursor still hands out the most expensive scenes first.
+    TaskScheduler scheduler(threads);
+    std::vector<int> order(runs.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+    std::stable_sort(order.begin(), order.end(), [&runs](int a, int b) { return runs[a].cost > runs[b].cost; });
+
+    SweepClock::time_point start = SweepClock::now();
+    TaskGroup group;
+    std::atomic<size_t> next(0);
+    for (size_t k = 0; k < order.size(); k++) {
+        scheduler.run(group, [&runs, &order, &next]() {
+            runScene(runs[order[next.fetch_add(1, std::memory_order_relaxed)]]);
+        });
+    }
+    scheduler.wait(group);
+    double wallMs = elapsedMs(start);
+
+    FILE* out = fopen(outPath, "w");
+    if (!out) {
+        fprintf(stderr, "blackhole_sweep: cannot write %s\n", outPath);
+        return 1;
+    }
+    if (strcmp(format, "json") == 0) writeJson(out, runs, scheduler.threadCount(), wallMs);
+    else writeCsv(out, runs);
+    fclose(out);
+
+    // Overlap is the summed scene time over the wall time: how many scenes
+    // were in flight on average. Scenes slow each other down through shared
+    // caches and memory bandwidth, which overlap does not see; compare
+    // runs_per_second against a --threads 1 run of the same spec for that.
+    double sceneMs = 0;
+    for (const SweepRun& r : runs) sceneMs += r.runMs;
+    double overlap = wallMs > 0 ? sceneMs / wallMs : 0;
+    printf("{\"runs\": %zu, \"skipped\": %lld, \"threads\": %d, \"wall_ms\": %.1f, \"scene_ms\": %.1f, "
+        "\"runs_per_second\": %.3f, \"overlap\": %.2f, \"peak_rss_mb\": %.1f, "
+        "\"out\": \"%s\"}\n",
+        runs.size(), skipped, scheduler.threadCount(), wallMs, sceneMs,
+        wallMs > 0 ? runs.size() * 1000.0 / wallMs : 0.0, overlap,
+        peakResidentBytes() / (1024.0 * 1024.0), outPath);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "geodesic_tracer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Renders a lensed still of the scene on the CPU and writes it as a binary
+// PPM. Needs only the raylib headers, not the library or a GPU.
+
+static bool writePpm(const char* path, int width, int height, const std::vector<Color>& pixels) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    std::vector<unsigned char> row((size_t)width * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const Color& c = pixels[(size_t)y * width + x];
+            row[x * 3] = c.r;
+            row[x * 3 + 1] = c.g;
+            row[x * 3 + 2] = c.b;
+        }
+        fwrite(row.data(), 1, row.size(), f);
+    }
+    return fclose(f) == 0;
+}
+
+static void printUsage() {
+    fprintf(stderr,
+        "usage: blackhole_trace [options]\n"
+        "  --width N          image width (3840)\n"
+        "  --height N         image height (2160)\n"
+        "  --distance D       camera distance from the hole (28)\n"
+        "  --height-y Y       camera height above the disk (8)\n"
+        "  --angle A          camera orbit angle in radians (0)\n"
+        "  --fov DEG          vertical field of view (60)\n"
+        "  --time T           scene time for the disk pattern (0)\n"
+        "  --threads N        worker threads (all cores)\n"
+        "  --seed N           scene seed for the starfield (1)\n"
+        "  --out FILE         output PPM (blackhole.ppm)\n");
+}
+
+int main(int argc, char** argv) {
+    int width = 3840;
+    int height = 2160;
+    float cameraDistance = 28.0f;
+    float cameraHeight = 8.0f;
+    float cameraAngle = 0.0f;
+    float fovy = 60.0f;
+    float time = 0.0f;
+    int threads = 0;
+    uint64_t seed = DEFAULT_SCENE_SEED;
+    const char* outPath = "blackhole.ppm";
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--width") == 0 && hasValue) width = atoi(argv[++i]);
+        else if (strcmp(arg, "--height") == 0 && hasValue) height = atoi(argv[++i]);
+        else if (strcmp(arg, "--distance") == 0 && hasValue) cameraDistance = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--height-y") == 0 && hasValue) cameraHeight = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--angle") == 0 && hasValue) cameraAngle = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--fov") == 0 && hasValue) fovy = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--time") == 0 && hasValue) time = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--threads") == 0 && hasValue) threads = atoi(argv[++i]);
+        else if (strcmp(arg, "--seed") == 0 && hasValue) seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(arg, "--out") == 0 && hasValue) outPath = argv[++i];
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (width <= 0 || height <= 0) {
+        printUsage();
+        return 2;
+    }
+
+    TaskScheduler scheduler(threads);
+    BlackHole blackHole;
+    blackHole.seed = seed;
+    Starfield starfield(3000, seed);
+    GeodesicTracer tracer(&blackHole, starfield);
+    tracer.time = time;
+
+    Camera3D camera = {0};
+    camera.position = {cosf(cameraAngle) * cameraDistance, cameraHeight, sinf(cameraAngle) * cameraDistance};
+    camera.target = blackHole.position;
+    camera.up = {0, 1, 0};
+    camera.fovy = fovy;
+    camera.projection = CAMERA_PERSPECTIVE;
+
+    std::vector<Color> pixels((size_t)width * height);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long long rays = tracer.render(camera, width, height, scheduler, pixels.data());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!writePpm(outPath, width, height, pixels)) {
+        fprintf(stderr, "blackhole_trace: cannot write %s\n", outPath);
+        return 1;
+    }
+
+    printf("{\"width\": %d, \"height\": %d, \"threads\": %d, \"simd\": \"%s\", \"rays\": %lld, "
+        "\"seconds\": %.4f, \"rays_per_second\": %.0f, \"out\": \"%s\"}\n",
+        width, height, scheduler.threadCount(), simdLevelName(tracer.simdLevel), rays,
+        seconds, seconds > 0 ? rays / seconds : 0.0, outPath);
+    return 0;
+}
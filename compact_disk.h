@@ -0,0 +1,443 @@
+#pragma once
+
+#include "simulation.h"
+#include <cstdint>
+
+// Quantized accretion disk for very large particle counts. Per particle it
+// keeps only what cannot be derived:
+//     angle       uint16, 2pi / 65536 per step
+//     radius      uint16, horizon .. outer edge
+//     height      int16,  +-DISK_HEIGHT_RANGE
+//     life        uint16, 1/2048 s
+//     generation  uint16, respawn counter for the RNG (wraps)
+// = 10 bytes, against 40 for AccretionDisk. Orbital speed and color follow
+// from the radius, maxLife from the particle's first random block, and
+// positions are only built while drawing, through a 64K sine table indexed
+// directly by the quantized angle.
+//
+// Per-step changes are far smaller than a quantum (the radius decays by
+// ~1e-6 per frame), so every increment is dithered before it is truncated.
+// The dither walks a golden-ratio sequence from a per-particle offset: its
+// running sum tracks the exact one to within a few quanta, where independent
+// random dither would drift like a random walk.
+
+const float DISK_HEIGHT_RANGE = 0.32f;
+const float DISK_LIFE_UNITS = 2048.0f;
+// sin over one period in 65536 steps; cos(a) is entry a + 16384.
+class SineTable {
+public:
+    float values[65536];
+
+    SineTable() {
+        for (int i = 0; i < 65536; i++) values[i] = sinf(i * (BH_PI * 2.0f / 65536.0f));
+    }
+
+    static const SineTable& get() {
+        static SineTable table;
+        return table;
+    }
+
+    float sinAt(uint32_t angle) const { return values[angle & 0xFFFFu]; }
+    float cosAt(uint32_t angle) const { return values[(angle + 16384u) & 0xFFFFu]; }
+};
+
+class CompactAccretionDisk {
+public:
+    AlignedBuffer<uint16_t> angle;
+    AlignedBuffer<uint16_t> radius;
+    AlignedBuffer<int16_t> height;
+    AlignedBuffer<uint16_t> life;
+    AlignedBuffer<uint16_t> generation;
+    int particleCount;
+    int activeCount;     // update and draw only [0, activeCount)
+    BlackHole* blackHole;
+    SimdLevel simdLevel;
+    CounterRng rng;
+    uint32_t stepCount;
+    float radiusMin;     // quantization bounds, refreshed by requantize()
+    float radiusStep;
+    DiskCullBins cullBins;
+    AlignedBuffer<int> drawIndex;
+    std::vector<int> chunkOffsets;
+    DiskColorTable colorTable;
+
+    // Same contract as AccretionDisk's pipelined mode. Updates write angle
+    // and radius (the drawn fields) to the back buffers.
+    struct Targets {
+        uint16_t* angle;
+        uint16_t* radius;
+    };
+    bool pipelined;
+    AlignedBuffer<uint16_t> backAngle;
+    AlignedBuffer<uint16_t> backRadius;
+
+    static const int BYTES_PER_PARTICLE = 2 + 2 + 2 + 2 + 2;
+    // Read and written by every update: angle, radius and life.
+    static const int UPDATE_BYTES_PER_PARTICLE = 2 * (2 + 2 + 2);
+
+    CompactAccretionDisk(BlackHole* bh, int count) {
+        blackHole = bh;
+        particleCount = count;
+        activeCount = count;
+        simdLevel = detectSimdLevel();
+        rng = CounterRng(bh->seed, RNG_STREAM_DISK);
+        stepCount = 0;
+        pipelined = false;
+        radiusMin = bh->eventHorizonRadius;
+        radiusStep = radiusStepFor(radiusMin, bh->accretionDiskOuter);
+        colorTable.refresh(bh->colorInputs());
+        initParticles();
+    }
+
+    // Same random draws as AccretionDisk, so both start from one scene.
+    void initParticles() {
+        angle.resize(particleCount);
+        radius.resize(particleCount);
+        height.resize(particleCount);
+        life.resize(particleCount);
+        generation.resize(particleCount);
+
+        float span = blackHole->accretionDiskOuter - blackHole->accretionDiskInner;
+        for (int i = 0; i < particleCount; i++) {
+            RandomBlock r0 = rng.block(i, 0, 0);
+            float uLife = rng.uniform(i, 0, 1, 0);
+            float r = blackHole->accretionDiskInner + r0.uniform(0) * span;
+            float h = (r0.uniform(2) - 0.5f) * 0.6f * (1.0f - (r - blackHole->accretionDiskInner) / span * 0.5f);
+
+            radius[i] = quantizeRadius(r);
+            angle[i] = quantizeAngle(r0.uniform(1) * BH_PI * 2.0f);
+            height[i] = (int16_t)lrintf(h / DISK_HEIGHT_RANGE * 32767.0f);
+            life[i] = quantizeLife(uLife * maxLifeOf(i));
+            generation[i] = 0;
+        }
+    }
+
+    // Same contract as AccretionDisk::setActiveCount.
+    void setActiveCount(int count, double time, TaskScheduler& scheduler) {
+        requantize(scheduler);
+        count = std::max(0, std::min(count, particleCount));
+        if (count > activeCount) {
+            scheduler.parallelFor(activeCount, count, DISK_UPDATE_GRAIN, [this, time](int begin, int end) {
+                seekRange(time, begin, end);
+            });
+        }
+        activeCount = count;
+    }
+
+    float maxLifeOf(int i) const {
+        return 10.0f + rng.uniform(i, 0, 0, 3) * 20.0f;
+    }
+
+    static float radiusStepFor(float horizon, float outer) {
+        return (outer - horizon) / 65535.0f;
+    }
+
+    // Moves the radius quanta to a changed horizon or outer edge. Particles
+    // the new range cannot hold are given a tick of life, so the next update
+    // respawns them. Only between steps; in pipelined mode both buffers are
+    // converted.
+    void requantize(TaskScheduler& scheduler) {
+        float newMin = blackHole->eventHorizonRadius;
+        float newStep = radiusStepFor(newMin, blackHole->accretionDiskOuter);
+        if (newMin == radiusMin && newStep == radiusStep) return;
+        float oldMin = radiusMin;
+        float oldStep = radiusStep;
+        radiusMin = newMin;
+        radiusStep = newStep;
+        float outer = blackHole->accretionDiskOuter;
+        scheduler.parallelFor(0, particleCount, DISK_UPDATE_GRAIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                float r = oldMin + radius[i] * oldStep;
+                radius[i] = quantizeRadius(r);
+                if (pipelined) backRadius[i] = quantizeRadius(oldMin + backRadius[i] * oldStep);
+                if (r < newMin || r > outer) life[i] = 1;
+            }
+        });
+    }
+
+    uint16_t quantizeRadius(float r) const {
+        float q = (r - radiusMin) / radiusStep;
+        return (uint16_t)(q < 0 ? 0 : q > 65535.0f ? 65535 : lrintf(q));
+    }
+
+    static uint16_t quantizeAngle(float a) {
+        return (uint16_t)((uint32_t)lrintf(a * (65536.0f / (BH_PI * 2.0f))) & 0xFFFFu);
+    }
+
+    static uint16_t quantizeLife(float seconds) {
+        float q = seconds * DISK_LIFE_UNITS;
+        return (uint16_t)(q > 65535.0f ? 65535 : lrintf(q));
+    }
+
+    float radiusAt(int i) const { return radiusMin + radius[i] * radiusStep; }
+    float angleAt(int i) const { return angle[i] * (BH_PI * 2.0f / 65536.0f); }
+    float heightAt(int i) const { return height[i] * (DISK_HEIGHT_RANGE / 32767.0f); }
+
+    Vector3 positionAt(int i) const {
+        const SineTable& table = SineTable::get();
+        float r = radiusAt(i);
+        uint32_t wobble = 3u * angle[i] + (uint32_t)(r * (65536.0f / (BH_PI * 2.0f)));
+        return {
+            table.cosAt(angle[i]) * r,
+            heightAt(i) * (r / blackHole->accretionDiskOuter) + table.sinAt(wobble) * 0.08f,
+            table.sinAt(angle[i]) * r
+        };
+    }
+
+    void respawnParticle(int i, const Targets& out) {
+        RandomBlock r = rng.block(i, ++generation[i]);
+        float span = blackHole->accretionDiskOuter - blackHole->accretionDiskInner;
+        float newRadius = blackHole->accretionDiskInner + r.uniform(0) * span;
+        out.radius[i] = quantizeRadius(newRadius);
+        out.angle[i] = quantizeAngle(r.uniform(1) * BH_PI * 2.0f);
+        life[i] = quantizeLife(maxLifeOf(i));
+    }
+
+    Targets targets() {
+        if (pipelined) return {backAngle.data(), backRadius.data()};
+        return {angle.data(), radius.data()};
+    }
+
+    void setPipelined(bool enabled) {
+        if (enabled == pipelined) return;
+        pipelined = enabled;
+        if (enabled) {
+            angle.own();
+            radius.own();
+            backAngle = angle;
+            backRadius = radius;
+        } else {
+            backAngle = AlignedBuffer<uint16_t>();
+            backRadius = AlignedBuffer<uint16_t>();
+        }
+    }
+
+    void swapBuffers() {
+        if (!pipelined) return;
+        std::swap(angle, backAngle);
+        std::swap(radius, backRadius);
+    }
+
+    size_t pipelineBytes() const {
+        return (backAngle.size() + backRadius.size()) * sizeof(uint16_t);
+    }
+
+    // Closed-form jump to time t since initParticles. The speed follows the
+    // radius here, omega = C r^-3/2 with r^3 = r0^3 - 3kt, which integrates
+    // to an angle of C * 2 / (3k) * (r0^3/2 - r^3/2).
+    void seek(double t, TaskScheduler& scheduler) {
+        BH_PROFILE_SCOPE("CompactAccretionDisk::seek");
+        requantize(scheduler);
+        scheduler.parallelFor(0, particleCount, DISK_UPDATE_GRAIN, [this, t](int begin, int end) {
+            seekRange(t, begin, end);
+        });
+    }
+
+    void seekRange(double t, int begin, int end) {
+        DiskOrbitModel model(*blackHole);
+        const double speed = 0.15 * sqrt((double)blackHole->mass);
+        const double twoPi = BH_PI * 2.0;
+
+        for (int i = begin; i < end; i++) {
+            DiskSpawn s = diskSpawnAt(model, rng, i, t, maxLifeOf(i));
+            float r = model.radiusAfter(s.radius, s.age);
+            double swept = model.decayRate > 0
+                ? speed * 2.0 / (3.0 * model.decayRate) * (pow(s.radius, 1.5) - pow(r, 1.5))
+                : speed * pow(s.radius, -1.5) * s.age;
+
+            radius[i] = quantizeRadius(r);
+            angle[i] = quantizeAngle((float)fmod(s.angle + swept, twoPi));
+            life[i] = s.lifeLeft > 0 ? std::max<uint16_t>(quantizeLife((float)s.lifeLeft), 1) : 1;
+            // Past 65536 generations (a week of disk time) this and the
+            // stepped disk's wrapped counter draw different respawns.
+            generation[i] = (uint16_t)s.generation;
+        }
+    }
+
+    void update(float dt, TaskScheduler& scheduler) {
+        BH_PROFILE_SCOPE("CompactAccretionDisk::update");
+        uint32_t step = stepCount++;
+        scheduler.parallelFor(0, activeCount, DISK_UPDATE_GRAIN, [this, dt, step](int begin, int end) {
+            updateRange(dt, step, begin, end);
+        });
+    }
+
+    void updateRange(float dt, uint32_t step, int begin, int end) {
+        int done = begin;
+#if BH_SIMD_X86
+        if (simdLevel == SIMD_AVX2) done = updateAvx2(dt, step, begin, end);
+#endif
+        updateScalar(dt, step, done, end);
+    }
+
+    // Per-particle dither offsets: three 10-bit fields.
+    static uint32_t ditherHash(uint32_t i) {
+        uint32_t h = i * 0x9E3779B1u;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 12;
+        return h;
+    }
+
+    // The AVX2 kernel does the same float operations in the same order and
+    // is built without FMA, so both paths produce identical disks.
+    void updateScalar(float dt, uint32_t step, int begin, int end) {
+        const float angleScale = 0.15f * sqrtf(blackHole->mass) * dt * (65536.0f / (BH_PI * 2.0f));
+        const float decay = 0.02f * dt * blackHole->mass * 0.01f / radiusStep;
+        const float lifeStep = dt * DISK_LIFE_UNITS;
+        // 633 / 1024 ~ golden ratio; odd, so the sequence has period 1024.
+        const uint32_t stepOffset = step * 633u;
+        const Targets out = targets();
+
+        for (int i = begin; i < end; i++) {
+            uint32_t h = ditherHash(i);
+            float d0 = (float)((h + stepOffset) & 1023u) * (1.0f / 1024.0f);
+            float d1 = (float)(((h >> 10) + stepOffset) & 1023u) * (1.0f / 1024.0f);
+            float d2 = (float)(((h >> 20) + stepOffset) & 1023u) * (1.0f / 1024.0f);
+
+            float r = radiusMin + (float)radius[i] * radiusStep;
+            float invR = 1.0f / r;
+            // Kepler: omega = 0.15 * sqrt(mass / r) / r.
+            out.angle[i] = (uint16_t)(angle[i] + (int)(angleScale * invR * sqrtf(invR) + d0));
+            int shrink = (int)(decay * invR * invR + d1);
+            int lifeLeft = (int)life[i] - (int)(lifeStep + d2);
+
+            if (lifeLeft <= 0 || shrink > (int)radius[i]) {
+                respawnParticle(i, out);
+            } else {
+                out.radius[i] = (uint16_t)(radius[i] - shrink);
+                life[i] = (uint16_t)lifeLeft;
+            }
+        }
+    }
+
+#if BH_SIMD_X86
+    BH_TARGET_AVX2_NOFMA static __m128i packU16(__m256i v) {
+        return _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08));
+    }
+
+    BH_TARGET_AVX2_NOFMA int updateAvx2(float dt, uint32_t step, int begin, int end) {
+        const __m256 angleScale = _mm256_set1_ps(0.15f * sqrtf(blackHole->mass) * dt * (65536.0f / (BH_PI * 2.0f)));
+        const __m256 decay = _mm256_set1_ps(0.02f * dt * blackHole->mass * 0.01f / radiusStep);
+        const __m256 lifeStep = _mm256_set1_ps(dt * DISK_LIFE_UNITS);
+        const __m256 rMin = _mm256_set1_ps(radiusMin);
+        const __m256 rStep = _mm256_set1_ps(radiusStep);
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 ditherScale = _mm256_set1_ps(1.0f / 1024.0f);
+        const __m256i ditherMask = _mm256_set1_epi32(1023);
+        const __m256i angleMask = _mm256_set1_epi32(0xFFFF);
+        const __m256i stepOffset = _mm256_set1_epi32((int)(step * 633u));
+        const __m256i golden = _mm256_set1_epi32((int)0x9E3779B1u);
+        const __m256i mix = _mm256_set1_epi32(0x2C1B3C6D);
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i oneLife = _mm256_set1_epi32(1);
+        const Targets out = targets();
+
+        int i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256i h = _mm256_add_epi32(_mm256_set1_epi32(i), lanes);
+            h = _mm256_mullo_epi32(h, golden);
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+            h = _mm256_mullo_epi32(h, mix);
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+            __m256 d0 = _mm256_mul_ps(_mm256_cvtepi32_ps(
+                _mm256_and_si256(_mm256_add_epi32(h, stepOffset), ditherMask)), ditherScale);
+            __m256 d1 = _mm256_mul_ps(_mm256_cvtepi32_ps(
+                _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(h, 10), stepOffset), ditherMask)), ditherScale);
+            __m256 d2 = _mm256_mul_ps(_mm256_cvtepi32_ps(
+                _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(h, 20), stepOffset), ditherMask)), ditherScale);
+
+            __m256i a = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&angle[i]));
+            __m256i q = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&radius[i]));
+            __m256i l = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&life[i]));
+
+            __m256 r = _mm256_add_ps(rMin, _mm256_mul_ps(_mm256_cvtepi32_ps(q), rStep));
+            __m256 invR = _mm256_div_ps(one, r);
+            __m256 omega = _mm256_mul_ps(_mm256_mul_ps(angleScale, invR), _mm256_sqrt_ps(invR));
+            a = _mm256_and_si256(_mm256_add_epi32(a, _mm256_cvttps_epi32(_mm256_add_ps(omega, d0))), angleMask);
+            __m256i shrink = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(decay, invR), invR), d1));
+            __m256i lifeLeft = _mm256_sub_epi32(l, _mm256_cvttps_epi32(_mm256_add_ps(lifeStep, d2)));
+
+            __m256i dead = _mm256_or_si256(_mm256_cmpgt_epi32(oneLife, lifeLeft), _mm256_cmpgt_epi32(shrink, q));
+            _mm_storeu_si128((__m128i*)&out.angle[i], packU16(a));
+            _mm_storeu_si128((__m128i*)&out.radius[i], packU16(_mm256_blendv_epi8(_mm256_sub_epi32(q, shrink), q, dead)));
+            _mm_storeu_si128((__m128i*)&life[i], packU16(_mm256_andnot_si256(dead, lifeLeft)));
+
+            int respawn = _mm256_movemask_ps(_mm256_castsi256_ps(dead));
+            while (respawn) {
+                respawnParticle(i + __builtin_ctz(respawn), out);
+                respawn &= respawn - 1;
+            }
+        }
+        return i;
+    }
+#endif
+
+    void drawParticle(int i, Vector3* positions, Color* colors, const SineTable& table) const {
+        Vector3 p = positionAt(i);
+        // DiskColorTable::shade with the direction taken from the sine table.
+        float u = table.cosAt(angle[i]) * colorTable.viewZ - table.sinAt(angle[i]) * colorTable.viewX;
+        Color c = colorTable.fetch(radiusAt(i), u);
+
+        positions[0] = p;
+        positions[1] = {p.x, p.y, p.z + 0.1f};
+        colors[0] = c;
+        colors[1] = c;
+    }
+
+    // With a culler, particles are binned straight from their quantized
+    // radius and angle. Culled draws run in two passes over fixed chunks:
+    // each chunk compacts the indices of its visible particles in place
+    // without branches, then writes them at its prefix-sum offset.
+    void draw(VertexBatch& batch, const Camera3D& camera, TaskScheduler& scheduler, ViewCuller* culler = nullptr) {
+        BH_PROFILE_SCOPE("CompactAccretionDisk::draw");
+        colorTable.refresh(blackHole->colorInputs());
+        colorTable.setViewer(camera.position, blackHole->position);
+        if (culler) cullBins.classify(*culler, blackHole->eventHorizonRadius, blackHole->accretionDiskOuter);
+        if (!culler || cullBins.allVisible()) {
+            int first = batch.reserve(activeCount * 2);
+            Vector3* positions = batch.positions.data() + first;
+            Color* colors = batch.colors.data() + first;
+            scheduler.parallelFor(0, activeCount, DISK_UPDATE_GRAIN, [&](int begin, int end) {
+                const SineTable& table = SineTable::get();
+                for (int i = begin; i < end; i++) drawParticle(i, positions + i * 2, colors + i * 2, table);
+            });
+            if (culler) culler->count(CULL_DISK, activeCount, 0, DISK_CULL_BINS, 0);
+            return;
+        }
+
+        int chunks = (activeCount + DISK_UPDATE_GRAIN - 1) / DISK_UPDATE_GRAIN;
+        chunkOffsets.assign(chunks + 1, 0);
+        drawIndex.resize(activeCount);
+        scheduler.parallelFor(0, chunks, 1, [&](int begin, int end) {
+            for (int chunk = begin; chunk < end; chunk++) {
+                int start = chunk * DISK_UPDATE_GRAIN;
+                int last = std::min(activeCount, start + DISK_UPDATE_GRAIN);
+                int n = start;
+                for (int i = start; i < last; i++) {
+                    drawIndex[n] = i;
+                    n += cullBins.visible[DiskCullBins::binOfQuantized(radius[i], angle[i])];
+                }
+                chunkOffsets[chunk + 1] = n - start;
+            }
+        });
+        for (int chunk = 0; chunk < chunks; chunk++) chunkOffsets[chunk + 1] += chunkOffsets[chunk];
+        int drawn = chunkOffsets[chunks];
+
+        int first = batch.reserve(drawn * 2);
+        Vector3* positions = batch.positions.data() + first;
+        Color* colors = batch.colors.data() + first;
+        scheduler.parallelFor(0, chunks, 1, [&](int begin, int end) {
+            const SineTable& table = SineTable::get();
+            for (int chunk = begin; chunk < end; chunk++) {
+                const int* indices = drawIndex.data() + chunk * DISK_UPDATE_GRAIN;
+                int out = chunkOffsets[chunk];
+                int count = chunkOffsets[chunk + 1] - out;
+                for (int k = 0; k < count; k++) {
+                    drawParticle(indices[k], positions + (out + k) * 2, colors + (out + k) * 2, table);
+                }
+            }
+        });
+        culler->count(CULL_DISK, drawn, activeCount - drawn, DISK_CULL_BINS, DISK_CULL_BINS - cullBins.visibleBins);
+    }
+};
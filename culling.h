@@ -0,0 +1,214 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// View culling by bins. Points are grouped into bins with a bounding sphere
+// (disk sectors, sky tiles, jet slabs); each frame every bin is tested once
+// against the camera frustum and against the shadow cone of the opaque
+// horizon sphere, and points in a rejected bin are skipped before any
+// position or color work. The tests are conservative: a bin is only rejected
+// when no point of its bound can be on screen.
+
+const float CULL_NEAR_PLANE = 0.01f;     // raylib's default near plane
+const float CULL_POINT_LENGTH = 0.1f;    // VertexBatch::addPoint reaches this far along +z
+
+enum CullGroup {
+    CULL_DISK,
+    CULL_STARS,
+    CULL_JETS,
+    CULL_PHOTONS,
+    CULL_GROUP_COUNT
+};
+
+struct CullStats {
+    long long submitted;
+    long long culled;
+    int bins;
+    int binsCulled;
+};
+
+struct BoundingSphere {
+    Vector3 center;
+    float radius;
+};
+
+// Bound of the wedge r0..r1, a0..a1, y0..y1 around `origin`, with angles
+// measured from +x towards +z as in the disk (a1 - a0 at most pi/2). The
+// farthest point from the middle is always one of the four corners.
+inline BoundingSphere wedgeBound(Vector3 origin, float r0, float r1, float a0, float a1, float y0, float y1) {
+    float mid = 0.5f * (a0 + a1);
+    float rMid = 0.5f * (r0 + r1);
+    float cx = cosf(mid) * rMid, cz = sinf(mid) * rMid;
+    float farthest = 0;
+    const float radii[2] = {r0, r1};
+    const float angles[2] = {a0, a1};
+    for (float r : radii) {
+        for (float a : angles) {
+            float dx = cosf(a) * r - cx, dz = sinf(a) * r - cz;
+            farthest = std::max(farthest, dx * dx + dz * dz);
+        }
+    }
+    float halfHeight = 0.5f * (y1 - y0);
+    BoundingSphere bound;
+    bound.center = {origin.x + cx, origin.y + 0.5f * (y0 + y1), origin.z + cz};
+    bound.radius = sqrtf(farthest + halfHeight * halfHeight) + CULL_POINT_LENGTH;
+    return bound;
+}
+
+class ViewCuller {
+public:
+    Vector3 eye;
+    Vector3 planes[5];          // inward normals through the eye; [0] is the view direction
+    Vector3 occluderCenter;
+    float occluderRadius;
+    CullStats stats[CULL_GROUP_COUNT];
+
+    ViewCuller() {
+        Camera3D camera = {0};
+        camera.position = {0, 0, 1};
+        camera.up = {0, 1, 0};
+        camera.fovy = 60.0f;
+        setup(camera, 1.0f, {0, 0, 0}, 0);
+    }
+
+    void setup(const Camera3D& camera, float aspect, Vector3 horizonCenter, float horizonRadius) {
+        eye = camera.position;
+        Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+        Vector3 right = Vector3Normalize(Vector3CrossProduct(forward, camera.up));
+        Vector3 up = Vector3CrossProduct(right, forward);
+        float tanY = tanf(camera.fovy * DEG2RAD * 0.5f);
+        float tanX = tanY * aspect;
+
+        planes[0] = forward;
+        planes[1] = Vector3Normalize(Vector3Add(right, Vector3Scale(forward, tanX)));
+        planes[2] = Vector3Normalize(Vector3Subtract(Vector3Scale(forward, tanX), right));
+        planes[3] = Vector3Normalize(Vector3Add(up, Vector3Scale(forward, tanY)));
+        planes[4] = Vector3Normalize(Vector3Subtract(Vector3Scale(forward, tanY), up));
+        occluderCenter = horizonCenter;
+        occluderRadius = horizonRadius;
+        for (CullStats& s : stats) s = CullStats{0, 0, 0, 0};
+    }
+
+    bool sphereInFrustum(Vector3 center, float radius) const {
+        Vector3 offset = Vector3Subtract(center, eye);
+        if (Vector3DotProduct(offset, planes[0]) < CULL_NEAR_PLANE - radius) return false;
+        for (int k = 1; k < 5; k++) {
+            if (Vector3DotProduct(offset, planes[k]) < -radius) return false;
+        }
+        return true;
+    }
+
+    // Directions from the eye within halfAngle of `axis` (unit length). Used
+    // for lensed stars, whose bound is a cone of sight lines, not a sphere.
+    bool coneInFrustum(Vector3 axis, float halfAngle) const {
+        if (halfAngle >= 0.5f * PI) return true;
+        float limit = -sinf(halfAngle);
+        for (int k = 0; k < 5; k++) {
+            if (Vector3DotProduct(axis, planes[k]) < limit) return false;
+        }
+        return true;
+    }
+
+    // True when the whole sphere sits in the horizon's shadow: inside the
+    // cone the horizon subtends from the eye and no nearer than its center.
+    // Every sight line in that cone enters the horizon before that distance.
+    bool sphereOccluded(Vector3 center, float radius) const {
+        Vector3 toOccluder = Vector3Subtract(occluderCenter, eye);
+        float occluderDistance = Vector3Length(toOccluder);
+        if (occluderDistance <= occluderRadius) return false;
+        Vector3 offset = Vector3Subtract(center, eye);
+        float distance = Vector3Length(offset);
+        if (distance - radius < occluderDistance) return false;
+
+        float cosAngle = Vector3DotProduct(offset, toOccluder) / (distance * occluderDistance);
+        float angle = acosf(Clamp(cosAngle, -1.0f, 1.0f));
+        return angle + asinf(radius / distance) <= asinf(occluderRadius / occluderDistance);
+    }
+
+    bool sphereVisible(const BoundingSphere& bound) const {
+        return sphereInFrustum(bound.center, bound.radius) && !sphereOccluded(bound.center, bound.radius);
+    }
+
+    void count(CullGroup group, long long submitted, long long culled, int bins, int binsCulled) {
+        CullStats& s = stats[group];
+        s.submitted += submitted;
+        s.culled += culled;
+        s.bins += bins;
+        s.binsCulled += binsCulled;
+    }
+
+    CullStats total() const {
+        CullStats sum = {0, 0, 0, 0};
+        for (const CullStats& s : stats) {
+            sum.submitted += s.submitted;
+            sum.culled += s.culled;
+            sum.bins += s.bins;
+            sum.binsCulled += s.binsCulled;
+        }
+        return sum;
+    }
+};
+
+// Disk bins: DISK_CULL_BANDS even radius bands from the horizon to the outer
+// edge times DISK_CULL_SECTORS even angle sectors. The float disk bins from
+// its orbit radius and angle, the compact disk from the quantized ones with
+// two shifts.
+const int DISK_CULL_BANDS = 4;
+const int DISK_CULL_SECTORS = 64;
+const int DISK_CULL_BINS = DISK_CULL_BANDS * DISK_CULL_SECTORS;
+const int DISK_CULL_BAND_SHIFT = 14;      // 16-bit radius -> band
+const int DISK_CULL_SECTOR_SHIFT = 10;    // 16-bit angle -> sector
+const float DISK_CULL_HALF_HEIGHT = 0.4f; // tilt plus the 0.08 wobble, both layouts
+static_assert(DISK_CULL_BANDS << DISK_CULL_BAND_SHIFT == 65536, "bands must split the 16-bit radius");
+static_assert(DISK_CULL_SECTORS << DISK_CULL_SECTOR_SHIFT == 65536, "sectors must split the 16-bit angle");
+
+class DiskCullBins {
+public:
+    float innerRadius;
+    float bandScale;                    // bands per unit of radius
+    uint8_t visible[DISK_CULL_BINS];    // [band * DISK_CULL_SECTORS + sector]
+    int visibleBins;
+
+    DiskCullBins() {
+        innerRadius = 0;
+        bandScale = 0;
+        std::fill(visible, visible + DISK_CULL_BINS, (uint8_t)1);
+        visibleBins = DISK_CULL_BINS;
+    }
+
+    void classify(const ViewCuller& view, float inner, float outer) {
+        float bandWidth = (outer - inner) / DISK_CULL_BANDS;
+        innerRadius = inner;
+        bandScale = 1.0f / bandWidth;
+        visibleBins = 0;
+        for (int s = 0; s < DISK_CULL_SECTORS; s++) {
+            float a0 = 2.0f * PI * s / DISK_CULL_SECTORS;
+            float a1 = 2.0f * PI * (s + 1) / DISK_CULL_SECTORS;
+            for (int b = 0; b < DISK_CULL_BANDS; b++) {
+                BoundingSphere bound = wedgeBound({0, 0, 0}, inner + bandWidth * b, inner + bandWidth * (b + 1),
+                                                  a0, a1, -DISK_CULL_HALF_HEIGHT, DISK_CULL_HALF_HEIGHT);
+                bool seen = view.sphereVisible(bound);
+                visible[b * DISK_CULL_SECTORS + s] = seen;
+                visibleBins += seen;
+            }
+        }
+    }
+
+    bool allVisible() const { return visibleBins == DISK_CULL_BINS; }
+
+    // Angle in [0, 2pi); radii just inside the horizon fall in band 0, which
+    // the point padding of the bounds covers.
+    int binOf(float radius, float angle) const {
+        int band = std::max(0, std::min((int)((radius - innerRadius) * bandScale), DISK_CULL_BANDS - 1));
+        int sector = std::min((int)(angle * (DISK_CULL_SECTORS / (2.0f * PI))), DISK_CULL_SECTORS - 1);
+        return band * DISK_CULL_SECTORS + sector;
+    }
+
+    static int binOfQuantized(uint16_t radius, uint16_t angle) {
+        return (radius >> DISK_CULL_BAND_SHIFT) * DISK_CULL_SECTORS + (angle >> DISK_CULL_SECTOR_SHIFT);
+    }
+};
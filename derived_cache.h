@@ -0,0 +1,77 @@
+#pragma once
+
+#include "task_scheduler.h"
+#include <utility>
+
+// Geometry and tables derived from parameters that can change while the
+// scene runs. Each cache names its inputs in a small struct with operator==
+// and keeps the inputs its value was built from; it is stale when they
+// differ from the live ones. refresh() then builds a new value on the
+// scheduler's background thread into a second copy and swaps it in on a later
+// call once the task has finished, so drawing keeps the old value for a frame
+// or two instead of waiting. Without a scheduler, with a single-threaded one,
+// or before the first build, it builds inline.
+//
+// build(inputs, value) runs on a worker and must only read `inputs`.
+
+template <typename Inputs, typename T>
+class DerivedCache {
+public:
+    T value;
+    Inputs inputs;      // what value was built from
+    bool valid;
+    int rebuilds;
+
+    DerivedCache() {
+        valid = false;
+        rebuilds = 0;
+        building = false;
+        scheduler = nullptr;
+    }
+
+    ~DerivedCache() {
+        finish();
+    }
+
+    DerivedCache(const DerivedCache&) = delete;
+    DerivedCache& operator=(const DerivedCache&) = delete;
+
+    // Waits for a rebuild in flight; the next refresh() swaps it in.
+    void finish() {
+        if (building) scheduler->wait(group);
+    }
+
+    // Returns true when value changed since the last call.
+    template <typename Build>
+    bool refresh(const Inputs& wanted, TaskScheduler* taskScheduler, Build build) {
+        bool changed = false;
+        if (building) {
+            if (group.pending.load(std::memory_order_acquire) > 0) return false;
+            building = false;
+            std::swap(value, next);
+            inputs = nextInputs;
+            rebuilds++;
+            changed = true;
+        }
+        if (valid && inputs == wanted) return changed;
+        if (!taskScheduler || !valid || taskScheduler->threadCount() == 1) {
+            build(wanted, value);
+            inputs = wanted;
+            valid = true;
+            rebuilds++;
+            return true;
+        }
+        nextInputs = wanted;
+        building = true;
+        scheduler = taskScheduler;
+        scheduler->runBackground(group, [this, build]() { build(nextInputs, next); });
+        return changed;
+    }
+
+private:
+    T next;
+    Inputs nextInputs;
+    bool building;
+    TaskScheduler* scheduler;
+    TaskGroup group;
+};
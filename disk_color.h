@@ -0,0 +1,196 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+#include "derived_cache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Disk color from a thin-disk model. Gas at radius r glows as a blackbody at
+// the Novikov-Thorne temperature
+//     T(r) ~ r^-3/4 (1 - sqrt(r0 / r))^1/4,
+// with r0 = 36/49 of the inner edge so that T peaks there at
+// DISK_PEAK_KELVIN. Seen from far away, light from gas on a circular orbit is
+// shifted by gravitational redshift and relativistic Doppler together,
+//     g = sqrt(1 - rs / r) / (gamma (1 - beta u)),
+// with beta the orbital speed the geodesic tracer uses (at most
+// DISK_MAX_BETA) and u the cosine
+// between the gas velocity and the line of sight. A shifted blackbody is a
+// blackbody at g T. Its flux, (g T)^4 relative to the peak, goes through a
+// soft knee, so the approaching side saturates to white instead of clipping.
+// RGB samples the Planck spectrum at 610, 550 and 465 nm, relative to 6500 K
+// white and scaled so the brightest channel is 1.
+//
+// diskColor() is the exact formula. DiskColorTable bakes it over
+// (radius, u) whenever the hole's parameters change, so shading a particle
+// is one table fetch.
+
+const float DISK_PEAK_KELVIN = 7000.0f;
+const float DISK_FLUX_KNEE = 0.02f;      // flux where the knee is half way
+const int DISK_COLOR_RADII = 256;        // rows, r0 .. outer edge
+const int DISK_COLOR_SPEEDS = 64;        // columns, u in -1 .. 1
+const int DISK_COLOR_SPEED_STEPS = 2048;  // column lookup, u in -1 .. 1
+const double DISK_MAX_BETA = 0.95;
+
+struct DiskColorInputs {
+    float horizon;
+    float inner;
+    float outer;
+
+    bool operator==(const DiskColorInputs& o) const {
+        return horizon == o.horizon && inner == o.inner && outer == o.outer;
+    }
+};
+
+// Where the temperature falls to zero.
+inline double diskCutoff(const DiskColorInputs& in) {
+    return in.inner * (36.0 / 49.0);
+}
+
+// Rest-frame temperature; zero inside r0.
+inline double diskTemperature(const DiskColorInputs& in, double r) {
+    double r0 = diskCutoff(in);
+    if (r <= r0) return 0;
+    // At the inner edge, 1 - sqrt(r0 / r) = 1/7.
+    double f = (1.0 - sqrt(r0 / r)) / (r * r * r);
+    double peak = 1.0 / (7.0 * in.inner * in.inner * in.inner);
+    return DISK_PEAK_KELVIN * pow(f / peak, 0.25);
+}
+
+inline double diskShift(const DiskColorInputs& in, double r, double u) {
+    double rs = in.horizon;
+    if (r <= rs) return 0;
+    double beta = std::min(sqrt(rs / (2.0 * (r - rs))), DISK_MAX_BETA);
+    return sqrt(1.0 - rs / r) * sqrt(1.0 - beta * beta) / (1.0 - beta * u);
+}
+
+// The exact color in 0 .. 255 per channel, before rounding.
+inline void diskColorLevels(const DiskColorInputs& in, double r, double u, double levels[3]) {
+    double kelvin = diskShift(in, r, u) * diskTemperature(in, r);
+    // Below 500 K the flux rounds to zero in every channel.
+    if (kelvin < 500.0) {
+        levels[0] = levels[1] = levels[2] = 0;
+        return;
+    }
+
+    const double hcOverK = 1.4388e-2;    // m K
+    const double wavelength[3] = {610e-9, 550e-9, 465e-9};
+    double brightest = 0;
+    for (int c = 0; c < 3; c++) {
+        levels[c] = expm1(hcOverK / (wavelength[c] * 6500.0)) / expm1(hcOverK / (wavelength[c] * kelvin));
+        brightest = std::max(brightest, levels[c]);
+    }
+    double flux = pow(kelvin / DISK_PEAK_KELVIN, 4.0);
+    double intensity = std::min(1.0, (1.0 + DISK_FLUX_KNEE) * flux / (flux + DISK_FLUX_KNEE));
+    for (int c = 0; c < 3; c++) levels[c] *= 255.0 * intensity / brightest;
+}
+
+inline Color diskColor(const DiskColorInputs& in, double r, double u) {
+    double levels[3];
+    diskColorLevels(in, r, u, levels);
+    return {(unsigned char)lround(levels[0]), (unsigned char)lround(levels[1]), (unsigned char)lround(levels[2]), 255};
+}
+
+// diskColor() on a DISK_COLOR_RADII x DISK_COLOR_SPEEDS grid of nodes. Both
+// axes are stretched where the color changes fastest:
+// - Near r0 the temperature rises as (r - r0)^1/4 with a vertical tangent,
+//   so rows are uniform in (r - start)^1/2, with start r0 (or the horizon,
+//   if that is further out). Everything inside is the black first row.
+// - The Doppler term goes as 1 / (1 - beta u), which at DISK_MAX_BETA grows
+//   twentyfold towards u = 1, so columns are uniform in
+//   -log(1 / DISK_MAX_BETA - u).
+// A fetch takes the nearest node: the row from one square root, the column
+// from an index table linear in u, so there is no log or power per particle.
+// Owners call refresh() before drawing and setViewer() once per frame; the
+// viewer is taken to be far from the disk, so one line of sight serves every
+// particle.
+class DiskColorTable {
+public:
+    DerivedCache<DiskColorInputs, std::vector<Color>> cache;
+    TaskScheduler* scheduler;   // rebuilds run here when set
+    float radiusMin;            // the first row's radius
+    float radiusScale;          // rows per unit of (r - radiusMin)^1/2
+    float viewX;                // unit vector towards the viewer, x and z
+    float viewZ;
+    uint8_t column[DISK_COLOR_SPEED_STEPS];     // nearest column per step of u
+
+    DiskColorTable() {
+        scheduler = nullptr;
+        radiusMin = 0;
+        radiusScale = 0;
+        viewX = 0;
+        viewZ = 1;
+        double axisScale = (DISK_COLOR_SPEEDS - 1) / (speedAxis(1.0) - speedAxis(-1.0));
+        for (int j = 0; j < DISK_COLOR_SPEED_STEPS; j++) {
+            double u = -1.0 + (j + 0.5) * (2.0 / DISK_COLOR_SPEED_STEPS);
+            column[j] = (uint8_t)lround((speedAxis(u) - speedAxis(-1.0)) * axisScale);
+        }
+    }
+
+    static double radiusStart(const DiskColorInputs& in) {
+        return std::max(diskCutoff(in), (double)in.horizon);
+    }
+
+    static double radiusAxisScale(const DiskColorInputs& in) {
+        return (DISK_COLOR_RADII - 1) / sqrt(in.outer - radiusStart(in));
+    }
+
+    static double speedAxis(double u) {
+        return -log(1.0 / DISK_MAX_BETA - u);
+    }
+
+    void refresh(const DiskColorInputs& in) {
+        cache.refresh(in, scheduler, build);
+        radiusMin = (float)radiusStart(cache.inputs);
+        radiusScale = (float)radiusAxisScale(cache.inputs);
+    }
+
+    void setViewer(Vector3 viewer, Vector3 center) {
+        Vector3 n = Vector3Normalize(Vector3Subtract(viewer, center));
+        viewX = n.x;
+        viewZ = n.z;
+    }
+
+    // Where row ri and column ui sit.
+    static double nodeRadius(const DiskColorInputs& in, int ri) {
+        double t = ri / radiusAxisScale(in);
+        return radiusStart(in) + t * t;
+    }
+
+    static double nodeSpeed(int ui) {
+        double w = speedAxis(-1.0) + ui * (speedAxis(1.0) - speedAxis(-1.0)) / (DISK_COLOR_SPEEDS - 1);
+        return 1.0 / DISK_MAX_BETA - exp(-w);
+    }
+
+    static void build(const DiskColorInputs& in, std::vector<Color>& table) {
+        table.resize(DISK_COLOR_RADII * DISK_COLOR_SPEEDS);
+        for (int ri = 0; ri < DISK_COLOR_RADII; ri++) {
+            double r = nodeRadius(in, ri);
+            for (int ui = 0; ui < DISK_COLOR_SPEEDS; ui++) {
+                table[ri * DISK_COLOR_SPEEDS + ui] = diskColor(in, r, nodeSpeed(ui));
+            }
+        }
+    }
+
+    // Nearest row, and the step of u, clamped to the table.
+    void locate(float r, float u, int& ri, int& j) const {
+        ri = (int)(sqrtf(std::max(r - radiusMin, 0.0f)) * radiusScale + 0.5f);
+        j = (int)((u + 1.0f) * (0.5f * DISK_COLOR_SPEED_STEPS));
+        ri = std::min(ri, DISK_COLOR_RADII - 1);
+        j = std::min(std::max(j, 0), DISK_COLOR_SPEED_STEPS - 1);
+    }
+
+    Color fetch(float r, float u) const {
+        int ri, j;
+        locate(r, u, ri, j);
+        return cache.value[ri * DISK_COLOR_SPEEDS + column[j]];
+    }
+
+    // Gas at (x, z) on a prograde circular orbit of radius r, moving along
+    // (-z, 0, x) / r.
+    Color shade(float x, float z, float r) const {
+        return fetch(r, (x * viewZ - z * viewX) / r);
+    }
+};
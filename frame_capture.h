@@ -0,0 +1,274 @@
+#pragma once
+
+#include "raylib.h"
+#include "simd.h"
+#include "platform.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams rendered frames to disk or to an encoder without stalling the
+// render loop. The renderer reads each frame back into one of a ring of
+// preallocated RGBA buffers and hands it over; writer threads flip, encode
+// and write it. The renderer only waits when every buffer is still queued
+// for writing, or with dropWhenFull skips the frame instead. Both cases are
+// counted.
+
+enum CaptureFormat {
+    CAPTURE_RAW,
+    CAPTURE_PPM,
+    CAPTURE_PNG,
+    CAPTURE_PIPE
+};
+
+inline bool parseCaptureFormat(const char* name, CaptureFormat& format) {
+    if (strcmp(name, "raw") == 0) format = CAPTURE_RAW;
+    else if (strcmp(name, "ppm") == 0) format = CAPTURE_PPM;
+    else if (strcmp(name, "png") == 0) format = CAPTURE_PNG;
+    else if (strcmp(name, "pipe") == 0) format = CAPTURE_PIPE;
+    else return false;
+    return true;
+}
+
+class FrameCapture {
+public:
+    CaptureFormat format;
+    std::string pattern;      // printf pattern for the frame number, no extension
+    std::string pipeCommand;  // CAPTURE_PIPE: receives raw top-down RGBA frames
+    int ringSize;
+    int writerCount;
+    bool dropWhenFull;
+
+    FrameCapture() {
+        format = CAPTURE_PPM;
+        pattern = "frame_%06lld";
+        ringSize = 8;
+        writerCount = 2;
+        dropWhenFull = false;
+        width = 0;
+        height = 0;
+        pipe = nullptr;
+        acquiredSlot = -1;
+        stopping = false;
+        running = false;
+        resetStats();
+    }
+
+    ~FrameCapture() {
+        stop();
+    }
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    bool active() const { return running; }
+    int frameWidth() const { return width; }
+    int frameHeight() const { return height; }
+
+    long long submitted() const { return submittedFrames; }
+    long long written() const { return writtenFrames; }
+    long long dropped() const { return droppedFrames; }
+    long long failed() const { return failedFrames; }
+    long long stalls() const { return stallCount; }
+    double stallMs() const { return stallTimeMs; }
+
+    // Allocates the ring and starts the writers. A pipe keeps frame order,
+    // so it always gets a single writer.
+    bool start(int frameW, int frameH) {
+        stop();
+        if (frameW <= 0 || frameH <= 0 || ringSize < 1) return false;
+        width = frameW;
+        height = frameH;
+
+        if (format == CAPTURE_PIPE) {
+            pipe = openWritePipe(pipeCommand.c_str());
+            if (!pipe) return false;
+        }
+
+        slots.clear();
+        slots.resize(ringSize);
+        for (int i = 0; i < ringSize; i++) {
+            slots[i].pixels.resize((size_t)width * height * 4);
+            freeSlots.push_back(i);
+        }
+        resetStats();
+        stopping = false;
+        running = true;
+
+        int writers = format == CAPTURE_PIPE ? 1 : std::max(1, writerCount);
+        for (int i = 0; i < writers; i++) {
+            writerThreads.emplace_back([this]() { writerLoop(); });
+        }
+        return true;
+    }
+
+    // A buffer for the next frame's bottom-up RGBA readback, or null if the
+    // ring is full and frames are being dropped.
+    unsigned char* acquire() {
+        if (!running) return nullptr;
+        std::unique_lock<std::mutex> lock(mutex);
+        if (freeSlots.empty()) {
+            if (dropWhenFull) {
+                droppedFrames++;
+                return nullptr;
+            }
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            freeCv.wait(lock, [this]() { return !freeSlots.empty(); });
+            stallCount++;
+            stallTimeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        acquiredSlot = freeSlots.front();
+        freeSlots.pop_front();
+        return slots[acquiredSlot].pixels.data();
+    }
+
+    // Queues the buffer from the last acquire() for writing.
+    void submit() {
+        if (acquiredSlot < 0) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[acquiredSlot].frame = submittedFrames++;
+            readySlots.push_back(acquiredSlot);
+            acquiredSlot = -1;
+        }
+        readyCv.notify_one();
+    }
+
+    // Writes out everything still queued, then joins the writers.
+    void stop() {
+        if (!running) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (acquiredSlot >= 0) {
+                freeSlots.push_back(acquiredSlot);
+                acquiredSlot = -1;
+            }
+            stopping = true;
+        }
+        readyCv.notify_all();
+        for (std::thread& t : writerThreads) t.join();
+        writerThreads.clear();
+        if (pipe) {
+            closeWritePipe(pipe);
+            pipe = nullptr;
+        }
+        freeSlots.clear();
+        readySlots.clear();
+        slots.clear();
+        running = false;
+    }
+
+private:
+    struct Slot {
+        AlignedBuffer<unsigned char> pixels;
+        long long frame = 0;
+    };
+
+    int width;
+    int height;
+    std::vector<Slot> slots;
+    std::deque<int> freeSlots;
+    std::deque<int> readySlots;
+    int acquiredSlot;
+    std::vector<std::thread> writerThreads;
+    std::mutex mutex;
+    std::condition_variable freeCv;
+    std::condition_variable readyCv;
+    bool stopping;
+    bool running;
+    FILE* pipe;
+
+    long long submittedFrames;
+    std::atomic<long long> writtenFrames;
+    long long droppedFrames;
+    std::atomic<long long> failedFrames;
+    long long stallCount;
+    double stallTimeMs;
+
+    void resetStats() {
+        submittedFrames = 0;
+        writtenFrames = 0;
+        droppedFrames = 0;
+        failedFrames = 0;
+        stallCount = 0;
+        stallTimeMs = 0;
+    }
+
+    void writerLoop() {
+        // Top-down, alpha forced opaque; PPM only uses the first 3/4 of it.
+        std::vector<unsigned char> scratch((size_t)width * height * 4);
+        for (;;) {
+            int slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                readyCv.wait(lock, [this]() { return stopping || !readySlots.empty(); });
+                if (readySlots.empty()) return;
+                slot = readySlots.front();
+                readySlots.pop_front();
+            }
+
+            bool ok = writeFrame(slots[slot], scratch);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ok) writtenFrames++;
+                else failedFrames++;
+                freeSlots.push_back(slot);
+            }
+            freeCv.notify_one();
+        }
+    }
+
+    bool writeFrame(const Slot& slot, std::vector<unsigned char>& scratch) {
+        const unsigned char* src = slot.pixels.data();
+        size_t rowBytes = (size_t)width * 4;
+        bool rgb = format == CAPTURE_PPM;
+        unsigned char* dst = scratch.data();
+        for (int y = 0; y < height; y++) {
+            const unsigned char* row = src + (size_t)(height - 1 - y) * rowBytes;
+            if (rgb) {
+                for (int x = 0; x < width; x++) {
+                    dst[0] = row[x * 4];
+                    dst[1] = row[x * 4 + 1];
+                    dst[2] = row[x * 4 + 2];
+                    dst += 3;
+                }
+            } else {
+                memcpy(dst, row, rowBytes);
+                for (int x = 0; x < width; x++) dst[x * 4 + 3] = 255;
+                dst += rowBytes;
+            }
+        }
+        size_t bytes = (size_t)(dst - scratch.data());
+
+        if (format == CAPTURE_PIPE) {
+            return fwrite(scratch.data(), 1, bytes, pipe) == bytes;
+        }
+
+        char path[1024];
+        const char* extension = format == CAPTURE_RAW ? ".rgba" : format == CAPTURE_PPM ? ".ppm" : ".png";
+        int length = snprintf(path, sizeof(path), pattern.c_str(), slot.frame);
+        if (length < 0 || length + strlen(extension) >= sizeof(path)) return false;
+        strcat(path, extension);
+
+        if (format == CAPTURE_PNG) {
+            Image image = {scratch.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+            return ExportImage(image, path);
+        }
+
+        FILE* f = fopen(path, "wb");
+        if (!f) return false;
+        bool ok = true;
+        if (format == CAPTURE_PPM) ok = fprintf(f, "P6\n%d %d\n255\n", width, height) > 0;
+        ok = ok && fwrite(scratch.data(), 1, bytes, f) == bytes;
+        return fclose(f) == 0 && ok;
+    }
+};
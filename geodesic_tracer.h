@@ -0,0 +1,365 @@
+#pragma once
+
+#include "simulation.h"
+#include "scene_geometry.h"
+#include <algorithm>
+#include <vector>
+
+// Offline renderer with real gravitational lensing. Each pixel's ray follows
+// a Schwarzschild null geodesic around the black hole (Schwarzschild radius
+// rs = eventHorizonRadius). In Schwarzschild coordinates read as flat space,
+// the photon path obeys
+//     x'' = -3/2 * rs * h^2 * x / |x|^5,    h = |x cross x'|,
+// which is integrated with RK4 in steps proportional to r. Rays that cross
+// the disk plane between accretionDiskInner and accretionDiskOuter pick up
+// disk emission; rays that escape sample the starfield; rays that fall in
+// stay black.
+
+// Equirectangular star map around the black hole. Stars are splatted
+// bilinearly and looked up bilinearly, so each star spans a few texels.
+class SkyMap {
+public:
+    int width;
+    int height;
+    std::vector<Vector3> texels;
+
+    SkyMap() {
+        width = 0;
+        height = 0;
+    }
+
+    void build(const Starfield& starfield, int mapWidth) {
+        width = mapWidth;
+        height = mapWidth / 2;
+        texels.assign((size_t)width * height, {1.0f / 255.0f, 1.0f / 255.0f, 4.0f / 255.0f});
+
+        for (const Star& s : starfield.stars) {
+            float u, v;
+            toTexel(Vector3Normalize(s.pos), u, v);
+            Vector3 c = {
+                s.color.r / 255.0f * s.brightness,
+                s.color.g / 255.0f * s.brightness,
+                s.color.b / 255.0f * s.brightness
+            };
+
+            int x0 = (int)floorf(u);
+            int y0 = (int)floorf(v);
+            float fx = u - x0;
+            float fy = v - y0;
+            splat(x0, y0, Vector3Scale(c, (1 - fx) * (1 - fy)));
+            splat(x0 + 1, y0, Vector3Scale(c, fx * (1 - fy)));
+            splat(x0, y0 + 1, Vector3Scale(c, (1 - fx) * fy));
+            splat(x0 + 1, y0 + 1, Vector3Scale(c, fx * fy));
+        }
+    }
+
+    Vector3 sample(Vector3 dir) const {
+        float u, v;
+        toTexel(dir, u, v);
+        int x0 = (int)floorf(u);
+        int y0 = (int)floorf(v);
+        float fx = u - x0;
+        float fy = v - y0;
+        Vector3 top = Vector3Lerp(texel(x0, y0), texel(x0 + 1, y0), fx);
+        Vector3 bottom = Vector3Lerp(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), fx);
+        return Vector3Lerp(top, bottom, fy);
+    }
+
+private:
+    void toTexel(Vector3 dir, float& u, float& v) const {
+        float y = Clamp(dir.y, -1.0f, 1.0f);
+        u = (atan2f(dir.z, dir.x) / (BH_PI * 2.0f) + 0.5f) * width - 0.5f;
+        v = acosf(y) / BH_PI * height - 0.5f;
+    }
+
+    int wrapX(int x) const {
+        x %= width;
+        return x < 0 ? x + width : x;
+    }
+
+    int clampY(int y) const {
+        return y < 0 ? 0 : (y >= height ? height - 1 : y);
+    }
+
+    Vector3 texel(int x, int y) const {
+        return texels[(size_t)clampY(y) * width + wrapX(x)];
+    }
+
+    void splat(int x, int y, Vector3 c) {
+        Vector3& t = texels[(size_t)clampY(y) * width + wrapX(x)];
+        t = Vector3Add(t, c);
+    }
+};
+
+const int RAY_PACKET_SIZE = 8;
+
+// Eight rays traced in lockstep, stored lane-major so the RK4 step maps
+// straight onto one AVX2 register per component.
+struct RayPacket {
+    float px[RAY_PACKET_SIZE], py[RAY_PACKET_SIZE], pz[RAY_PACKET_SIZE];
+    float vx[RAY_PACKET_SIZE], vy[RAY_PACKET_SIZE], vz[RAY_PACKET_SIZE];
+    float bend[RAY_PACKET_SIZE];
+    float red[RAY_PACKET_SIZE], green[RAY_PACKET_SIZE], blue[RAY_PACKET_SIZE];
+    float transmit[RAY_PACKET_SIZE];
+    int active;
+};
+
+class GeodesicTracer {
+public:
+    BlackHole* blackHole;
+    SkyMap sky;
+    float time;
+    int tileSize;
+    int maxSteps;
+    float stepScale;
+    float minStep;
+    float maxStep;
+    float escapeRadius;
+    SimdLevel simdLevel;
+    DiskColorTable colorTable;
+
+    GeodesicTracer(BlackHole* bh, const Starfield& starfield, int skyWidth = 4096) {
+        blackHole = bh;
+        time = 0;
+        tileSize = 32;
+        maxSteps = 4000;
+        stepScale = 0.04f;
+        minStep = 0.005f;
+        maxStep = 2.0f;
+        escapeRadius = 60.0f;
+        simdLevel = detectSimdLevel();
+        sky.build(starfield, skyWidth);
+    }
+
+    // Renders a width x height image (top row first) with the screen split into
+    // tileSize x tileSize tiles spread across the scheduler. Returns the number
+    // of primary rays traced.
+    long long render(const Camera3D& camera, int width, int height, TaskScheduler& scheduler, Color* pixels) {
+        Vector3 origin = Vector3Subtract(camera.position, blackHole->position);
+        Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+        Vector3 right = Vector3Normalize(Vector3CrossProduct(forward, camera.up));
+        Vector3 up = Vector3CrossProduct(right, forward);
+        float tanHalf = tanf(camera.fovy * 0.5f * BH_PI / 180.0f);
+        float aspect = (float)width / height;
+        colorTable.refresh(blackHole->colorInputs());
+
+        int tilesX = (width + tileSize - 1) / tileSize;
+        int tilesY = (height + tileSize - 1) / tileSize;
+
+        scheduler.parallelFor(0, tilesX * tilesY, 1, [&](int begin, int end) {
+            for (int tile = begin; tile < end; tile++) {
+                int x0 = (tile % tilesX) * tileSize;
+                int y0 = (tile / tilesX) * tileSize;
+                int x1 = std::min(x0 + tileSize, width);
+                int y1 = std::min(y0 + tileSize, height);
+
+                for (int y = y0; y < y1; y++) {
+                    float sy = (1.0f - 2.0f * (y + 0.5f) / height) * tanHalf;
+                    for (int x = x0; x < x1; x += RAY_PACKET_SIZE) {
+                        int lanes = std::min(RAY_PACKET_SIZE, x1 - x);
+                        RayPacket packet;
+                        packet.active = (1 << lanes) - 1;
+
+                        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+                            int px = std::min(x + lane, x1 - 1);
+                            float sx = (2.0f * (px + 0.5f) / width - 1.0f) * tanHalf * aspect;
+                            Vector3 dir = Vector3Normalize(Vector3Add(forward,
+                                Vector3Add(Vector3Scale(right, sx), Vector3Scale(up, sy))));
+                            initRay(packet, lane, origin, dir);
+                        }
+
+                        tracePacket(packet);
+
+                        for (int lane = 0; lane < lanes; lane++) {
+                            pixels[(size_t)y * width + x + lane] = {
+                                toByte(packet.red[lane]),
+                                toByte(packet.green[lane]),
+                                toByte(packet.blue[lane]),
+                                255
+                            };
+                        }
+                    }
+                }
+            }
+        });
+
+        return (long long)width * height;
+    }
+
+    void initRay(RayPacket& p, int lane, Vector3 origin, Vector3 dir) {
+        Vector3 h = Vector3CrossProduct(origin, dir);
+        p.px[lane] = origin.x;
+        p.py[lane] = origin.y;
+        p.pz[lane] = origin.z;
+        p.vx[lane] = dir.x;
+        p.vy[lane] = dir.y;
+        p.vz[lane] = dir.z;
+        p.bend[lane] = -1.5f * blackHole->eventHorizonRadius * Vector3DotProduct(h, h);
+        p.red[lane] = 0;
+        p.green[lane] = 0;
+        p.blue[lane] = 0;
+        p.transmit[lane] = 1.0f;
+    }
+
+    void tracePacket(RayPacket& p) {
+        float rs = blackHole->eventHorizonRadius;
+        float captureR2 = rs * rs * 1.0001f;
+        float escapeR2 = escapeRadius * escapeRadius;
+        float prevX[RAY_PACKET_SIZE], prevY[RAY_PACKET_SIZE], prevZ[RAY_PACKET_SIZE];
+
+        for (int step = 0; step < maxSteps && p.active; step++) {
+            memcpy(prevX, p.px, sizeof(prevX));
+            memcpy(prevY, p.py, sizeof(prevY));
+            memcpy(prevZ, p.pz, sizeof(prevZ));
+
+#if BH_SIMD_X86
+            if (simdLevel == SIMD_AVX2) stepPacketAvx2(p);
+            else stepPacketScalar(p);
+#else
+            stepPacketScalar(p);
+#endif
+
+            // Events are rare compared to steps, so they are checked per lane.
+            for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+                if (!(p.active & (1 << lane))) continue;
+
+                if ((prevY[lane] > 0) != (p.py[lane] > 0)) {
+                    float f = prevY[lane] / (prevY[lane] - p.py[lane]);
+                    float cx = prevX[lane] + f * (p.px[lane] - prevX[lane]);
+                    float cz = prevZ[lane] + f * (p.pz[lane] - prevZ[lane]);
+                    shadeDisk(p, lane, cx, cz);
+                }
+
+                float r2 = p.px[lane] * p.px[lane] + p.py[lane] * p.py[lane] + p.pz[lane] * p.pz[lane];
+                float outward = p.px[lane] * p.vx[lane] + p.py[lane] * p.vy[lane] + p.pz[lane] * p.vz[lane];
+                if (r2 < captureR2 || p.transmit[lane] < 0.005f) {
+                    p.active &= ~(1 << lane);
+                } else if (r2 > escapeR2 && outward > 0) {
+                    Vector3 c = sky.sample(Vector3Normalize({p.vx[lane], p.vy[lane], p.vz[lane]}));
+                    p.red[lane] += p.transmit[lane] * c.x;
+                    p.green[lane] += p.transmit[lane] * c.y;
+                    p.blue[lane] += p.transmit[lane] * c.z;
+                    p.active &= ~(1 << lane);
+                }
+            }
+        }
+    }
+
+    // Thin-disk emission with DiskGlow's streak pattern, colored by the
+    // disk's blackbody table (disk_color.h). Here each ray has its own line
+    // of sight, the cosine between the gas velocity and the ray reversed.
+    void shadeDisk(RayPacket& p, int lane, float cx, float cz) {
+        float inner = blackHole->accretionDiskInner;
+        float outer = blackHole->accretionDiskOuter;
+        float radius = sqrtf(cx * cx + cz * cz);
+        if (radius < inner || radius > outer) return;
+
+        float radiusT = (radius - inner) / (outer - inner);
+        float phi = atan2f(cz, cx);
+        float brightness = sinf(phi * 8.0f - time * 4.0f + radius * 2.0f) * 0.3f + 0.7f;
+
+        float invSpeed = 1.0f / sqrtf(p.vx[lane] * p.vx[lane] + p.vy[lane] * p.vy[lane] + p.vz[lane] * p.vz[lane]);
+        float cosTheta = (sinf(phi) * p.vx[lane] - cosf(phi) * p.vz[lane]) * invSpeed;
+        Color base = colorTable.fetch(radius, cosTheta);
+
+        float alpha = (220.0f / 255.0f) * (1.0f - radiusT * 0.6f);
+        float weight = p.transmit[lane] * alpha * brightness / 255.0f;
+        p.red[lane] += weight * base.r;
+        p.green[lane] += weight * base.g;
+        p.blue[lane] += weight * base.b;
+        p.transmit[lane] *= 1.0f - alpha;
+    }
+
+    void stepPacketScalar(RayPacket& p) {
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+            if (!(p.active & (1 << lane))) continue;
+
+            float x = p.px[lane], y = p.py[lane], z = p.pz[lane];
+            float vx = p.vx[lane], vy = p.vy[lane], vz = p.vz[lane];
+            float k = p.bend[lane];
+            float h = Clamp(stepScale * sqrtf(x * x + y * y + z * z), minStep, maxStep);
+
+            float ax1, ay1, az1, ax2, ay2, az2, ax3, ay3, az3, ax4, ay4, az4;
+            bendAccel(x, y, z, k, ax1, ay1, az1);
+            bendAccel(x + 0.5f * h * vx, y + 0.5f * h * vy, z + 0.5f * h * vz, k, ax2, ay2, az2);
+            float vx2 = vx + 0.5f * h * ax1, vy2 = vy + 0.5f * h * ay1, vz2 = vz + 0.5f * h * az1;
+            bendAccel(x + 0.5f * h * vx2, y + 0.5f * h * vy2, z + 0.5f * h * vz2, k, ax3, ay3, az3);
+            float vx3 = vx + 0.5f * h * ax2, vy3 = vy + 0.5f * h * ay2, vz3 = vz + 0.5f * h * az2;
+            bendAccel(x + h * vx3, y + h * vy3, z + h * vz3, k, ax4, ay4, az4);
+            float vx4 = vx + h * ax3, vy4 = vy + h * ay3, vz4 = vz + h * az3;
+
+            float s = h / 6.0f;
+            p.px[lane] = x + s * (vx + 2.0f * vx2 + 2.0f * vx3 + vx4);
+            p.py[lane] = y + s * (vy + 2.0f * vy2 + 2.0f * vy3 + vy4);
+            p.pz[lane] = z + s * (vz + 2.0f * vz2 + 2.0f * vz3 + vz4);
+            p.vx[lane] = vx + s * (ax1 + 2.0f * ax2 + 2.0f * ax3 + ax4);
+            p.vy[lane] = vy + s * (ay1 + 2.0f * ay2 + 2.0f * ay3 + ay4);
+            p.vz[lane] = vz + s * (az1 + 2.0f * az2 + 2.0f * az3 + az4);
+        }
+    }
+
+    static void bendAccel(float x, float y, float z, float k, float& ax, float& ay, float& az) {
+        float r2 = x * x + y * y + z * z;
+        float s = k / (r2 * r2 * sqrtf(r2));
+        ax = x * s;
+        ay = y * s;
+        az = z * s;
+    }
+
+#if BH_SIMD_X86
+    BH_TARGET_AVX2 static inline void bendAccel8(__m256 x, __m256 y, __m256 z, __m256 k,
+                                                __m256* ax, __m256* ay, __m256* az) {
+        __m256 r2 = _mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_mul_ps(z, z)));
+        __m256 s = _mm256_div_ps(k, _mm256_mul_ps(_mm256_mul_ps(r2, r2), _mm256_sqrt_ps(r2)));
+        *ax = _mm256_mul_ps(x, s);
+        *ay = _mm256_mul_ps(y, s);
+        *az = _mm256_mul_ps(z, s);
+    }
+
+    // Same RK4 step as stepPacketScalar for all eight lanes; finished lanes
+    // keep their old state through the blend.
+    BH_TARGET_AVX2 void stepPacketAvx2(RayPacket& p) {
+        const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256 mask = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+            _mm256_and_si256(_mm256_set1_epi32(p.active), laneBits), _mm256_setzero_si256()));
+
+        __m256 x = _mm256_loadu_ps(p.px), y = _mm256_loadu_ps(p.py), z = _mm256_loadu_ps(p.pz);
+        __m256 vx = _mm256_loadu_ps(p.vx), vy = _mm256_loadu_ps(p.vy), vz = _mm256_loadu_ps(p.vz);
+        __m256 k = _mm256_loadu_ps(p.bend);
+
+        __m256 r = _mm256_sqrt_ps(_mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_mul_ps(z, z))));
+        __m256 h = _mm256_mul_ps(r, _mm256_set1_ps(stepScale));
+        h = _mm256_min_ps(_mm256_max_ps(h, _mm256_set1_ps(minStep)), _mm256_set1_ps(maxStep));
+        __m256 hh = _mm256_mul_ps(h, _mm256_set1_ps(0.5f));
+
+        __m256 ax1, ay1, az1, ax2, ay2, az2, ax3, ay3, az3, ax4, ay4, az4;
+        bendAccel8(x, y, z, k, &ax1, &ay1, &az1);
+        bendAccel8(_mm256_fmadd_ps(hh, vx, x), _mm256_fmadd_ps(hh, vy, y), _mm256_fmadd_ps(hh, vz, z), k, &ax2, &ay2, &az2);
+        __m256 vx2 = _mm256_fmadd_ps(hh, ax1, vx), vy2 = _mm256_fmadd_ps(hh, ay1, vy), vz2 = _mm256_fmadd_ps(hh, az1, vz);
+        bendAccel8(_mm256_fmadd_ps(hh, vx2, x), _mm256_fmadd_ps(hh, vy2, y), _mm256_fmadd_ps(hh, vz2, z), k, &ax3, &ay3, &az3);
+        __m256 vx3 = _mm256_fmadd_ps(hh, ax2, vx), vy3 = _mm256_fmadd_ps(hh, ay2, vy), vz3 = _mm256_fmadd_ps(hh, az2, vz);
+        bendAccel8(_mm256_fmadd_ps(h, vx3, x), _mm256_fmadd_ps(h, vy3, y), _mm256_fmadd_ps(h, vz3, z), k, &ax4, &ay4, &az4);
+        __m256 vx4 = _mm256_fmadd_ps(h, ax3, vx), vy4 = _mm256_fmadd_ps(h, ay3, vy), vz4 = _mm256_fmadd_ps(h, az3, vz);
+
+        const __m256 two = _mm256_set1_ps(2.0f);
+        __m256 s = _mm256_div_ps(h, _mm256_set1_ps(6.0f));
+        __m256 nx = _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_add_ps(vx, vx4), _mm256_mul_ps(two, _mm256_add_ps(vx2, vx3))), x);
+        __m256 ny = _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_add_ps(vy, vy4), _mm256_mul_ps(two, _mm256_add_ps(vy2, vy3))), y);
+        __m256 nz = _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_add_ps(vz, vz4), _mm256_mul_ps(two, _mm256_add_ps(vz2, vz3))), z);
+        __m256 nvx = _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_add_ps(ax1, ax4), _mm256_mul_ps(two, _mm256_add_ps(ax2, ax3))), vx);
+        __m256 nvy = _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_add_ps(ay1, ay4), _mm256_mul_ps(two, _mm256_add_ps(ay2, ay3))), vy);
+        __m256 nvz = _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_add_ps(az1, az4), _mm256_mul_ps(two, _mm256_add_ps(az2, az3))), vz);
+
+        _mm256_storeu_ps(p.px, _mm256_blendv_ps(x, nx, mask));
+        _mm256_storeu_ps(p.py, _mm256_blendv_ps(y, ny, mask));
+        _mm256_storeu_ps(p.pz, _mm256_blendv_ps(z, nz, mask));
+        _mm256_storeu_ps(p.vx, _mm256_blendv_ps(vx, nvx, mask));
+        _mm256_storeu_ps(p.vy, _mm256_blendv_ps(vy, nvy, mask));
+        _mm256_storeu_ps(p.vz, _mm256_blendv_ps(vz, nvz, mask));
+    }
+#endif
+
+    static unsigned char toByte(float v) {
+        return (unsigned char)(Clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+};
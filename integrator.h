@@ -0,0 +1,169 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Shared ODE steppers for everything that follows the hole's gravity.
+//
+// Orbits (pos, vel under an acceleration field) use drift-kick-drift
+// leapfrog: one force evaluation per step, time-reversible, and symplectic
+// at a fixed step, so energy errors oscillate instead of accumulating.
+// integrateLeapfrog splits a frame into substeps of eta times the local
+// free-fall time sqrt(r^3 / M), so steps shrink near the horizon and a far
+// body takes the whole frame in one.
+//
+// First-order curves (dx/ds = f(x), e.g. field lines) use Dormand-Prince
+// 5(4) with embedded error control and first-same-as-last, six evaluations
+// per accepted step. Callers get every accepted step with its endpoint
+// derivatives and can resample it with hermiteInterpolate.
+
+struct LeapfrogControl {
+    float eta = 0.05f;         // substep as a fraction of the free-fall time
+    float minStep = 1e-4f;
+    int maxSubsteps = 64;      // the last substep takes whatever is left
+};
+
+struct Rk45Control {
+    float tolerance = 1e-4f;   // per-step error, absolute plus relative to |y|
+    float initialStep = 0.5f;
+    float minStep = 1e-5f;
+    float maxStep = 1e30f;
+    int maxSteps = 10000;
+};
+
+struct Rk45Result {
+    Vector3 y;
+    float t;
+    int evaluations;
+    int accepted;
+    int rejected;
+};
+
+// One drift-kick-drift step of length h.
+template <typename Accel>
+inline void leapfrogStep(Vector3& pos, Vector3& vel, float h, const Accel& accel) {
+    pos = Vector3Add(pos, Vector3Scale(vel, 0.5f * h));
+    vel = Vector3Add(vel, Vector3Scale(accel(pos), h));
+    pos = Vector3Add(pos, Vector3Scale(vel, 0.5f * h));
+}
+
+inline float freeFallStep(Vector3 pos, Vector3 center, float mass, const LeapfrogControl& control) {
+    float r = Vector3Distance(pos, center);
+    float h = mass > 0 ? control.eta * sqrtf(r * r * r / mass) : 1e30f;
+    return std::max(h, control.minStep);
+}
+
+// Advances (pos, vel) by dt around a point mass at `center`, stopping early
+// once stop(pos) holds after a substep. Returns the force evaluations used.
+template <typename Accel, typename Stop>
+inline int integrateLeapfrog(Vector3& pos, Vector3& vel, float dt, Vector3 center, float mass,
+                             const LeapfrogControl& control, const Accel& accel, const Stop& stop) {
+    float remaining = dt;
+    int steps = 0;
+    while (remaining > 0) {
+        float h = freeFallStep(pos, center, mass, control);
+        if (h >= remaining || steps + 1 >= control.maxSubsteps) h = remaining;
+        leapfrogStep(pos, vel, h, accel);
+        remaining -= h;
+        steps++;
+        if (stop(pos)) break;
+    }
+    return steps;
+}
+
+// Cubic Hermite between two accepted steps, u in [0, 1].
+inline Vector3 hermiteInterpolate(Vector3 y0, Vector3 f0, Vector3 y1, Vector3 f1, float h, float u) {
+    float u2 = u * u, u3 = u2 * u;
+    float h00 = 2 * u3 - 3 * u2 + 1;
+    float h10 = u3 - 2 * u2 + u;
+    float h01 = -2 * u3 + 3 * u2;
+    float h11 = u3 - u2;
+    return Vector3Add(Vector3Add(Vector3Scale(y0, h00), Vector3Scale(f0, h10 * h)),
+                      Vector3Add(Vector3Scale(y1, h01), Vector3Scale(f1, h11 * h)));
+}
+
+// Integrates dy/dt = deriv(y) from t0 to t1. After each accepted step it
+// calls onStep(t0, y0, f0, t1, y1, f1) and stops early if that returns false.
+template <typename Deriv, typename OnStep>
+inline Rk45Result integrateRk45(Vector3 y, float t0, float t1, const Rk45Control& control,
+                                const Deriv& deriv, const OnStep& onStep) {
+    // Dormand & Prince (1980) tableau.
+    const float a21 = 1.0f / 5;
+    const float a31 = 3.0f / 40, a32 = 9.0f / 40;
+    const float a41 = 44.0f / 45, a42 = -56.0f / 15, a43 = 32.0f / 9;
+    const float a51 = 19372.0f / 6561, a52 = -25360.0f / 2187, a53 = 64448.0f / 6561, a54 = -212.0f / 729;
+    const float a61 = 9017.0f / 3168, a62 = -355.0f / 33, a63 = 46732.0f / 5247, a64 = 49.0f / 176,
+                a65 = -5103.0f / 18656;
+    const float b1 = 35.0f / 384, b3 = 500.0f / 1113, b4 = 125.0f / 192, b5 = -2187.0f / 6784, b6 = 11.0f / 84;
+    // Fifth- minus fourth-order weights.
+    const float e1 = 71.0f / 57600, e3 = -71.0f / 16695, e4 = 71.0f / 1920, e5 = -17253.0f / 339200,
+                e6 = 22.0f / 525, e7 = -1.0f / 40;
+
+    Rk45Result result = {y, t0, 0, 0, 0};
+    Vector3 k1 = deriv(y);
+    result.evaluations++;
+    float t = t0;
+    float h = std::min(control.initialStep, t1 - t0);
+    while (t < t1 && result.accepted + result.rejected < control.maxSteps) {
+        h = std::min(std::max(h, control.minStep), t1 - t);
+        Vector3 k2 = deriv(Vector3Add(y, Vector3Scale(k1, h * a21)));
+        Vector3 k3 = deriv(Vector3Add(y, Vector3Add(Vector3Scale(k1, h * a31), Vector3Scale(k2, h * a32))));
+        Vector3 k4 = deriv(Vector3Add(y, Vector3Add(Vector3Add(Vector3Scale(k1, h * a41), Vector3Scale(k2, h * a42)),
+                                                    Vector3Scale(k3, h * a43))));
+        Vector3 k5 = deriv(Vector3Add(y, Vector3Add(Vector3Add(Vector3Scale(k1, h * a51), Vector3Scale(k2, h * a52)),
+                                                    Vector3Add(Vector3Scale(k3, h * a53), Vector3Scale(k4, h * a54)))));
+        Vector3 k6 = deriv(Vector3Add(y, Vector3Add(Vector3Add(Vector3Add(Vector3Scale(k1, h * a61), Vector3Scale(k2, h * a62)),
+                                                               Vector3Add(Vector3Scale(k3, h * a63), Vector3Scale(k4, h * a64))),
+                                                    Vector3Scale(k5, h * a65))));
+        Vector3 next = Vector3Add(y, Vector3Add(Vector3Add(Vector3Scale(k1, h * b1), Vector3Scale(k3, h * b3)),
+                                                Vector3Add(Vector3Add(Vector3Scale(k4, h * b4), Vector3Scale(k5, h * b5)),
+                                                           Vector3Scale(k6, h * b6))));
+        Vector3 k7 = deriv(next);
+        result.evaluations += 6;
+        Vector3 err = Vector3Add(Vector3Add(Vector3Add(Vector3Scale(k1, h * e1), Vector3Scale(k3, h * e3)),
+                                            Vector3Add(Vector3Scale(k4, h * e4), Vector3Scale(k5, h * e5))),
+                                 Vector3Add(Vector3Scale(k6, h * e6), Vector3Scale(k7, h * e7)));
+        float scale = control.tolerance * (1.0f + std::max(Vector3Length(y), Vector3Length(next)));
+        float ratio = Vector3Length(err) / scale;
+        if (ratio <= 1.0f || h <= control.minStep) {
+            float tNext = t + h;
+            result.accepted++;
+            bool more = onStep(t, y, k1, tNext, next, k7);
+            t = tNext;
+            y = next;
+            k1 = k7;
+            result.y = y;
+            result.t = t;
+            if (!more) break;
+        } else {
+            result.rejected++;
+        }
+        float grow = ratio > 0 ? 0.9f * powf(ratio, -0.2f) : 5.0f;
+        h = std::min(h * std::min(std::max(grow, 0.2f), 5.0f), control.maxStep);
+    }
+    return result;
+}
+
+// Integrates dy/ds = deriv(y) over [0, length] and appends y at `samples`
+// evenly spaced s, Hermite-interpolated within the adaptive steps. Stops
+// before the first sample where stop(y) holds. Returns the evaluations used.
+template <typename Deriv, typename Stop>
+inline int sampleRk45(Vector3 y, float length, int samples, const Rk45Control& control, const Deriv& deriv,
+                      const Stop& stop, std::vector<Vector3>& out) {
+    const float spacing = length / samples;
+    int taken = 0;
+    Rk45Result result = integrateRk45(y, 0.0f, length, control, deriv,
+        [&](float t0, Vector3 y0, Vector3 f0, float t1, Vector3 y1, Vector3 f1) {
+            while (taken < samples && taken * spacing <= t1) {
+                Vector3 p = hermiteInterpolate(y0, f0, y1, f1, t1 - t0, (taken * spacing - t0) / (t1 - t0));
+                if (stop(p)) return false;
+                out.push_back(p);
+                taken++;
+            }
+            return !stop(y1);
+        });
+    return result.evaluations;
+}
@@ -0,0 +1,439 @@
+#pragma once
+
+#include "simulation.h"
+#include "platform.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Precomputed Schwarzschild light bending. A photon's orbit in the plane of
+// its motion obeys the Binet equation
+//     u'' + u = 3/2 * rs * u^2,    u = 1/r,  ' = d/dphi,
+// so the azimuth it sweeps coming in from infinity to radius r depends only
+// on the impact parameter b and r. Measured in units of rs the table is
+// scale-free: one file serves every BlackHole, whatever its mass or horizon
+// radius.
+//
+// The table stores, per impact parameter b (rows, quadratic spacing so the
+// photon-sphere region near b = 2.6 rs gets dense rows):
+//     turnU[b]     rs/r at periapsis; 2 if the photon has no turning point
+//     turnSweep[b] azimuth swept down to periapsis, LENSING_CAPTURED if the
+//                  photon falls in
+//     sweep[b][c]  azimuth swept from infinity down to u = rs/r, with
+//                  c = 1 - sqrt(1 - u/uTop) and uTop = min(turnU, 1)
+// The sweep has a square-root cusp at periapsis; in c it is close to linear
+// there, so fetches stay accurate for observers near their turning point.
+
+const uint32_t LENSING_TABLE_VERSION = 1;
+const float LENSING_CAPTURED = 1e30f;
+// b_crit = 3*sqrt(3)/2 rs: photons with smaller impact parameters fall in.
+const float LENSING_CRITICAL_IMPACT = 2.598076f;
+
+struct LensingTableHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerBytes;
+    uint32_t impactCount;
+    uint32_t radiusCount;
+    float impactMax;
+    float maxSweep;
+    uint32_t reserved;
+};
+
+class LensingTable {
+public:
+    int impactCount;
+    int radiusCount;
+    float impactMax;
+    float maxSweep;
+
+    LensingTable() {
+        impactCount = 0;
+        radiusCount = 0;
+        impactMax = 0;
+        maxSweep = 0;
+        turnU = nullptr;
+        turnSweep = nullptr;
+        sweep = nullptr;
+    }
+
+    LensingTable(const LensingTable&) = delete;
+    LensingTable& operator=(const LensingTable&) = delete;
+
+    bool valid() const { return sweep != nullptr; }
+
+    // Integrates one orbit per row, rows spread over the scheduler. Orbits
+    // still circling the photon sphere after maxSweep radians count as
+    // captured.
+    void generate(TaskScheduler& scheduler, int impacts = 1024, int radii = 1024,
+                  float maxImpact = 64.0f, float sweepLimit = 6.0f * BH_PI) {
+        mapped.close();
+        impactCount = impacts;
+        radiusCount = radii;
+        impactMax = maxImpact;
+        maxSweep = sweepLimit;
+        owned.assign((size_t)impacts * (radii + 2), 0.0f);
+        bindArrays(owned.data());
+
+        scheduler.parallelFor(0, impacts, 4, [this](int begin, int end) {
+            for (int i = begin; i < end; i++) integrateRow(i);
+        });
+    }
+
+    bool save(const char* path) const {
+        if (!valid()) return false;
+        FILE* f = fopen(path, "wb");
+        if (!f) return false;
+        LensingTableHeader header;
+        makeHeader(header);
+        size_t floats = (size_t)impactCount * (radiusCount + 2);
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        ok = ok && fwrite(turnU, sizeof(float), floats, f) == floats;
+        return fclose(f) == 0 && ok;
+    }
+
+    // Maps the file read-only; the arrays point straight into the mapping.
+    // Fails on a missing, truncated or other-version file.
+    bool load(const char* path) {
+        if (!mapped.open(path)) return false;
+        if (mapped.size() < sizeof(LensingTableHeader)) {
+            mapped.close();
+            return false;
+        }
+        LensingTableHeader header;
+        memcpy(&header, mapped.data(), sizeof(header));
+        size_t floats = (size_t)header.impactCount * (header.radiusCount + 2);
+        if (memcmp(header.magic, "BHLT", 4) != 0 || header.version != LENSING_TABLE_VERSION ||
+            header.headerBytes != sizeof(LensingTableHeader) || header.impactCount < 2 ||
+            header.radiusCount < 2 || mapped.size() != sizeof(header) + floats * sizeof(float)) {
+            mapped.close();
+            return false;
+        }
+        owned.clear();
+        owned.shrink_to_fit();
+        impactCount = (int)header.impactCount;
+        radiusCount = (int)header.radiusCount;
+        impactMax = header.impactMax;
+        maxSweep = header.maxSweep;
+        bindArrays((const float*)((const char*)mapped.data() + sizeof(header)));
+        return true;
+    }
+
+    // Azimuth swept from infinity to u = rs/r on the inbound leg, b in rs.
+    float sweepTo(float b, float u) const {
+        float row;
+        int i = rowIndex(b, row);
+        float top = sweepInRow(i, u);
+        float bottom = sweepInRow(i + 1, u);
+        return top + (bottom - top) * row;
+    }
+
+    // Azimuth swept to periapsis, LENSING_CAPTURED if the photon falls in.
+    float sweepToTurn(float b) const {
+        float row;
+        int i = rowIndex(b, row);
+        float a = turnSweep[i];
+        float c = turnSweep[i + 1];
+        if (a >= LENSING_CAPTURED || c >= LENSING_CAPTURED) return LENSING_CAPTURED;
+        return a + (c - a) * row;
+    }
+
+    // A ray leaving an observer at radius rObserver (in rs) at angle alpha
+    // from the outward radial direction: the azimuth of its direction once
+    // it reaches infinity, in the plane of the observer and the ray. Returns
+    // false if the ray falls into the hole. Speeds follow the tracer's flat
+    // reading: unit speed at the observer and v^2 = 1 - h^2/r^3 at infinity,
+    // so b = h / v.
+    bool escapeAzimuth(float rObserver, float alpha, float& azimuth) const {
+        float sinAlpha = sinf(alpha);
+        float b = rObserver * sinAlpha / sqrtf(1.0f - sinAlpha * sinAlpha / rObserver);
+        float u = 1.0f / rObserver;
+        float toObserver = sweepTo(b, u);
+        if (alpha <= 0.5f * BH_PI) {
+            azimuth = toObserver;
+            return true;
+        }
+        float toTurn = sweepToTurn(b);
+        if (toTurn >= LENSING_CAPTURED) return false;
+        azimuth = 2.0f * toTurn - toObserver;
+        return true;
+    }
+
+    const float* turnU;
+    const float* turnSweep;
+    const float* sweep;
+
+private:
+    std::vector<float> owned;
+    MappedFile mapped;
+
+    void bindArrays(const float* base) {
+        turnU = base;
+        turnSweep = base + impactCount;
+        sweep = base + 2 * (size_t)impactCount;
+    }
+
+    void makeHeader(LensingTableHeader& header) const {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "BHLT", 4);
+        header.version = LENSING_TABLE_VERSION;
+        header.headerBytes = sizeof(LensingTableHeader);
+        header.impactCount = (uint32_t)impactCount;
+        header.radiusCount = (uint32_t)radiusCount;
+        header.impactMax = impactMax;
+        header.maxSweep = maxSweep;
+    }
+
+    float impactAt(int i) const {
+        float t = (float)i / (impactCount - 1);
+        return impactMax * t * t;
+    }
+
+    int rowIndex(float b, float& frac) const {
+        float t = b > 0 ? sqrtf(b / impactMax) : 0.0f;
+        return clampIndex(t * (impactCount - 1), impactCount, frac);
+    }
+
+    static int clampIndex(float x, int count, float& frac) {
+        if (x <= 0) {
+            frac = 0;
+            return 0;
+        }
+        if (x >= count - 1) {
+            frac = 1;
+            return count - 2;
+        }
+        int i = (int)x;
+        frac = x - i;
+        return i;
+    }
+
+    static float topU(float turn) {
+        return turn < 1.0f ? turn : 1.0f;
+    }
+
+    static float columnU(float c, float uTop) {
+        float s = 1.0f - c;
+        return uTop * (1.0f - s * s);
+    }
+
+    float sweepInRow(int i, float u) const {
+        float uTop = topU(turnU[i]);
+        float x = u < uTop ? 1.0f - sqrtf(1.0f - u / uTop) : 1.0f;
+        float frac;
+        int j = clampIndex(x * (radiusCount - 1), radiusCount, frac);
+        const float* row = sweep + (size_t)i * radiusCount;
+        return row[j] + (row[j + 1] - row[j]) * frac;
+    }
+
+    // Periapsis: the root of 1/b^2 - u^2 + u^3 below the photon sphere
+    // (u = 2/3), which exists only above the critical impact parameter.
+    static double turningPoint(double b) {
+        if (b <= LENSING_CRITICAL_IMPACT) return 2.0;
+        double k = 1.0 / (b * b);
+        double lo = 0, hi = 2.0 / 3.0;
+        if (k - hi * hi + hi * hi * hi >= 0) return 2.0;
+        for (int it = 0; it < 60; it++) {
+            double mid = 0.5 * (lo + hi);
+            if (k - mid * mid + mid * mid * mid > 0) lo = mid;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // RK4 on (u, du/dphi) from u = 0, du/dphi = 1/b, in double precision,
+    // recording the azimuth at which u crosses each column. Steps are
+    // limited both in phi and in u so no column is skipped.
+    void integrateRow(int i) {
+        float* row = const_cast<float*>(sweep) + (size_t)i * radiusCount;
+        float* turnURow = const_cast<float*>(turnU);
+        float* turnSweepRow = const_cast<float*>(turnSweep);
+        double b = impactAt(i);
+        double turn = turningPoint(b);
+        turnURow[i] = (float)turn;
+        turnSweepRow[i] = LENSING_CAPTURED;
+
+        if (b <= 0) {
+            // Radial ray: no sweep at all, straight into the hole.
+            for (int j = 0; j < radiusCount; j++) row[j] = 0;
+            return;
+        }
+
+        float uTop = topU((float)turn);
+        double duMin = uTop * (1.0 - (1.0 - 1.0 / (radiusCount - 1)) * (1.0 - 1.0 / (radiusCount - 1)));
+        double u = 0, w = 1.0 / b, phi = 0;
+        int next = 1;
+        row[0] = 0;
+        bool turned = false;
+
+        while (phi < maxSweep) {
+            double h = 0.01;
+            if (w > 0) h = std::min(h, 0.25 * duMin / w);
+
+            double k1u = w, k1w = 1.5 * u * u - u;
+            double u2 = u + 0.5 * h * k1u, w2 = w + 0.5 * h * k1w;
+            double k2u = w2, k2w = 1.5 * u2 * u2 - u2;
+            double u3 = u + 0.5 * h * k2u, w3 = w + 0.5 * h * k2w;
+            double k3u = w3, k3w = 1.5 * u3 * u3 - u3;
+            double u4 = u + h * k3u, w4 = w + h * k3w;
+            double k4u = w4, k4w = 1.5 * u4 * u4 - u4;
+            double nu = u + h / 6.0 * (k1u + 2 * k2u + 2 * k3u + k4u);
+            double nw = w + h / 6.0 * (k1w + 2 * k2w + 2 * k3w + k4w);
+
+            if (nw <= 0) {
+                // Periapsis: du/dphi passes through zero.
+                double t = w / (w - nw);
+                turnSweepRow[i] = (float)(phi + t * h);
+                turned = true;
+                break;
+            }
+
+            // Columns crossed this step, interpolated linearly in u.
+            while (next < radiusCount - 1 && columnU((float)next / (radiusCount - 1), uTop) <= nu) {
+                double t = (columnU((float)next / (radiusCount - 1), uTop) - u) / (nu - u);
+                row[next++] = (float)(phi + t * h);
+            }
+
+            u = nu;
+            w = nw;
+            phi += h;
+            if (u >= 1.0) break;
+        }
+
+        // Columns between the last crossing and the top: the sweep is close
+        // to linear in c there, so fill towards the end value.
+        float end = turned ? turnSweepRow[i] : (float)phi;
+        float c0 = (float)(next - 1) / (radiusCount - 1);
+        float v0 = row[next - 1];
+        for (int j = next; j < radiusCount; j++) {
+            float c = (float)j / (radiusCount - 1);
+            row[j] = v0 + (end - v0) * (c - c0) / (1.0f - c0);
+        }
+    }
+};
+
+// Per-frame inverse of the table for one observer: for a source direction at
+// azimuth phi from the observer's outward radial, the angle alpha at which
+// its primary image appears. Built once per frame from a few thousand table
+// fetches; each star then costs one interpolated lookup.
+class LensedSky {
+public:
+    std::vector<float> apparentAlpha;
+    Vector3 observer;
+    Vector3 center;
+    Vector3 outward;
+    float captureAlpha;
+
+    LensedSky() {
+        observer = {0, 0, 0};
+        center = {0, 0, 0};
+        outward = {0, 0, 1};
+        captureAlpha = BH_PI;
+    }
+
+    void prepare(const LensingTable& table, const BlackHole& blackHole, Vector3 observerPos,
+                 int sourceSamples = 1024, int alphaSamples = 4096) {
+        BH_PROFILE_SCOPE("LensedSky::prepare");
+        observer = observerPos;
+        center = blackHole.position;
+        Vector3 offset = Vector3Subtract(observer, center);
+        float distance = Vector3Length(offset);
+        float rs = blackHole.eventHorizonRadius;
+        outward = distance > 0 ? Vector3Scale(offset, 1.0f / distance) : Vector3{0, 0, 1};
+        float rObserver = std::max(distance / rs, 1.6f);
+
+        // Edge of the shadow: the largest alpha whose ray still escapes.
+        float lo = 0.5f * BH_PI, hi = BH_PI, azimuth;
+        for (int k = 0; k < 24; k++) {
+            float mid = 0.5f * (lo + hi);
+            if (table.escapeAzimuth(rObserver, mid, azimuth)) lo = mid;
+            else hi = mid;
+        }
+        captureAlpha = lo;
+
+        // The escape azimuth rises monotonically with alpha and diverges at
+        // the shadow edge, so samples are packed towards captureAlpha.
+        apparentAlpha.assign(sourceSamples, captureAlpha);
+        float prevAlpha = 0, prevAzimuth = 0;
+        int j = 0;
+        for (int k = 1; k < alphaSamples && j < sourceSamples; k++) {
+            float t = (float)k / (alphaSamples - 1);
+            float s = 1.0f - t;
+            float alpha = captureAlpha * (1.0f - s * s * s);
+            if (!table.escapeAzimuth(rObserver, alpha, azimuth)) break;
+            while (j < sourceSamples) {
+                float target = BH_PI * j / (sourceSamples - 1);
+                if (target > azimuth) break;
+                float span = azimuth - prevAzimuth;
+                float f = span > 0 ? (target - prevAzimuth) / span : 0.0f;
+                apparentAlpha[j++] = prevAlpha + (alpha - prevAlpha) * f;
+            }
+            prevAlpha = alpha;
+            prevAzimuth = azimuth;
+        }
+    }
+
+    // Image angle from the outward radial for a source at azimuth phi.
+    float apparentAlphaAt(float phi) const {
+        float frac;
+        float x = phi / BH_PI * (apparentAlpha.size() - 1);
+        int i = (int)x;
+        if (i >= (int)apparentAlpha.size() - 1) {
+            i = (int)apparentAlpha.size() - 2;
+            frac = 1;
+        } else {
+            frac = x - i;
+        }
+        return apparentAlpha[i] + (apparentAlpha[i + 1] - apparentAlpha[i]) * frac;
+    }
+
+    // Cone of sight lines from the observer that holds the images of every
+    // source inside the sphere (sourceCenter, sourceRadius). Lensing keeps
+    // each source's azimuth around the outward axis and maps phi to alpha
+    // monotonically, so the images span the mapped phi range plus the
+    // azimuth spread at its widest. Returns false when no useful cone exists.
+    bool imageCone(Vector3 sourceCenter, float sourceRadius, Vector3* axis, float* halfAngle) const {
+        Vector3 toSource = Vector3Subtract(sourceCenter, center);
+        float distance = Vector3Length(toSource);
+        if (distance <= sourceRadius) return false;
+        Vector3 dir = Vector3Scale(toSource, 1.0f / distance);
+        float spread = asinf(sourceRadius / distance);
+        float phi = acosf(Clamp(Vector3DotProduct(dir, outward), -1.0f, 1.0f));
+        if (phi <= spread || phi >= BH_PI - spread) return false;
+
+        float alphaLo = apparentAlphaAt(phi - spread);
+        float alphaHi = apparentAlphaAt(phi + spread);
+        float azimuthSpread = asinf(std::min(1.0f, sinf(spread) / sinf(phi)));
+        float widest = (alphaLo <= 0.5f * BH_PI && alphaHi >= 0.5f * BH_PI) ? 1.0f
+                     : std::max(sinf(alphaLo), sinf(alphaHi));
+        float alpha = 0.5f * (alphaLo + alphaHi);
+        Vector3 tangent = Vector3Normalize(Vector3Subtract(dir, Vector3Scale(outward, cosf(phi))));
+        *axis = Vector3Add(Vector3Scale(outward, cosf(alpha)), Vector3Scale(tangent, sinf(alpha)));
+        *halfAngle = 0.5f * (alphaHi - alphaLo) + azimuthSpread * widest;
+        return true;
+    }
+
+    // Where a source at sourcePos appears: the same distance from the
+    // observer, along the bent ray's initial direction.
+    Vector3 apparentPosition(Vector3 sourcePos) const {
+        Vector3 toSource = Vector3Subtract(sourcePos, center);
+        float sourceDistance = Vector3Length(toSource);
+        if (sourceDistance <= 0) return sourcePos;
+        Vector3 dir = Vector3Scale(toSource, 1.0f / sourceDistance);
+
+        float c = Clamp(Vector3DotProduct(dir, outward), -1.0f, 1.0f);
+        Vector3 tangent = Vector3Subtract(dir, Vector3Scale(outward, c));
+        float tangentLength = Vector3Length(tangent);
+        if (tangentLength < 1e-6f) {
+            tangent = fabsf(outward.y) < 0.9f ? Vector3CrossProduct(outward, {0, 1, 0})
+                                              : Vector3CrossProduct(outward, {1, 0, 0});
+            tangentLength = Vector3Length(tangent);
+        }
+        tangent = Vector3Scale(tangent, 1.0f / tangentLength);
+
+        float alpha = apparentAlphaAt(acosf(c));
+        Vector3 seen = Vector3Add(Vector3Scale(outward, cosf(alpha)), Vector3Scale(tangent, sinf(alpha)));
+        float viewDistance = Vector3Distance(sourcePos, observer);
+        return Vector3Add(observer, Vector3Scale(seen, viewDistance));
+    }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+#include <algorithm>
+#include <cmath>
+
+// Screen-space level of detail. Each subsystem keeps a table of prebuilt
+// levels, 0 the finest, and picks the coarsest one whose on-screen error
+// stays under LOD_MAX_PIXEL_ERROR at the object's projected size. Switching
+// to a finer level happens at once; switching to a coarser one waits until
+// it would still be good enough at LOD_HYSTERESIS times the size, so a
+// camera hovering at a boundary does not flip back and forth. Line geometry
+// cross-fades between the outgoing and incoming level over fadeSeconds.
+
+const float LOD_MAX_PIXEL_ERROR = 0.75f;
+const float LOD_HYSTERESIS = 1.25f;
+// Sets of concentric lines (glow rings, ring layers) are respread over the
+// same band when thinned, as long as the gaps stay under this many pixels.
+const float LOD_MAX_LINE_SPACING = 12.0f;
+
+// Pixels per world unit at the distance of `center`.
+inline float pixelsPerUnit(const Camera3D& camera, Vector3 center, float screenHeight) {
+    float distance = std::max(Vector3Distance(camera.position, center), 0.01f);
+    return screenHeight * 0.5f / (distance * tanf(camera.fovy * DEG2RAD * 0.5f));
+}
+
+// Deviation in pixels of a polygon with `segments` sides from a circle of
+// `radiusPx` pixels (the sagitta of one side).
+inline float circleErrorPixels(float radiusPx, int segments) {
+    return radiusPx * (1.0f - cosf(3.14159265359f / segments));
+}
+
+class LodSelector {
+public:
+    int level;          // 0 = finest
+    int previous;       // level fading out, -1 when none
+    float fade;         // 0..1 weight of `level` while fading
+    float fadeSeconds;
+
+    LodSelector() {
+        level = 0;
+        previous = -1;
+        fade = 1.0f;
+        fadeSeconds = 0.3f;
+    }
+
+    // `coarsest` is the coarsest acceptable level at the current size and
+    // `coarsestLoose` the same at LOD_HYSTERESIS times the size.
+    void update(int coarsest, int coarsestLoose, float dt) {
+        int target = level;
+        if (coarsest < level) target = coarsest;
+        else if (coarsestLoose > level) target = coarsestLoose;
+
+        if (target != level) {
+            previous = level;
+            level = target;
+            fade = 0;
+        }
+        if (previous >= 0) {
+            fade += fadeSeconds > 0 ? dt / fadeSeconds : 1.0f;
+            if (fade >= 1.0f) {
+                fade = 1.0f;
+                previous = -1;
+            }
+        }
+    }
+};
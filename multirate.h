@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Multirate stepping by orbital timescale. Particles are split into tiles
+// of MULTIRATE_TILE, and each tile is kept sorted by level: level L holds
+// particles whose orbit is 2^L to 2^(L+1) times slower than the fastest
+// one, and is stepped every 2^L frames with the time gathered since its last
+// step. To keep every frame's work the same, a level is cut into 2^L phases
+// and one phase steps per frame. A (level, phase) pair is a slot; its lag is
+// how long ago it last stepped, which drawing uses to carry particles
+// forward along their orbit.
+//
+// A particle's level follows from its orbit speed, which a respawn keeps,
+// so tiles are only re-sorted when the inner edge moves or particles are
+// reactivated, with their slots caught up to the present first.
+
+const int MULTIRATE_LEVELS = 4;                            // every 1, 2, 4 and 8 frames
+const int MULTIRATE_SLOTS = (1 << MULTIRATE_LEVELS) - 1;
+const int MULTIRATE_TILE_SHIFT = 14;
+const int MULTIRATE_TILE = 1 << MULTIRATE_TILE_SHIFT;
+
+inline int multirateSlot(int level, int phase) {
+    return (1 << level) - 1 + phase;
+}
+
+// The level of an orbit at angular speed `speed`, given the fastest one.
+inline int multirateLevel(float speed, float fastest) {
+    int level = 0;
+    while (level + 1 < MULTIRATE_LEVELS && speed * (float)(2 << level) <= fastest) level++;
+    return level;
+}
+
+struct MultirateRange {
+    int begin;
+    int end;
+};
+
+class MultirateSchedule {
+public:
+    int count;
+    int tileCount;
+    uint32_t frame;
+    std::vector<int> levelStart;    // per tile, MULTIRATE_LEVELS + 1 particle indices
+    std::vector<float> lag;         // per tile and slot, seconds since stepped
+    std::vector<float> drawLag;     // what draw() reads; published between steps
+
+    MultirateSchedule() {
+        count = 0;
+        tileCount = 0;
+        frame = 0;
+    }
+
+    // Every particle starts in level 0 with no lag.
+    void reset(int particles) {
+        count = particles;
+        tileCount = (particles + MULTIRATE_TILE - 1) >> MULTIRATE_TILE_SHIFT;
+        frame = 0;
+        levelStart.assign((size_t)tileCount * (MULTIRATE_LEVELS + 1), 0);
+        for (int t = 0; t < tileCount; t++) {
+            int* start = &levelStart[(size_t)t * (MULTIRATE_LEVELS + 1)];
+            start[0] = t * MULTIRATE_TILE;
+            for (int l = 1; l <= MULTIRATE_LEVELS; l++) start[l] = std::min(count, (t + 1) * MULTIRATE_TILE);
+        }
+        lag.assign((size_t)tileCount * MULTIRATE_SLOTS, 0.0f);
+        drawLag = lag;
+    }
+
+    MultirateRange tileRange(int tile) const {
+        return {tile * MULTIRATE_TILE, std::min(count, (tile + 1) * MULTIRATE_TILE)};
+    }
+
+    MultirateRange slotRange(int tile, int level, int phase) const {
+        const int* start = &levelStart[(size_t)tile * (MULTIRATE_LEVELS + 1)];
+        int n = start[level + 1] - start[level];
+        return {start[level] + ((n * phase) >> level), start[level] + ((n * (phase + 1)) >> level)};
+    }
+
+    bool due(int level, int phase) const {
+        return (int)(frame & ((1u << level) - 1)) == phase;
+    }
+
+    float* tileLag(int tile) {
+        return &lag[(size_t)tile * MULTIRATE_SLOTS];
+    }
+
+    float lagOf(int i, const uint8_t* slot) const {
+        return drawLag[(size_t)(i >> MULTIRATE_TILE_SHIFT) * MULTIRATE_SLOTS + slot[i]];
+    }
+
+    void publish() {
+        drawLag = lag;
+    }
+};
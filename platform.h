@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+
+// OS services that need system headers. Those headers clash with raylib.h
+// (Rectangle, CloseWindow, DrawText...) on Windows, so they live in their own
+// translation unit, platform.cpp.
+
+// Peak resident set size of this process in bytes, or 0 if unavailable.
+size_t peakResidentBytes();
+
+// Binary write pipe to a shell command's stdin (popen/_popen), or null.
+FILE* openWritePipe(const char* command);
+// Closes the pipe and waits for the command; returns its exit status.
+int closeWritePipe(FILE* pipe);
+
+// Memory mapping of a whole file. The mapping lives as long as the object;
+// data() is null when nothing is mapped. A copy-on-write mapping can also be
+// written through writableData(): touched pages become private copies and
+// the file itself never changes.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char* path, bool copyOnWrite = false);
+    void close();
+
+    const void* data() const { return ptr; }
+    void* writableData() const { return writable ? ptr : nullptr; }
+    size_t size() const { return length; }
+
+private:
+    void* ptr;
+    size_t length;
+    bool writable;
+    void* fileHandle;
+    void* mappingHandle;
+};
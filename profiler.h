@@ -0,0 +1,209 @@
+#pragma once
+
+// Scoped hot-path timers. BH_PROFILE_SCOPE("Name") times the rest of the
+// enclosing block; per frame the totals of every zone go into a rolling
+// window for the p50/p95/p99 overlay, and while a trace is running each
+// scope is also logged as a Chrome trace event (chrome://tracing, Perfetto).
+// BH_PROFILE_END_FRAME() closes a frame. Build with -DBH_PROFILE=0 and the
+// macros expand to nothing.
+
+#ifndef BH_PROFILE
+#define BH_PROFILE 1
+#endif
+
+#if BH_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+const int PROFILE_MAX_ZONES = 64;
+const int PROFILE_HISTORY = 240;
+
+struct ProfileStats {
+    float mean;
+    float p50;
+    float p95;
+    float p99;
+};
+
+class Profiler {
+public:
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static long long nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Registered once per call site; the same name always maps to one zone.
+    int zoneId(const char* name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int count = zoneTotal.load(std::memory_order_relaxed);
+        for (int i = 0; i < count; i++) {
+            if (strcmp(zones[i].name, name) == 0) return i;
+        }
+        if (count == PROFILE_MAX_ZONES) return PROFILE_MAX_ZONES - 1;
+        zones[count].name = name;
+        zoneTotal.store(count + 1, std::memory_order_release);
+        return count;
+    }
+
+    void record(int zone, long long startNs, long long endNs) {
+        zones[zone].frameNs.fetch_add(endNs - startNs, std::memory_order_relaxed);
+        if (!tracing.load(std::memory_order_relaxed)) return;
+
+        TraceBuffer* buffer = threadBuffer();
+        if (eventCount.fetch_add(1, std::memory_order_relaxed) >= eventLimit) {
+            droppedEvents.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        buffer->events.push_back({zone, startNs, endNs - startNs});
+    }
+
+    // Closes the frame: every zone's total becomes one history sample.
+    void endFrame() {
+        int count = zoneTotal.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            long long ns = zones[i].frameNs.exchange(0, std::memory_order_relaxed);
+            zones[i].history[historyHead] = (float)(ns * 1e-6);
+        }
+        historyHead = (historyHead + 1) % PROFILE_HISTORY;
+        if (historyCount < PROFILE_HISTORY) historyCount++;
+    }
+
+    int zoneCount() const { return zoneTotal.load(std::memory_order_acquire); }
+    const char* zoneName(int zone) const { return zones[zone].name; }
+
+    // Milliseconds per frame over the last PROFILE_HISTORY frames.
+    ProfileStats stats(int zone) const {
+        ProfileStats s = {0, 0, 0, 0};
+        if (historyCount == 0) return s;
+        float sorted[PROFILE_HISTORY];
+        double sum = 0;
+        for (int i = 0; i < historyCount; i++) {
+            sorted[i] = zones[zone].history[i];
+            sum += sorted[i];
+        }
+        std::sort(sorted, sorted + historyCount);
+        s.mean = (float)(sum / historyCount);
+        s.p50 = sorted[(int)(0.50f * (historyCount - 1) + 0.5f)];
+        s.p95 = sorted[(int)(0.95f * (historyCount - 1) + 0.5f)];
+        s.p99 = sorted[(int)(0.99f * (historyCount - 1) + 0.5f)];
+        return s;
+    }
+
+    void startTrace(long long maxEvents = 4000000) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::unique_ptr<TraceBuffer>& b : buffers) b->events.clear();
+        eventLimit = maxEvents;
+        eventCount.store(0, std::memory_order_relaxed);
+        droppedEvents.store(0, std::memory_order_relaxed);
+        traceStartNs = nowNs();
+        tracing.store(true, std::memory_order_release);
+    }
+
+    bool isTracing() const { return tracing.load(std::memory_order_relaxed); }
+    long long traceDropped() const { return droppedEvents.load(std::memory_order_relaxed); }
+
+    // Stops tracing and writes the trace-event JSON. Call only while no
+    // scopes are running on other threads.
+    bool writeTrace(const char* path) {
+        tracing.store(false, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(mutex);
+        FILE* f = fopen(path, "w");
+        if (!f) return false;
+        fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        bool first = true;
+        for (const std::unique_ptr<TraceBuffer>& b : buffers) {
+            fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"name\": \"thread %d\"}}", first ? "" : ",\n", b->tid, b->tid);
+            first = false;
+            for (const TraceEvent& e : b->events) {
+                fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    zones[e.zone].name, b->tid, (e.startNs - traceStartNs) * 1e-3, e.durationNs * 1e-3);
+            }
+        }
+        fprintf(f, "\n]}\n");
+        return fclose(f) == 0;
+    }
+
+private:
+    struct Zone {
+        const char* name = "";
+        std::atomic<long long> frameNs{0};
+        float history[PROFILE_HISTORY] = {};
+    };
+
+    struct TraceEvent {
+        int zone;
+        long long startNs;
+        long long durationNs;
+    };
+
+    // Owned by the profiler so events survive worker threads that exit
+    // when the scheduler is resized.
+    struct TraceBuffer {
+        int tid;
+        std::vector<TraceEvent> events;
+    };
+
+    Zone zones[PROFILE_MAX_ZONES];
+    std::atomic<int> zoneTotal{0};
+    int historyHead = 0;
+    int historyCount = 0;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::atomic<bool> tracing{false};
+    std::atomic<long long> eventCount{0};
+    std::atomic<long long> droppedEvents{0};
+    long long eventLimit = 0;
+    long long traceStartNs = 0;
+
+    TraceBuffer* threadBuffer() {
+        thread_local TraceBuffer* buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.emplace_back(new TraceBuffer());
+            buffer = buffers.back().get();
+            buffer->tid = (int)buffers.size() - 1;
+        }
+        return buffer;
+    }
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(int zoneId) : zone(zoneId), start(Profiler::nowNs()) {}
+    ~ProfileScope() { Profiler::instance().record(zone, start, Profiler::nowNs()); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    int zone;
+    long long start;
+};
+
+#define BH_PROFILE_JOIN2(a, b) a##b
+#define BH_PROFILE_JOIN(a, b) BH_PROFILE_JOIN2(a, b)
+#define BH_PROFILE_SCOPE(name) \
+    static const int BH_PROFILE_JOIN(bhProfileZone, __LINE__) = Profiler::instance().zoneId(name); \
+    ProfileScope BH_PROFILE_JOIN(bhProfileScope, __LINE__)(BH_PROFILE_JOIN(bhProfileZone, __LINE__))
+#define BH_PROFILE_END_FRAME() Profiler::instance().endFrame()
+
+#else
+
+#define BH_PROFILE_SCOPE(name) ((void)0)
+#define BH_PROFILE_END_FRAME() ((void)0)
+
+#endif
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+
+// Holds a frame-time budget by trading detail for speed. Every frame's time
+// goes into an exponential average; the governor steps one quality level
+// down when the average stays over budget, and one level up when it stays
+// well under. Hysteresis keeps it from oscillating:
+//   - a dead band between upThreshold and downThreshold where nothing moves,
+//   - a settle period after each change so the average can catch up,
+//   - a back-off: an upgrade that is undone right away doubles the wait
+//     before the next upgrade attempt, and every stableFrames an upgrade
+//     holds halves it again.
+
+struct QualityLevel {
+    float diskFraction;   // active accretion disk particles
+    float starFraction;   // drawn stars
+    float glowFraction;   // DiskGlow segments and rings
+    float ringFraction;   // EinsteinRing segments
+    int ringLayers;
+    float gridFraction;   // SpacetimeGrid cells per side
+};
+
+const int QUALITY_LEVEL_COUNT = 6;
+const QualityLevel QUALITY_LEVELS[QUALITY_LEVEL_COUNT] = {
+    {0.20f, 0.35f, 0.40f, 0.35f, 2, 0.40f},
+    {0.35f, 0.50f, 0.50f, 0.50f, 3, 0.50f},
+    {0.50f, 0.65f, 0.65f, 0.60f, 3, 0.65f},
+    {0.65f, 0.80f, 0.75f, 0.75f, 4, 0.75f},
+    {0.80f, 0.90f, 0.90f, 0.90f, 5, 0.90f},
+    {1.00f, 1.00f, 1.00f, 1.00f, 5, 1.00f}
+};
+
+class QualityGovernor {
+public:
+    float targetMs;
+    float downThreshold;   // x target: sustained average above this lowers quality
+    float upThreshold;     // x target: sustained average below this raises it
+    float smoothing;       // weight of each new frame in the average
+    int downFrames;        // frames over budget before lowering
+    int upFrames;          // frames under budget before raising
+    int settleFrames;      // frames ignored after a change
+    int maxUpFrames;       // back-off cap
+    int stableFrames;      // frames an upgrade holds for each halving of the back-off
+
+    int level;
+    float averageMs;
+    long long changes;
+    char lastDecision[96];
+
+    QualityGovernor() {
+        targetMs = 16.6f;
+        downThreshold = 1.08f;
+        upThreshold = 0.75f;
+        smoothing = 0.1f;
+        downFrames = 15;
+        upFrames = 120;
+        settleFrames = 30;
+        maxUpFrames = 1920;
+        stableFrames = 600;
+        reset(QUALITY_LEVEL_COUNT - 1);
+    }
+
+    void reset(int startLevel) {
+        level = std::max(0, std::min(startLevel, QUALITY_LEVEL_COUNT - 1));
+        averageMs = 0;
+        changes = 0;
+        overCount = 0;
+        underCount = 0;
+        settleLeft = settleFrames;
+        upWait = upFrames;
+        framesSinceUp = -1;
+        stableLeft = stableFrames;
+        snprintf(lastDecision, sizeof(lastDecision), "start at level %d", level);
+    }
+
+    const QualityLevel& settings() const { return QUALITY_LEVELS[level]; }
+
+    // Feeds one frame; returns true when the level changed, with the reason
+    // in lastDecision.
+    bool update(float frameMs) {
+        averageMs = averageMs == 0 ? frameMs : averageMs + (frameMs - averageMs) * smoothing;
+        if (framesSinceUp >= 0) framesSinceUp++;
+        if (framesSinceUp >= 0 && --stableLeft <= 0) {
+            upWait = std::max(upWait / 2, upFrames);
+            stableLeft = stableFrames;
+        }
+        if (settleLeft > 0) {
+            settleLeft--;
+            return false;
+        }
+
+        overCount = averageMs > targetMs * downThreshold ? overCount + 1 : 0;
+        underCount = averageMs < targetMs * upThreshold ? underCount + 1 : 0;
+
+        if (overCount >= downFrames && level > 0) {
+            // Undoing an upgrade that has not settled means that level does
+            // not fit: wait twice as long before trying it again.
+            bool backOff = framesSinceUp >= 0 && framesSinceUp < upWait;
+            if (backOff) upWait = std::min(upWait * 2, maxUpFrames);
+            return change(level - 1, backOff ? "over budget, backing off" : "over budget");
+        }
+        if (underCount >= upWait && level < QUALITY_LEVEL_COUNT - 1) {
+            bool changed = change(level + 1, "under budget");
+            framesSinceUp = 0;
+            return changed;
+        }
+        return false;
+    }
+
+private:
+    int overCount;
+    int underCount;
+    int settleLeft;
+    int upWait;
+    int framesSinceUp;
+    int stableLeft;
+
+    bool change(int next, const char* reason) {
+        snprintf(lastDecision, sizeof(lastDecision), "%d -> %d: %s at %.1f ms", level, next, reason, averageMs);
+        level = next;
+        changes++;
+        overCount = 0;
+        underCount = 0;
+        settleLeft = settleFrames;
+        framesSinceUp = -1;
+        stableLeft = stableFrames;
+        return true;
+    }
+};
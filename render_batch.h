@@ -0,0 +1,68 @@
+#pragma once
+
+#include "raylib.h"
+#include "simd.h"
+
+struct BatchRange {
+    int first;
+    int count;
+};
+
+// CPU-side line list: one contiguous position array and one color array,
+// laid out exactly as the GPU vertex buffers expect. Filling it touches no
+// graphics state, so vertex building can be timed without a window.
+// Subsystems append in draw order and close their span with endRange() so
+// the spans can be drawn interleaved with immediate-mode geometry.
+class VertexBatch {
+public:
+    AlignedBuffer<Vector3> positions;
+    AlignedBuffer<Color> colors;
+    int vertexCount;
+    int rangeStart;
+
+    VertexBatch() : vertexCount(0), rangeStart(0) {}
+
+    void clear() {
+        vertexCount = 0;
+        rangeStart = 0;
+    }
+
+    BatchRange endRange() {
+        BatchRange range = {rangeStart, vertexCount - rangeStart};
+        rangeStart = vertexCount;
+        return range;
+    }
+
+    // Makes room for `count` more vertices and returns the index of the first.
+    int reserve(int count) {
+        int needed = vertexCount + count;
+        if (needed > (int)positions.size()) {
+            int grown = (int)positions.size() * 2;
+            if (grown < needed) grown = needed;
+            positions.resize(grown);
+            colors.resize(grown);
+        }
+        int first = vertexCount;
+        vertexCount = needed;
+        return first;
+    }
+
+    // Gives back the last `count` reserved vertices, for callers that reserve
+    // an upper bound and fill less.
+    void release(int count) {
+        vertexCount -= count;
+    }
+
+    void addLine(Vector3 a, Vector3 b, Color c) {
+        int i = reserve(2);
+        positions[i] = a;
+        positions[i + 1] = b;
+        colors[i] = c;
+        colors[i + 1] = c;
+    }
+
+    // Same footprint as raylib's DrawPoint3D, which is a 0.1 unit line along +z.
+    void addPoint(Vector3 p, Color c) {
+        addLine(p, {p.x, p.y, p.z + 0.1f}, c);
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "simd.h"
+#include <cstdint>
+
+// Stateless counter-based random numbers (Philox4x32-10, Salmon et al. 2011).
+// Each call hashes (index, generation, stream, block) under the scene seed, so
+// a particle's numbers depend only on who it is and how many times it has
+// respawned -- never on thread count, chunking or update order.
+
+const uint64_t DEFAULT_SCENE_SEED = 1;
+
+enum RngStream {
+    RNG_STREAM_DISK = 1,
+    RNG_STREAM_INFALL,
+    RNG_STREAM_JET_TOP,
+    RNG_STREAM_JET_BOTTOM,
+    RNG_STREAM_RING_SPARKS,
+    RNG_STREAM_STARS,
+    RNG_STREAM_PHOTONS
+};
+
+struct RandomBlock {
+    uint32_t bits[4];
+
+    // Uniform in [0, 1) from the top 24 bits of one word.
+    float uniform(int lane) const {
+        return (float)(bits[lane] >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+class CounterRng {
+public:
+    uint32_t key[2];
+    uint32_t stream;
+
+    CounterRng() : CounterRng(DEFAULT_SCENE_SEED, 0) {}
+
+    CounterRng(uint64_t seed, uint32_t streamId) {
+        key[0] = (uint32_t)seed;
+        key[1] = (uint32_t)(seed >> 32);
+        stream = streamId;
+    }
+
+    RandomBlock block(uint32_t index, uint32_t generation, uint32_t blockIndex = 0) const {
+        RandomBlock out;
+        philox(index, generation, stream, blockIndex, out.bits);
+        return out;
+    }
+
+    float uniform(uint32_t index, uint32_t generation, uint32_t blockIndex, int lane) const {
+        return block(index, generation, blockIndex).uniform(lane);
+    }
+
+    // Batch form for SoA initialisation: out0..out3[i] receive the four
+    // uniforms of block(firstIndex + i, generation, blockIndex), eight
+    // particles per iteration on AVX2.
+    void fillUniform4(uint32_t firstIndex, int count, uint32_t generation, uint32_t blockIndex,
+                      float* out0, float* out1, float* out2, float* out3) const {
+        int done = 0;
+#if BH_SIMD_X86
+        if (detectSimdLevel() == SIMD_AVX2) {
+            done = fillUniform4Avx2(firstIndex, count, generation, blockIndex, out0, out1, out2, out3);
+        }
+#endif
+        for (int i = done; i < count; i++) {
+            RandomBlock b = block(firstIndex + (uint32_t)i, generation, blockIndex);
+            out0[i] = b.uniform(0);
+            out1[i] = b.uniform(1);
+            out2[i] = b.uniform(2);
+            out3[i] = b.uniform(3);
+        }
+    }
+
+    static const uint32_t PHILOX_M0 = 0xD2511F53u;
+    static const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+    static const uint32_t PHILOX_W0 = 0x9E3779B9u;
+    static const uint32_t PHILOX_W1 = 0xBB67AE85u;
+
+    static void philox10(const uint32_t counter[4], const uint32_t seedKey[2], uint32_t out[4]) {
+        uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        uint32_t k0 = seedKey[0], k1 = seedKey[1];
+        for (int round = 0; round < 10; round++) {
+            uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+            uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+            uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+            uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+            c0 = n0;
+            c1 = (uint32_t)p1;
+            c2 = n2;
+            c3 = (uint32_t)p0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+
+private:
+    void philox(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t out[4]) const {
+        uint32_t counter[4] = {c0, c1, c2, c3};
+        philox10(counter, key, out);
+    }
+
+#if BH_SIMD_X86
+    BH_TARGET_AVX2 static inline void mulhilo8(__m256i a, __m256i m, __m256i* hi, __m256i* lo) {
+        __m256i even = _mm256_mul_epu32(a, m);
+        __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+        *lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+        *hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+    }
+
+    BH_TARGET_AVX2 static inline __m256 toUniform8(__m256i bits) {
+        return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+    }
+
+    BH_TARGET_AVX2 int fillUniform4Avx2(uint32_t firstIndex, int count, uint32_t generation, uint32_t blockIndex,
+                                       float* out0, float* out1, float* out2, float* out3) const {
+        const __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0);
+        const __m256i m1 = _mm256_set1_epi32((int)PHILOX_M1);
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((int)(firstIndex + (uint32_t)i)), lanes);
+            __m256i c1 = _mm256_set1_epi32((int)generation);
+            __m256i c2 = _mm256_set1_epi32((int)stream);
+            __m256i c3 = _mm256_set1_epi32((int)blockIndex);
+            uint32_t k0 = key[0], k1 = key[1];
+
+            for (int round = 0; round < 10; round++) {
+                __m256i hi0, lo0, hi1, lo1;
+                mulhilo8(c0, m0, &hi0, &lo0);
+                mulhilo8(c2, m1, &hi1, &lo1);
+                c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32((int)k0));
+                c1 = lo1;
+                c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32((int)k1));
+                c3 = lo0;
+                k0 += PHILOX_W0;
+                k1 += PHILOX_W1;
+            }
+
+            _mm256_storeu_ps(out0 + i, toUniform8(c0));
+            _mm256_storeu_ps(out1 + i, toUniform8(c1));
+            _mm256_storeu_ps(out2 + i, toUniform8(c2));
+            _mm256_storeu_ps(out3 + i, toUniform8(c3));
+        }
+        return i;
+    }
+#endif
+};
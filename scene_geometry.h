@@ -0,0 +1,518 @@
+#pragma once
+
+#include "simulation.h"
+#include "lensing_table.h"
+#include "lod.h"
+#include "derived_cache.h"
+#include <cstring>
+
+// Decorative geometry that is rebuilt every frame straight into a VertexBatch.
+
+struct Star {
+    Vector3 pos;
+    float brightness;
+    float twinkleSpeed;
+    float twinkleOffset;
+    Color color;
+};
+
+// What the warped grid is built from.
+struct GridInputs {
+    int gridSize;
+    float gridSpacing;
+    float warpStrength;
+    float horizon;
+    
+    bool operator==(const GridInputs& o) const {
+        return gridSize == o.gridSize && gridSpacing == o.gridSpacing && warpStrength == o.warpStrength &&
+               horizon == o.horizon;
+    }
+};
+
+// Warped segment endpoints and per-segment base colors.
+struct GridMesh {
+    AlignedBuffer<Vector3> positions;
+    AlignedBuffer<float> red;
+    AlignedBuffer<float> green;
+    AlignedBuffer<float> blue;
+    AlignedBuffer<unsigned char> alpha;
+    int segmentCount = 0;
+};
+
+class SpacetimeGrid {
+public:
+    BlackHole* blackHole;
+    int gridSize;
+    float gridSpacing;
+    float warpStrength;
+    TaskScheduler* scheduler;   // rebuilds in the background when set
+    
+    // Rebuilt only when the grid parameters or the horizon radius change.
+    // Per frame only the pulse scale is applied.
+    DerivedCache<GridInputs, GridMesh> cache;
+    
+    SpacetimeGrid(BlackHole* bh) {
+        blackHole = bh;
+        gridSize = 30;
+        gridSpacing = 2.0f;
+        warpStrength = 8.0f;
+        scheduler = nullptr;
+    }
+    
+    GridInputs inputs() const {
+        return {gridSize, gridSpacing, warpStrength, blackHole->eventHorizonRadius};
+    }
+    
+    static float getWarp(const GridInputs& in, float x, float z) {
+        float dist = sqrtf(x * x + z * z);
+        if (dist < in.horizon) return -100.0f;
+        return -in.warpStrength / (dist * 0.5f);
+    }
+    
+    static void rebuild(const GridInputs& in, GridMesh& mesh) {
+        BH_PROFILE_SCOPE("SpacetimeGrid::rebuild");
+        int maxSegments = 2 * (in.gridSize + 1) * in.gridSize;
+        mesh.positions.resize(maxSegments * 2);
+        mesh.red.resize(maxSegments);
+        mesh.green.resize(maxSegments);
+        mesh.blue.resize(maxSegments);
+        mesh.alpha.resize(maxSegments);
+        mesh.segmentCount = 0;
+        
+        float offset = in.gridSize * in.gridSpacing * 0.5f;
+        for (int i = 0; i <= in.gridSize; i++) {
+            for (int j = 0; j < in.gridSize; j++) {
+                float x1 = i * in.gridSpacing - offset;
+                float z1 = j * in.gridSpacing - offset;
+                float z2 = (j + 1) * in.gridSpacing - offset;
+                addSegment(mesh, {x1, getWarp(in, x1, z1), z1}, {x1, getWarp(in, x1, z2), z2});
+            }
+        }
+        for (int j = 0; j <= in.gridSize; j++) {
+            for (int i = 0; i < in.gridSize; i++) {
+                float x1 = i * in.gridSpacing - offset;
+                float x2 = (i + 1) * in.gridSpacing - offset;
+                float z1 = j * in.gridSpacing - offset;
+                addSegment(mesh, {x1, getWarp(in, x1, z1), z1}, {x2, getWarp(in, x2, z1), z1});
+            }
+        }
+    }
+    
+    void draw(VertexBatch& batch, float time) {
+        BH_PROFILE_SCOPE("SpacetimeGrid::draw");
+        cache.refresh(inputs(), scheduler, rebuild);
+        const GridMesh& mesh = cache.value;
+        float pulse = sinf(time * 0.5f) * 0.2f + 1.0f;
+        
+        int first = batch.reserve(mesh.segmentCount * 2);
+        memcpy(batch.positions.data() + first, mesh.positions.data(), sizeof(Vector3) * mesh.segmentCount * 2);
+        Color* colors = batch.colors.data() + first;
+        for (int s = 0; s < mesh.segmentCount; s++) {
+            Color c = {
+                (unsigned char)(mesh.red[s] * pulse),
+                (unsigned char)(mesh.green[s] * pulse),
+                (unsigned char)(mesh.blue[s] * pulse),
+                mesh.alpha[s]
+            };
+            colors[s * 2] = c;
+            colors[s * 2 + 1] = c;
+        }
+    }
+    
+private:
+    // Segments touching the horizon are skipped; color fades with the
+    // distance of the first endpoint.
+    static void addSegment(GridMesh& mesh, Vector3 a, Vector3 b) {
+        if (a.y < -50 || b.y < -50) return;
+        float dist = sqrtf(a.x * a.x + a.z * a.z);
+        float intensity = 1.0f / (1.0f + dist * 0.1f);
+        int s = mesh.segmentCount;
+        mesh.positions[s * 2] = a;
+        mesh.positions[s * 2 + 1] = b;
+        mesh.red[s] = 50 * intensity;
+        mesh.green[s] = 100 * intensity;
+        mesh.blue[s] = 255 * intensity;
+        mesh.alpha[s] = (unsigned char)(100 * intensity);
+        mesh.segmentCount++;
+    }
+};
+
+class EinsteinRing {
+public:
+    BlackHole* blackHole;
+    int segments;    // at the finest level
+    int layers;
+    CounterRng rng;
+    uint32_t sparkFrame;
+    LodSelector lod;
+    
+    // Fraction of segments and layer count per level. The flicker runs five
+    // waves around the ring, so segments never drop below 24.
+    static const int LOD_LEVELS = 5;
+    static constexpr float LOD_SEGMENTS[LOD_LEVELS] = {1.0f, 0.75f, 0.5f, 0.35f, 0.25f};
+    static constexpr int LOD_LAYERS[LOD_LEVELS] = {5, 5, 4, 3, 2};
+    
+    EinsteinRing(BlackHole* bh) {
+        blackHole = bh;
+        segments = 128;
+        layers = 5;
+        rng = CounterRng(bh->seed, RNG_STREAM_RING_SPARKS);
+        sparkFrame = 0;
+    }
+    
+    int lodSegments(int level) const { return std::max(24, (int)(segments * LOD_SEGMENTS[level])); }
+    int lodLayers(int level) const { return std::max(1, std::min(layers, LOD_LAYERS[level])); }
+    
+    int coarsestLevel(float unitPixels) const {
+        float outer = blackHole->eventHorizonRadius * (2.6f + (layers - 1) * 0.15f) + 0.1f;
+        float bandPx = (layers - 1) * blackHole->eventHorizonRadius * 0.15f * unitPixels;
+        for (int level = LOD_LEVELS - 1; level > 0; level--) {
+            int levelLayers = lodLayers(level);
+            float gapPx = levelLayers > 1 ? bandPx / (levelLayers - 1) : bandPx;
+            if (circleErrorPixels(outer * unitPixels, lodSegments(level)) <= LOD_MAX_PIXEL_ERROR &&
+                gapPx <= LOD_MAX_LINE_SPACING) return level;
+        }
+        return 0;
+    }
+    
+    void updateLod(const Camera3D& camera, float screenHeight, float dt) {
+        float unitPixels = pixelsPerUnit(camera, blackHole->position, screenHeight);
+        lod.update(coarsestLevel(unitPixels), coarsestLevel(unitPixels * LOD_HYSTERESIS), dt);
+    }
+    
+    void draw(VertexBatch& batch, float time, Camera3D camera) {
+        BH_PROFILE_SCOPE("EinsteinRing::draw");
+        Vector3 toCamera = Vector3Normalize(Vector3Subtract(camera.position, blackHole->position));
+        Vector3 up = {0, 1, 0};
+        Vector3 right = Vector3Normalize(Vector3CrossProduct(up, toCamera));
+        Vector3 ringUp = Vector3Normalize(Vector3CrossProduct(toCamera, right));
+        
+        if (lod.previous >= 0) drawLevel(batch, time, right, ringUp, lod.previous, 1.0f - lod.fade);
+        drawLevel(batch, time, right, ringUp, lod.level, lod.fade);
+        drawSparks(batch, time, right, ringUp);
+    }
+    
+    void drawLevel(VertexBatch& batch, float time, Vector3 right, Vector3 ringUp, int level, float weight) {
+        int levelSegments = lodSegments(level);
+        int levelLayers = lodLayers(level);
+        // Fewer layers still cover the full band.
+        float spacing = levelLayers == layers || levelLayers == 1 ? 0.15f : 0.15f * (layers - 1) / (levelLayers - 1);
+        for (int layer = 0; layer < levelLayers; layer++) {
+            float radius = blackHole->eventHorizonRadius * (2.6f + layer * spacing);
+            float layerT = (float)layer / levelLayers;
+            
+            for (int i = 0; i < levelSegments; i++) {
+                float angle1 = (float)i / levelSegments * BH_PI * 2.0f;
+                float angle2 = (float)(i + 1) / levelSegments * BH_PI * 2.0f;
+                
+                float flicker = sinf(time * 20.0f + angle1 * 5.0f + layer * 2.0f) * 0.3f + 0.7f;
+                float wave = sinf(angle1 * 3.0f - time * 4.0f) * 0.1f;
+                float r = radius + wave;
+                
+                Vector3 p1 = Vector3Add(blackHole->position, 
+                    Vector3Add(Vector3Scale(right, cosf(angle1) * r), Vector3Scale(ringUp, sinf(angle1) * r)));
+                Vector3 p2 = Vector3Add(blackHole->position, 
+                    Vector3Add(Vector3Scale(right, cosf(angle2) * r), Vector3Scale(ringUp, sinf(angle2) * r)));
+                
+                float brightness = flicker * (1.0f - layerT * 0.5f);
+                Color c;
+                
+                if (layer == 0) {
+                    c = {
+                        (unsigned char)(255 * brightness),
+                        (unsigned char)(220 * brightness),
+                        (unsigned char)(180 * brightness),
+                        (unsigned char)(255 * brightness * weight)
+                    };
+                } else {
+                    c = {
+                        (unsigned char)(255 * brightness * 0.8f),
+                        (unsigned char)(200 * brightness * 0.6f),
+                        (unsigned char)(100 * brightness * 0.4f),
+                        (unsigned char)(200 * (1.0f - layerT) * brightness * weight)
+                    };
+                }
+                
+                batch.addLine(p1, p2, c);
+            }
+        }
+    }
+    
+    void drawSparks(VertexBatch& batch, float time, Vector3 right, Vector3 ringUp) {
+        sparkFrame++;
+        for (int i = 0; i < 50; i++) {
+            RandomBlock spark = rng.block(i, sparkFrame);
+            float angle = spark.uniform(0) * BH_PI * 2.0f;
+            float r = blackHole->eventHorizonRadius * (2.5f + spark.uniform(1) * 0.8f);
+            float flicker = sinf(time * 30.0f + i * 0.5f);
+            
+            if (flicker > 0.7f) {
+                Vector3 sparkPos = Vector3Add(blackHole->position,
+                    Vector3Add(Vector3Scale(right, cosf(angle) * r), Vector3Scale(ringUp, sinf(angle) * r)));
+                batch.addPoint(sparkPos, WHITE);
+            }
+        }
+    }
+};
+
+// What the glow's rings are laid out from.
+struct GlowInputs {
+    float inner;
+    float outer;
+    int rings;
+    
+    bool operator==(const GlowInputs& o) const {
+        return inner == o.inner && outer == o.outer && rings == o.rings;
+    }
+};
+
+struct GlowRing {
+    float radius;
+    float radiusT;   // 0 at the inner edge, 1 at the outer
+};
+
+class DiskGlow {
+public:
+    BlackHole* blackHole;
+    int segments;    // at the finest level
+    int rings;
+    LodSelector lod;
+    DerivedCache<GlowInputs, std::vector<std::vector<GlowRing>>> levelRings;
+    DiskColorTable colorTable;
+    
+    // Fractions of segments and rings per level. The brightness pattern runs
+    // eight waves around each ring, so segments never drop below 32.
+    static const int LOD_LEVELS = 5;
+    static constexpr float LOD_SEGMENTS[LOD_LEVELS] = {1.0f, 0.75f, 0.55f, 0.4f, 0.3f};
+    static constexpr float LOD_RINGS[LOD_LEVELS] = {1.0f, 1.0f, 0.75f, 0.5f, 0.35f};
+    
+    DiskGlow(BlackHole* bh) {
+        blackHole = bh;
+        segments = 80;
+        rings = 25;
+        colorTable.refresh(bh->colorInputs());
+    }
+    
+    int lodSegments(int level) const { return std::max(32, (int)(segments * LOD_SEGMENTS[level])); }
+    int lodRings(int level) const { return ringsAt(rings, level); }
+    static int ringsAt(int rings, int level) { return std::max(4, (int)(rings * LOD_RINGS[level])); }
+    
+    int coarsestLevel(float unitPixels) const {
+        float outerPx = blackHole->accretionDiskOuter * unitPixels;
+        float spanPx = (blackHole->accretionDiskOuter - blackHole->accretionDiskInner) * unitPixels;
+        for (int level = LOD_LEVELS - 1; level > 0; level--) {
+            if (circleErrorPixels(outerPx, lodSegments(level)) <= LOD_MAX_PIXEL_ERROR &&
+                spanPx / lodRings(level) <= LOD_MAX_LINE_SPACING) return level;
+        }
+        return 0;
+    }
+    
+    void updateLod(const Camera3D& camera, float screenHeight, float dt) {
+        float unitPixels = pixelsPerUnit(camera, blackHole->position, screenHeight);
+        lod.update(coarsestLevel(unitPixels), coarsestLevel(unitPixels * LOD_HYSTERESIS), dt);
+    }
+    
+    // Radius of every ring at every level; a handful of rings, so rebuilt
+    // inline when the disk edges or ring count change.
+    static void buildRings(const GlowInputs& in, std::vector<std::vector<GlowRing>>& levels) {
+        levels.assign(LOD_LEVELS, std::vector<GlowRing>());
+        for (int level = 0; level < LOD_LEVELS; level++) {
+            int levelRings = ringsAt(in.rings, level);
+            for (int r = 0; r < levelRings; r++) {
+                float radiusT = (float)r / levelRings;
+                levels[level].push_back({in.inner + radiusT * (in.outer - in.inner), radiusT});
+            }
+        }
+    }
+    
+    void draw(VertexBatch& batch, float time, const Camera3D& camera) {
+        BH_PROFILE_SCOPE("DiskGlow::draw");
+        levelRings.refresh({blackHole->accretionDiskInner, blackHole->accretionDiskOuter, rings}, nullptr, buildRings);
+        colorTable.refresh(blackHole->colorInputs());
+        colorTable.setViewer(camera.position, blackHole->position);
+        if (lod.previous >= 0) drawLevel(batch, time, lod.previous, 1.0f - lod.fade);
+        drawLevel(batch, time, lod.level, lod.fade);
+    }
+    
+    void drawLevel(VertexBatch& batch, float time, int level, float weight) {
+        int levelSegments = lodSegments(level);
+        for (const GlowRing& ring : levelRings.value[level]) {
+            float radiusT = ring.radiusT;
+            float radius = ring.radius;
+            
+            for (int s = 0; s < levelSegments; s++) {
+                float angle1 = (float)s / levelSegments * BH_PI * 2.0f + time * blackHole->rotationSpeed;
+                float angle2 = (float)(s + 1) / levelSegments * BH_PI * 2.0f + time * blackHole->rotationSpeed;
+                
+                float height1 = sinf(angle1 * 2.0f + radius) * 0.12f * (1.0f - radiusT);
+                float height2 = sinf(angle2 * 2.0f + radius) * 0.12f * (1.0f - radiusT);
+                
+                Vector3 p1 = {cosf(angle1) * radius, height1, sinf(angle1) * radius};
+                Vector3 p2 = {cosf(angle2) * radius, height2, sinf(angle2) * radius};
+                
+                float brightness = (sinf(angle1 * 8.0f - time * 4.0f + radius * 2.0f) * 0.3f + 0.7f);
+                
+                Color c = colorTable.shade(p1.x, p1.z, radius);
+                c.r = (unsigned char)(c.r * brightness);
+                c.g = (unsigned char)(c.g * brightness);
+                c.b = (unsigned char)(c.b * brightness);
+                c.a = (unsigned char)(220 * (1.0f - radiusT * 0.6f) * weight);
+                
+                batch.addLine(p1, p2, c);
+            }
+        }
+    }
+};
+
+// Stars are binned once into sky tiles, SKY_TILE_ROWS even-area bands of
+// z times SKY_TILE_COLUMNS longitudes, for culling. Each tile lists its
+// stars in ascending index order so the activeCount prefix is a cut.
+const int SKY_TILE_ROWS = 8;
+const int SKY_TILE_COLUMNS = 16;
+
+struct SkyTile {
+    int first;           // into Starfield::tileStars
+    int count;
+    BoundingSphere bound;
+};
+
+class Starfield {
+public:
+    std::vector<Star> stars;
+    int starCount;
+    int activeCount;     // stars are in random order, so any prefix is an even thinning
+    CounterRng rng;
+    std::vector<SkyTile> tiles;
+    std::vector<int> tileStars;
+    
+    Starfield(int count, uint64_t seed = DEFAULT_SCENE_SEED) {
+        starCount = count;
+        activeCount = count;
+        rng = CounterRng(seed, RNG_STREAM_STARS);
+        generateStars();
+        buildTiles();
+    }
+    
+    void generateStars() {
+        stars.reserve(starCount);
+        for (int i = 0; i < starCount; i++) {
+            Star s;
+            RandomBlock r0 = rng.block(i, 0, 0);
+            RandomBlock r1 = rng.block(i, 0, 1);
+            float theta = r0.uniform(0) * BH_PI * 2.0f;
+            float phi = acosf(2.0f * r0.uniform(1) - 1.0f);
+            float radius = 80.0f + r0.uniform(2) * 40.0f;
+            
+            s.pos.x = radius * sinf(phi) * cosf(theta);
+            s.pos.y = radius * sinf(phi) * sinf(theta);
+            s.pos.z = radius * cosf(phi);
+            
+            s.brightness = 0.3f + r0.uniform(3) * 0.7f;
+            s.twinkleSpeed = 1.0f + r1.uniform(0) * 4.0f;
+            s.twinkleOffset = r1.uniform(1) * BH_PI * 2.0f;
+            
+            float colorRand = r1.uniform(2);
+            if (colorRand > 0.9f) {
+                s.color = {255, 200, 150, 255};
+            } else if (colorRand > 0.8f) {
+                s.color = {150, 180, 255, 255};
+            } else {
+                s.color = {255, 255, 255, 255};
+            }
+            
+            stars.push_back(s);
+        }
+    }
+    
+    void buildTiles() {
+        const int tileCount = SKY_TILE_ROWS * SKY_TILE_COLUMNS;
+        std::vector<int> tileOf(stars.size());
+        std::vector<int> counts(tileCount + 1, 0);
+        for (size_t i = 0; i < stars.size(); i++) {
+            Vector3 p = stars[i].pos;
+            float length = Vector3Length(p);
+            float z = length > 0 ? p.z / length : 0.0f;
+            float longitude = atan2f(p.y, p.x) + BH_PI;
+            int row = std::min((int)((z + 1.0f) * 0.5f * SKY_TILE_ROWS), SKY_TILE_ROWS - 1);
+            int column = std::min((int)(longitude / (BH_PI * 2.0f) * SKY_TILE_COLUMNS), SKY_TILE_COLUMNS - 1);
+            tileOf[i] = row * SKY_TILE_COLUMNS + column;
+            counts[tileOf[i] + 1]++;
+        }
+        
+        tiles.assign(tileCount, SkyTile{0, 0, {{0, 0, 0}, 0}});
+        for (int t = 0; t < tileCount; t++) {
+            counts[t + 1] += counts[t];
+            tiles[t].first = counts[t];
+        }
+        tileStars.resize(stars.size());
+        for (size_t i = 0; i < stars.size(); i++) {
+            SkyTile& tile = tiles[tileOf[i]];
+            tileStars[tile.first + tile.count++] = (int)i;
+        }
+        
+        for (SkyTile& tile : tiles) {
+            if (tile.count == 0) continue;
+            Vector3 sum = {0, 0, 0};
+            for (int k = 0; k < tile.count; k++) sum = Vector3Add(sum, stars[tileStars[tile.first + k]].pos);
+            tile.bound.center = Vector3Scale(sum, 1.0f / tile.count);
+            for (int k = 0; k < tile.count; k++) {
+                float d = Vector3Distance(tile.bound.center, stars[tileStars[tile.first + k]].pos);
+                tile.bound.radius = std::max(tile.bound.radius, d);
+            }
+            tile.bound.radius += CULL_POINT_LENGTH;
+        }
+    }
+    
+    void drawStar(VertexBatch& batch, const Star& s, float time, const LensedSky* lensedSky) {
+        float twinkle = 0.7f + 0.3f * sinf(time * s.twinkleSpeed + s.twinkleOffset);
+        float b = s.brightness * twinkle;
+        
+        Color c = {
+            (unsigned char)(s.color.r * b),
+            (unsigned char)(s.color.g * b),
+            (unsigned char)(s.color.b * b),
+            255
+        };
+        
+        batch.addPoint(lensedSky ? lensedSky->apparentPosition(s.pos) : s.pos, c);
+    }
+    
+    // With a prepared LensedSky each star moves to its primary lensed image.
+    // With a culler, tiles are tested first: lensed tiles by the cone their
+    // images fall in, unlensed ones by their bound, also against the horizon.
+    // Lensed images never fall inside the horizon's silhouette.
+    void draw(VertexBatch& batch, float time, const LensedSky* lensedSky = nullptr, ViewCuller* culler = nullptr) {
+        BH_PROFILE_SCOPE("Starfield::draw");
+        int count = std::min(activeCount, (int)stars.size());
+        if (!culler) {
+            for (int i = 0; i < count; i++) drawStar(batch, stars[i], time, lensedSky);
+            return;
+        }
+        
+        long long drawn = 0, skipped = 0;
+        int tilesCulled = 0;
+        for (const SkyTile& tile : tiles) {
+            const int* first = tileStars.data() + tile.first;
+            int active = (int)(std::lower_bound(first, first + tile.count, count) - first);
+            if (active == 0) continue;
+            
+            bool seen;
+            if (lensedSky) {
+                Vector3 axis;
+                float halfAngle;
+                seen = !lensedSky->imageCone(tile.bound.center, tile.bound.radius, &axis, &halfAngle) ||
+                       culler->coneInFrustum(axis, halfAngle);
+            } else {
+                seen = culler->sphereVisible(tile.bound);
+            }
+            if (!seen) {
+                skipped += active;
+                tilesCulled++;
+                continue;
+            }
+            for (int k = 0; k < active; k++) drawStar(batch, stars[first[k]], time, lensedSky);
+            drawn += active;
+        }
+        culler->count(CULL_STARS, drawn, skipped, (int)tiles.size(), tilesCulled);
+    }
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BH_SIMD_X86 1
+#include <immintrin.h>
+#define BH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+// Without FMA the compiler cannot fuse a multiply and an add, so a kernel
+// can reproduce its scalar fallback bit for bit.
+#define BH_TARGET_AVX2_NOFMA __attribute__((target("avx2")))
+#else
+#define BH_SIMD_X86 0
+#define BH_TARGET_AVX2
+#define BH_TARGET_AVX2_NOFMA
+#endif
+
+const size_t SIMD_ALIGNMENT = 64;
+
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+inline const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+// Picks the widest path the CPU supports. BH_SIMD=scalar|sse2|avx2 caps it,
+// which is handy for comparing the kernels against each other.
+inline SimdLevel detectSimdLevel() {
+    SimdLevel level = SIMD_SCALAR;
+#if BH_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) level = SIMD_SSE2;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) level = SIMD_AVX2;
+#endif
+    const char* cap = getenv("BH_SIMD");
+    if (cap) {
+        SimdLevel limit = SIMD_AVX2;
+        if (strcmp(cap, "scalar") == 0) limit = SIMD_SCALAR;
+        else if (strcmp(cap, "sse2") == 0) limit = SIMD_SSE2;
+        if (limit < level) level = limit;
+    }
+    return level;
+}
+
+// Growable array of trivially copyable elements on a SIMD_ALIGNMENT boundary.
+template <typename T>
+class AlignedBuffer {
+    static_assert(std::is_trivially_copyable<T>::value, "AlignedBuffer holds plain data only");
+
+public:
+    AlignedBuffer() : ptr(nullptr), count(0), capacity(0), borrowed(false) {}
+
+    explicit AlignedBuffer(size_t n) : ptr(nullptr), count(0), capacity(0), borrowed(false) {
+        resize(n);
+    }
+
+    AlignedBuffer(const AlignedBuffer& other) : ptr(nullptr), count(0), capacity(0), borrowed(false) {
+        resize(other.count);
+        if (count) memcpy(ptr, other.ptr, count * sizeof(T));
+    }
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+        : ptr(other.ptr), count(other.count), capacity(other.capacity), borrowed(other.borrowed) {
+        other.ptr = nullptr;
+        other.count = other.capacity = 0;
+        other.borrowed = false;
+    }
+
+    AlignedBuffer& operator=(const AlignedBuffer& other) {
+        if (this != &other) {
+            resize(other.count);
+            if (count) memcpy(ptr, other.ptr, count * sizeof(T));
+        }
+        return *this;
+    }
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            ptr = other.ptr;
+            count = other.count;
+            capacity = other.capacity;
+            borrowed = other.borrowed;
+            other.ptr = nullptr;
+            other.count = other.capacity = 0;
+            other.borrowed = false;
+        }
+        return *this;
+    }
+
+    ~AlignedBuffer() {
+        release();
+    }
+
+    void resize(size_t n) {
+        if (n > capacity) {
+            T* grown = static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(SIMD_ALIGNMENT)));
+            if (count) memcpy(grown, ptr, count * sizeof(T));
+            release();
+            ptr = grown;
+            capacity = n;
+        }
+        count = n;
+    }
+
+    void clear() { count = 0; }
+
+    // Uses n elements of memory the caller owns (a snapshot mapping) in
+    // place; it must be suitably aligned and outlive the buffer or the next
+    // own(). Growing past n moves the data to an allocation of its own.
+    void borrow(T* external, size_t n) {
+        release();
+        ptr = external;
+        count = capacity = n;
+        borrowed = true;
+    }
+
+    // Copies borrowed memory into an allocation of its own.
+    void own() {
+        if (!borrowed) return;
+        T* copy = count ? static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(SIMD_ALIGNMENT))) : nullptr;
+        if (count) memcpy(copy, ptr, count * sizeof(T));
+        ptr = copy;
+        capacity = count;
+        borrowed = false;
+    }
+
+    bool isBorrowed() const { return borrowed; }
+
+    T* data() { return ptr; }
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T& operator[](size_t i) { return ptr[i]; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+
+    T* begin() { return ptr; }
+    T* end() { return ptr + count; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+
+private:
+    void release() {
+        if (ptr && !borrowed) ::operator delete(ptr, std::align_val_t(SIMD_ALIGNMENT));
+        ptr = nullptr;
+        capacity = 0;
+        borrowed = false;
+    }
+
+    T* ptr;
+    size_t count;
+    size_t capacity;
+    bool borrowed;
+};
+
+#if BH_SIMD_X86
+
+// Cephes-style single precision sincos: range reduction by pi/4 with a
+// three-part Cody-Waite constant, then the minimax sin and cos polynomials.
+// Accurate to a couple of ulp for |x| up to a few thousand radians.
+
+inline void sincos4(__m128 x, __m128* outSin, __m128* outCos) {
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+    __m128 signSin = _mm_and_ps(x, signMask);
+    x = _mm_andnot_ps(signMask, x);
+
+    __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+    j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(j);
+
+    __m128 swapSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+    __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+    __m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+    signSin = _mm_xor_ps(signSin, swapSin);
+
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 c = _mm_set1_ps(2.443315711809948e-5f);
+    c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(-1.388731625493765e-3f));
+    c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(4.166664568298827e-2f));
+    c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+    c = _mm_sub_ps(c, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+    c = _mm_add_ps(c, _mm_set1_ps(1.0f));
+
+    __m128 s = _mm_set1_ps(-1.9515295891e-4f);
+    s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(8.3321608736e-3f));
+    s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(-1.6666654611e-1f));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+
+    __m128 sinPart = _mm_or_ps(_mm_and_ps(polyMask, s), _mm_andnot_ps(polyMask, c));
+    __m128 cosPart = _mm_or_ps(_mm_and_ps(polyMask, c), _mm_andnot_ps(polyMask, s));
+
+    *outSin = _mm_xor_ps(sinPart, signSin);
+    *outCos = _mm_xor_ps(cosPart, signCos);
+}
+
+BH_TARGET_AVX2 inline void sincos8(__m256 x, __m256* outSin, __m256* outCos) {
+    const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+    __m256 signSin = _mm256_and_ps(x, signMask);
+    x = _mm256_andnot_ps(signMask, x);
+
+    __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(1.27323954473516f)));
+    j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+    __m256 y = _mm256_cvtepi32_ps(j);
+
+    __m256 swapSin = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+    __m256 signCos = _mm256_castsi256_ps(_mm256_slli_epi32(
+        _mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+    __m256 polyMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+    signSin = _mm256_xor_ps(signSin, swapSin);
+
+    x = _mm256_fnmadd_ps(y, _mm256_set1_ps(0.78515625f), x);
+    x = _mm256_fnmadd_ps(y, _mm256_set1_ps(2.4187564849853515625e-4f), x);
+    x = _mm256_fnmadd_ps(y, _mm256_set1_ps(3.77489497744594108e-8f), x);
+
+    __m256 z = _mm256_mul_ps(x, x);
+
+    __m256 c = _mm256_set1_ps(2.443315711809948e-5f);
+    c = _mm256_fmadd_ps(c, z, _mm256_set1_ps(-1.388731625493765e-3f));
+    c = _mm256_fmadd_ps(c, z, _mm256_set1_ps(4.166664568298827e-2f));
+    c = _mm256_mul_ps(_mm256_mul_ps(c, z), z);
+    c = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), c);
+    c = _mm256_add_ps(c, _mm256_set1_ps(1.0f));
+
+    __m256 s = _mm256_set1_ps(-1.9515295891e-4f);
+    s = _mm256_fmadd_ps(s, z, _mm256_set1_ps(8.3321608736e-3f));
+    s = _mm256_fmadd_ps(s, z, _mm256_set1_ps(-1.6666654611e-1f));
+    s = _mm256_fmadd_ps(_mm256_mul_ps(s, z), x, x);
+
+    __m256 sinPart = _mm256_blendv_ps(c, s, polyMask);
+    __m256 cosPart = _mm256_blendv_ps(s, c, polyMask);
+
+    *outSin = _mm256_xor_ps(sinPart, signSin);
+    *outCos = _mm256_xor_ps(cosPart, signCos);
+}
+
+#endif
@@ -0,0 +1,1182 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+#include "simd.h"
+#include "task_scheduler.h"
+#include "render_batch.h"
+#include "rng.h"
+#include "profiler.h"
+#include "barnes_hut.h"
+#include "culling.h"
+#include "integrator.h"
+#include "multirate.h"
+#include "disk_color.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+// Simulation state and stepping. Nothing in here needs a window or a GL
+// context: the only rendering members either fill a VertexBatch on the CPU
+// or are declared here and defined next to main() in blackhole.cpp.
+
+const float BH_PI = 3.14159265359f;
+const int DISK_UPDATE_GRAIN = 16384;
+
+// Parameters that can be tuned while the scene runs.
+enum BlackHoleParameter {
+    BH_PARAM_MASS,
+    BH_PARAM_HORIZON,
+    BH_PARAM_DISK_INNER,
+    BH_PARAM_DISK_OUTER,
+    BH_PARAM_COUNT
+};
+
+static const char* const BH_PARAM_NAMES[BH_PARAM_COUNT] = {"Mass", "Horizon", "Disk Inner", "Disk Outer"};
+
+class BlackHole {
+public:
+    Vector3 position;
+    float mass;
+    float eventHorizonRadius;
+    float accretionDiskInner;
+    float accretionDiskOuter;
+    float rotationSpeed;
+    float currentRotation;
+    uint64_t seed;
+    
+    BlackHole() {
+        position = {0, 0, 0};
+        mass = 50.0f;
+        eventHorizonRadius = 2.0f;
+        accretionDiskInner = 3.5f;
+        accretionDiskOuter = 14.0f;
+        rotationSpeed = 0.4f;
+        currentRotation = 0;
+        seed = DEFAULT_SCENE_SEED;
+    }
+    
+    void update(float dt) {
+        currentRotation += rotationSpeed * dt;
+    }
+    
+    float* parameter(BlackHoleParameter p) {
+        float* fields[BH_PARAM_COUNT] = {&mass, &eventHorizonRadius, &accretionDiskInner, &accretionDiskOuter};
+        return fields[p];
+    }
+    
+    // Only between steps. Everything derived from these parameters notices
+    // the change on its own; a value that would break
+    // 0 < horizon < disk inner < disk outer or make the mass non-positive is
+    // refused.
+    bool setParameter(BlackHoleParameter p, float value) {
+        BlackHole edited = *this;
+        *edited.parameter(p) = value;
+        if (!(edited.mass > 0 && edited.eventHorizonRadius > 0 &&
+              edited.eventHorizonRadius < edited.accretionDiskInner &&
+              edited.accretionDiskInner < edited.accretionDiskOuter)) return false;
+        *parameter(p) = value;
+        return true;
+    }
+    
+    DiskColorInputs colorInputs() const {
+        return {eventHorizonRadius, accretionDiskInner, accretionDiskOuter};
+    }
+    
+    Vector3 getGravity(Vector3 point) {
+        Vector3 dir = Vector3Subtract(position, point);
+        float dist = Vector3Length(dir);
+        if (dist < 0.1f) dist = 0.1f;
+        float strength = mass / (dist * dist);
+        return Vector3Scale(Vector3Normalize(dir), strength);
+    }
+};
+
+// Closed-form lifecycle of a disk particle, for seeking to any time without
+// stepping. Between respawns the radius follows dr/dt = -k / r^2, so
+// r^3 = r0^3 - 3kt. A generation ends when its life runs out or its radius
+// reaches the horizon, whichever is first. Generation 0 lives for its
+// initial life and every later one for maxLife.
+class DiskOrbitModel {
+public:
+    float inner;
+    float span;
+    float horizon;
+    float decayRate;
+
+    DiskOrbitModel(const BlackHole& bh) {
+        inner = bh.accretionDiskInner;
+        span = bh.accretionDiskOuter - bh.accretionDiskInner;
+        horizon = bh.eventHorizonRadius;
+        decayRate = 0.02f * bh.mass * 0.01f;
+    }
+
+    double horizonTime(float r) const {
+        if (decayRate <= 0) return HUGE_VAL;
+        return ((double)r * r * r - (double)horizon * horizon * horizon) / (3.0 * decayRate);
+    }
+
+    float radiusAfter(float r0, double age) const {
+        double cube = (double)r0 * r0 * r0 - 3.0 * decayRate * age;
+        return (float)cbrt(std::max(cube, (double)horizon * horizon * horizon));
+    }
+};
+
+struct DiskSpawn {
+    uint32_t generation;
+    float radius;    // at spawn
+    float angle;     // at spawn
+    double age;      // seconds since spawn
+    double lifeLeft;
+};
+
+// The generation alive at time t (0 = initParticles) and how it started.
+// When no generation can reach the horizon within maxLife, which holds for
+// the default disk, the count is a single division; otherwise generations
+// are walked one at a time.
+inline DiskSpawn diskSpawnAt(const DiskOrbitModel& model, const CounterRng& rng, int i, double t, float maxLife) {
+    RandomBlock first = rng.block(i, 0, 0);
+    DiskSpawn s;
+    s.generation = 0;
+    s.radius = model.inner + first.uniform(0) * model.span;
+    s.angle = first.uniform(1) * BH_PI * 2.0f;
+    double spawnTime = 0;
+    double life = rng.uniform(i, 0, 1, 0) * maxLife;
+    double end = std::min(life, model.horizonTime(s.radius));
+
+    if (t >= end) {
+        if (model.horizonTime(model.inner) >= maxLife) {
+            double lived = floor((t - end) / maxLife);
+            s.generation = 1 + (uint32_t)lived;
+            spawnTime = end + lived * maxLife;
+        } else {
+            while (t >= end) {
+                s.generation++;
+                spawnTime = end;
+                float r = model.inner + rng.uniform(i, s.generation, 0, 0) * model.span;
+                end = spawnTime + std::min((double)maxLife, model.horizonTime(r));
+            }
+        }
+        RandomBlock r = rng.block(i, s.generation);
+        s.radius = model.inner + r.uniform(0) * model.span;
+        s.angle = r.uniform(1) * BH_PI * 2.0f;
+        life = maxLife;
+    }
+    s.age = t - spawnTime;
+    s.lifeLeft = life - s.age;
+    return s;
+}
+
+// The arrays a disk update writes that its draw reads. In pipelined mode
+// they point at the back buffers, so the next step can run while the
+// current one is drawn from the front.
+struct DiskTargets {
+    float* angle;
+    float* radius;
+    float* x;
+    float* y;
+    float* z;
+};
+
+class AccretionDisk {
+public:
+    AlignedBuffer<float> orbitAngle;
+    AlignedBuffer<float> orbitRadius;
+    AlignedBuffer<float> orbitHeight;
+    AlignedBuffer<float> orbitSpeed;
+    AlignedBuffer<float> life;
+    AlignedBuffer<float> maxLife;
+    AlignedBuffer<float> posX;
+    AlignedBuffer<float> posY;
+    AlignedBuffer<float> posZ;
+    AlignedBuffer<uint32_t> generation;
+    int particleCount;
+    int activeCount;     // update and draw only [0, activeCount)
+    BlackHole* blackHole;
+    SimdLevel simdLevel;
+    CounterRng rng;
+    DiskCullBins cullBins;
+    AlignedBuffer<int> drawIndex;
+    std::atomic<long long> accreted;   // respawns from inside the horizon since construction
+    
+    // The mass orbitSpeed was computed for. Speeds go as sqrt(mass), so a
+    // live mass change is folded into every step as speedScale() instead of
+    // rewriting the array.
+    float speedMass;
+    
+    // Back buffers of the DiskTargets arrays, allocated in pipelined mode.
+    bool pipelined;
+    AlignedBuffer<float> backAngle;
+    AlignedBuffer<float> backRadius;
+    AlignedBuffer<float> backX;
+    AlignedBuffer<float> backY;
+    AlignedBuffer<float> backZ;
+    
+    // Multirate mode (multirate.h). Particles are re-sorted within tiles, so
+    // particleId keeps each one's random stream; it stays once allocated.
+    bool multirate;
+    MultirateSchedule schedule;
+    float bucketInner;                 // inner edge the levels were chosen for
+    AlignedBuffer<uint8_t> rateSlot;
+    AlignedBuffer<uint32_t> particleId;
+    std::atomic<long long> stepped;    // particles stepped by the last update
+    
+    // Color comes from the radius and the line of sight (disk_color.h).
+    DiskColorTable colorTable;
+    
+    static const int BYTES_PER_PARTICLE = 9 * 4 + 4;
+    // Reads angle, speed, radius, height and life; writes angle, radius,
+    // life and the position.
+    static const int UPDATE_BYTES_PER_PARTICLE = 5 * 4 + 6 * 4;
+    
+    AccretionDisk(BlackHole* bh, int count)  {
+        blackHole = bh;
+        particleCount = count;
+        activeCount = count;
+        simdLevel = detectSimdLevel();
+        rng = CounterRng(bh->seed, RNG_STREAM_DISK);
+        accreted = 0;
+        speedMass = bh->mass;
+        pipelined = false;
+        multirate = false;
+        bucketInner = bh->accretionDiskInner;
+        stepped = 0;
+        colorTable.refresh(bh->colorInputs());
+        initParticles();
+    }
+    
+    // Particles past activeCount are frozen; reactivated ones are seeked to
+    // the disk's current time so they rejoin where they would have been.
+    // In multirate mode the tiles they join are seeked whole and re-sorted
+    // like seek() does, so none of them is left in a lagging slow slot.
+    void setActiveCount(int count, double time, TaskScheduler& scheduler) {
+        rebucket(scheduler);
+        count = std::max(0, std::min(count, particleCount));
+        int grown = activeCount;
+        if (count > grown && multirate) grown = (grown >> MULTIRATE_TILE_SHIFT) << MULTIRATE_TILE_SHIFT;
+        if (count > grown) {
+            scheduler.parallelFor(grown, count, DISK_UPDATE_GRAIN, [this, time](int begin, int end) {
+                seekRange(time, begin, end);
+            });
+        }
+        activeCount = count;
+        if (count > grown && multirate) {
+            int first = grown >> MULTIRATE_TILE_SHIFT;
+            int last = (count + MULTIRATE_TILE - 1) >> MULTIRATE_TILE_SHIFT;
+            std::fill(schedule.lag.begin() + (size_t)first * MULTIRATE_SLOTS,
+                      schedule.lag.begin() + (size_t)last * MULTIRATE_SLOTS, 0.0f);
+            rebucketTiles(first, last, scheduler);
+        }
+    }
+    
+    void initParticles() {
+        orbitAngle.resize(particleCount);
+        orbitRadius.resize(particleCount);
+        orbitHeight.resize(particleCount);
+        orbitSpeed.resize(particleCount);
+        life.resize(particleCount);
+        maxLife.resize(particleCount);
+        posX.resize(particleCount);
+        posY.resize(particleCount);
+        posZ.resize(particleCount);
+        generation.resize(particleCount);
+        
+        // Generation 0 uses blocks 0 and 1 of each particle's stream. They are
+        // generated in bulk straight into the arrays and mapped in place; the
+        // three unused lanes of block 1 land in the position arrays, which
+        // spawnParticle overwrites.
+        rng.fillUniform4(0, particleCount, 0, 0,
+            orbitRadius.data(), orbitAngle.data(), orbitHeight.data(), maxLife.data());
+        rng.fillUniform4(0, particleCount, 0, 1,
+            life.data(), posX.data(), posY.data(), posZ.data());
+        for (int i = 0; i < particleCount; i++) {
+            generation[i] = 0;
+            spawnParticle(i, orbitRadius[i], orbitAngle[i], orbitHeight[i], maxLife[i], life[i]);
+        }
+    }
+    
+    void spawnParticle(int i, float uRadius, float uAngle, float uHeight, float uMaxLife, float uLife) {
+        float radius = blackHole->accretionDiskInner + 
+            uRadius * (blackHole->accretionDiskOuter - blackHole->accretionDiskInner);
+        float angle = uAngle * BH_PI * 2.0f;
+        float height = (uHeight - 0.5f) * 0.6f * (1.0f - (radius - blackHole->accretionDiskInner) / 
+            (blackHole->accretionDiskOuter - blackHole->accretionDiskInner) * 0.5f);
+        
+        orbitRadius[i] = radius;
+        orbitAngle[i] = angle;
+        orbitHeight[i] = height;
+        
+        posX[i] = cosf(angle) * radius;
+        posY[i] = height;
+        posZ[i] = sinf(angle) * radius;
+        
+        float orbitVel = sqrtf(blackHole->mass / radius) * 0.15f;
+        orbitSpeed[i] = orbitVel / radius;
+        
+        maxLife[i] = 10.0f + uMaxLife * 20.0f;
+        life[i] = uLife * maxLife[i];
+    }
+    
+    void respawnParticle(int i, const DiskTargets& out) {
+        if (out.radius[i] < blackHole->eventHorizonRadius) accreted.fetch_add(1, std::memory_order_relaxed);
+        RandomBlock r = rng.block(idOf(i), ++generation[i]);
+        float radius = blackHole->accretionDiskInner + 
+            r.uniform(0) * (blackHole->accretionDiskOuter - blackHole->accretionDiskInner);
+        float angle = r.uniform(1) * BH_PI * 2.0f;
+        // A multirate particle can die up to a few frames before its slot
+        // steps; the new one starts that far along its orbit.
+        float overshoot = multirate ? std::max(0.0f, -life[i]) : 0.0f;
+        angle = fmodf(angle + orbitSpeed[i] * speedScale() * overshoot, BH_PI * 2.0f);
+        out.radius[i] = radius;
+        out.angle[i] = angle;
+        life[i] = maxLife[i] - overshoot;
+        
+        // Move the drawn point along, so it is binned where it is drawn.
+        out.x[i] = cosf(angle) * radius;
+        out.z[i] = sinf(angle) * radius;
+        out.y[i] = orbitHeight[i] * (radius / blackHole->accretionDiskOuter) + sinf(angle * 3.0f + radius) * 0.08f;
+    }
+    
+    float speedScale() const {
+        return sqrtf(blackHole->mass / speedMass);
+    }
+    
+    uint32_t idOf(int i) const {
+        return particleId.empty() ? (uint32_t)i : particleId[i];
+    }
+    
+    DiskTargets targets() {
+        if (pipelined) return {backAngle.data(), backRadius.data(), backX.data(), backY.data(), backZ.data()};
+        return {orbitAngle.data(), orbitRadius.data(), posX.data(), posY.data(), posZ.data()};
+    }
+    
+    // Pipelined mode: updates read the front arrays and write the back ones,
+    // and swapBuffers() publishes the step. Only switch between steps. The
+    // back buffers start as copies so particles outside activeCount stay
+    // valid in both; the front arrays are owned first so a snapshot mapping
+    // never ends up behind a back buffer.
+    void setPipelined(bool enabled) {
+        if (enabled == pipelined) return;
+        pipelined = enabled;
+        if (enabled) {
+            orbitAngle.own();
+            orbitRadius.own();
+            posX.own();
+            posY.own();
+            posZ.own();
+            backAngle = orbitAngle;
+            backRadius = orbitRadius;
+            backX = posX;
+            backY = posY;
+            backZ = posZ;
+        } else {
+            backAngle = AlignedBuffer<float>();
+            backRadius = AlignedBuffer<float>();
+            backX = AlignedBuffer<float>();
+            backY = AlignedBuffer<float>();
+            backZ = AlignedBuffer<float>();
+        }
+    }
+    
+    void swapBuffers() {
+        if (!pipelined) return;
+        std::swap(orbitAngle, backAngle);
+        std::swap(orbitRadius, backRadius);
+        std::swap(posX, backX);
+        std::swap(posY, backY);
+        std::swap(posZ, backZ);
+        if (multirate) schedule.publish();
+    }
+    
+    size_t pipelineBytes() const {
+        return (backAngle.size() + backRadius.size() + backX.size() + backY.size() + backZ.size()) * sizeof(float);
+    }
+    
+    // Jumps to time t since initParticles in closed form, independent of the
+    // frame rate and of every earlier step. Angles advance at the particle's
+    // fixed orbitSpeed; stepping can carry on from the result.
+    void seek(double t, TaskScheduler& scheduler) {
+        BH_PROFILE_SCOPE("AccretionDisk::seek");
+        scheduler.parallelFor(0, particleCount, DISK_UPDATE_GRAIN, [this, t](int begin, int end) {
+            seekRange(t, begin, end);
+        });
+        if (multirate) {
+            std::fill(schedule.lag.begin(), schedule.lag.end(), 0.0f);
+            rebucketAll(scheduler);
+        }
+    }
+    
+    void seekRange(double t, int begin, int end) {
+        DiskOrbitModel model(*blackHole);
+        const double twoPi = BH_PI * 2.0;
+        const float heightScale = 1.0f / blackHole->accretionDiskOuter;
+        const double scale = speedScale();
+        
+        for (int i = begin; i < end; i++) {
+            DiskSpawn s = diskSpawnAt(model, rng, idOf(i), t, maxLife[i]);
+            float radius = model.radiusAfter(s.radius, s.age);
+            float angle = (float)fmod(s.angle + orbitSpeed[i] * scale * s.age, twoPi);
+            
+            orbitAngle[i] = angle;
+            orbitRadius[i] = radius;
+            life[i] = (float)s.lifeLeft;
+            generation[i] = s.generation;
+            posX[i] = cosf(angle) * radius;
+            posZ[i] = sinf(angle) * radius;
+            posY[i] = orbitHeight[i] * (radius * heightScale) + sinf(angle * 3.0f + radius) * 0.08f;
+        }
+    }
+    
+    void update(float dt) {
+        BH_PROFILE_SCOPE("AccretionDisk::update");
+        if (multirate) {
+            updateMultirate(dt, nullptr);
+            return;
+        }
+        updateRange(dt, 0, activeCount);
+        stepped = activeCount;
+    }
+    
+    void update(float dt, TaskScheduler& scheduler) {
+        BH_PROFILE_SCOPE("AccretionDisk::update");
+        if (multirate) {
+            updateMultirate(dt, &scheduler);
+            return;
+        }
+        scheduler.parallelFor(0, activeCount, DISK_UPDATE_GRAIN, [this, dt](int begin, int end) {
+            updateRange(dt, begin, end);
+        });
+        stepped = activeCount;
+    }
+    
+    // Only between steps. Turning it off catches every slot up first; the
+    // particle order and ids stay as they are.
+    void setMultirate(bool enabled, TaskScheduler& scheduler) {
+        if (enabled == multirate) return;
+        if (!enabled) {
+            synchronize(scheduler);
+            multirate = false;
+            rateSlot = AlignedBuffer<uint8_t>();
+            return;
+        }
+        if (particleId.empty()) {
+            particleId.resize(particleCount);
+            for (int i = 0; i < particleCount; i++) particleId[i] = (uint32_t)i;
+        }
+        rateSlot.resize(particleCount);
+        schedule.reset(particleCount);
+        multirate = true;
+        rebucketAll(scheduler);
+    }
+    
+    // Steps every lagging slot to the present, so all particles share one
+    // time (for snapshots). Only between steps; in pipelined mode the
+    // result is swapped to the front.
+    void synchronize(TaskScheduler& scheduler) {
+        if (!multirate) return;
+        scheduler.parallelFor(0, schedule.tileCount, 1, [this](int begin, int end) {
+            for (int t = begin; t < end; t++) stepTile(t, 0, true);
+        });
+        if (pipelined) swapBuffers();
+        else schedule.publish();
+    }
+    
+    void updateMultirate(float dt, TaskScheduler* scheduler) {
+        schedule.frame++;
+        stepped = 0;
+        auto tiles = [this, dt](int begin, int end) {
+            for (int t = begin; t < end; t++) stepTile(t, dt, false);
+        };
+        if (scheduler) scheduler->parallelFor(0, schedule.tileCount, 1, tiles);
+        else tiles(0, schedule.tileCount);
+        if (!pipelined) schedule.publish();
+    }
+    
+    // Steps the slots of `tile` that are due this frame, or with catchUp
+    // every slot with lag. While pipelined the skipped ranges are copied to
+    // the back buffers, so the swap publishes them unchanged.
+    void stepTile(int tile, float dt, bool catchUp) {
+        MultirateRange range = schedule.tileRange(tile);
+        int end = std::min(range.end, activeCount);
+        if (range.begin >= end) return;
+        float* lag = schedule.tileLag(tile);
+        long long count = 0;
+        for (int level = 0; level < MULTIRATE_LEVELS; level++) {
+            for (int phase = 0; phase < (1 << level); phase++) {
+                int slot = multirateSlot(level, phase);
+                lag[slot] += dt;
+                MultirateRange r = schedule.slotRange(tile, level, phase);
+                r.end = std::min(r.end, end);
+                bool step = catchUp ? lag[slot] > 0 : schedule.due(level, phase);
+                if (step) {
+                    if (r.begin < r.end) stepRange(lag[slot], r.begin, r.end);
+                    count += std::max(0, r.end - r.begin);
+                    lag[slot] = 0;
+                } else if (pipelined && r.begin < r.end) {
+                    copyToBack(r.begin, r.end);
+                }
+            }
+        }
+        stepped.fetch_add(count, std::memory_order_relaxed);
+    }
+    
+    void copyToBack(int begin, int end) {
+        size_t bytes = (size_t)(end - begin) * sizeof(float);
+        memcpy(&backAngle[begin], &orbitAngle[begin], bytes);
+        memcpy(&backRadius[begin], &orbitRadius[begin], bytes);
+        memcpy(&backX[begin], &posX[begin], bytes);
+        memcpy(&backY[begin], &posY[begin], bytes);
+        memcpy(&backZ[begin], &posZ[begin], bytes);
+    }
+    
+    // A level compares a particle's speed with the inner edge's; the mass
+    // scales both alike and respawns keep the speed, so only an inner edge
+    // edit moves particles between levels. Only between steps.
+    void rebucket(TaskScheduler& scheduler) {
+        if (!multirate || bucketInner == blackHole->accretionDiskInner) return;
+        synchronize(scheduler);
+        rebucketAll(scheduler);
+    }
+    
+    void rebucketAll(TaskScheduler& scheduler) {
+        bucketInner = blackHole->accretionDiskInner;
+        rebucketTiles(0, schedule.tileCount, scheduler);
+    }
+    
+    void rebucketTiles(int first, int last, TaskScheduler& scheduler) {
+        scheduler.parallelFor(first, last, 1, [this](int begin, int end) {
+            for (int t = begin; t < end; t++) rebucketTile(t);
+        });
+        schedule.publish();
+    }
+    
+    template <typename T>
+    static void permuteRange(T* data, const int* order, int n, std::vector<T>& scratch) {
+        scratch.assign(data, data + n);
+        for (int k = 0; k < n; k++) data[k] = scratch[order[k]];
+    }
+    
+    // Counting sort of the tile's active particles by level; its slots must
+    // have no lag. Frozen particles past activeCount stay at the end, in the
+    // slowest level.
+    void rebucketTile(int tile) {
+        MultirateRange range = schedule.tileRange(tile);
+        int begin = range.begin;
+        int n = std::max(0, std::min(range.end, activeCount) - begin);
+        float inner = blackHole->accretionDiskInner;
+        float fastest = sqrtf(blackHole->mass / inner) * 0.15f / inner;
+        float scale = speedScale();
+        
+        int offsets[MULTIRATE_LEVELS + 1] = {0};
+        std::vector<uint8_t> levels(n);
+        for (int k = 0; k < n; k++) {
+            levels[k] = (uint8_t)multirateLevel(orbitSpeed[begin + k] * scale, fastest);
+            offsets[levels[k] + 1]++;
+        }
+        int* start = &schedule.levelStart[(size_t)tile * (MULTIRATE_LEVELS + 1)];
+        for (int l = 0; l < MULTIRATE_LEVELS; l++) {
+            start[l] = begin + offsets[l];
+            offsets[l + 1] += offsets[l];
+        }
+        start[MULTIRATE_LEVELS] = range.end;
+        std::vector<int> order(n);
+        for (int k = 0; k < n; k++) order[offsets[levels[k]]++] = k;
+        
+        std::vector<float> floats;
+        permuteRange(&orbitAngle[begin], order.data(), n, floats);
+        permuteRange(&orbitRadius[begin], order.data(), n, floats);
+        permuteRange(&orbitHeight[begin], order.data(), n, floats);
+        permuteRange(&orbitSpeed[begin], order.data(), n, floats);
+        permuteRange(&life[begin], order.data(), n, floats);
+        permuteRange(&maxLife[begin], order.data(), n, floats);
+        permuteRange(&posX[begin], order.data(), n, floats);
+        permuteRange(&posY[begin], order.data(), n, floats);
+        permuteRange(&posZ[begin], order.data(), n, floats);
+        std::vector<uint32_t> words;
+        permuteRange(&generation[begin], order.data(), n, words);
+        permuteRange(&particleId[begin], order.data(), n, words);
+        
+        for (int level = 0; level < MULTIRATE_LEVELS; level++) {
+            for (int phase = 0; phase < (1 << level); phase++) {
+                MultirateRange r = schedule.slotRange(tile, level, phase);
+                std::fill(rateSlot.data() + r.begin, rateSlot.data() + r.end, (uint8_t)multirateSlot(level, phase));
+            }
+        }
+    }
+    
+    void updateRange(float dt, int begin, int end) {
+        BH_PROFILE_SCOPE("AccretionDisk::updateRange");
+        stepRange(dt, begin, end);
+    }
+    
+    void stepRange(float dt, int begin, int end) {
+        int done = begin;
+#if BH_SIMD_X86
+        if (simdLevel == SIMD_AVX2) {
+            done = updateAvx2(dt, begin, end);
+        } else if (simdLevel == SIMD_SSE2) {
+            done = updateSse2(dt, begin, end);
+        }
+#endif
+        updateScalar(dt, done, end);
+    }
+    
+    // Angles are kept in [0, 2pi) so the vector sincos stays in its accurate
+    // range; every use of the angle is periodic so this is invisible on screen.
+    void updateScalar(float dt, int begin, int end) {
+        const float twoPi = BH_PI * 2.0f;
+        const float decay = 0.02f * dt * blackHole->mass * 0.01f;
+        const float heightScale = 1.0f / blackHole->accretionDiskOuter;
+        const float turnDt = dt * speedScale();
+        const DiskTargets out = targets();
+        
+        for (int i = begin; i < end; i++) {
+            float angle = orbitAngle[i] + orbitSpeed[i] * turnDt;
+            if (angle >= twoPi) angle -= twoPi;
+            float radius = orbitRadius[i] - decay / (orbitRadius[i] * orbitRadius[i]);
+            
+            out.x[i] = cosf(angle) * radius;
+            out.z[i] = sinf(angle) * radius;
+            out.y[i] = orbitHeight[i] * (radius * heightScale) + sinf(angle * 3.0f + radius) * 0.08f;
+            
+            out.angle[i] = angle;
+            out.radius[i] = radius;
+            life[i] -= dt;
+            
+            if (life[i] <= 0 || radius < blackHole->eventHorizonRadius) {
+                respawnParticle(i, out);
+            }
+        }
+    }
+    
+#if BH_SIMD_X86
+    // Vector kernels return how many particles they handled; the remainder
+    // goes through updateScalar. Respawns are rare, so lanes that need one are
+    // picked out of the movemask and handled one by one after the stores.
+    int updateSse2(float dt, int begin, int end) {
+        const __m128 twoPi = _mm_set1_ps(BH_PI * 2.0f);
+        const __m128 vdt = _mm_set1_ps(dt);
+        const __m128 turnDt = _mm_set1_ps(dt * speedScale());
+        const __m128 decay = _mm_set1_ps(0.02f * dt * blackHole->mass * 0.01f);
+        const __m128 heightScale = _mm_set1_ps(1.0f / blackHole->accretionDiskOuter);
+        const __m128 horizon = _mm_set1_ps(blackHole->eventHorizonRadius);
+        const __m128 three = _mm_set1_ps(3.0f);
+        const __m128 wobble = _mm_set1_ps(0.08f);
+        const __m128 zero = _mm_setzero_ps();
+        const DiskTargets out = targets();
+        
+        int i = begin;
+        for (; i + 4 <= end; i += 4) {
+            __m128 angle = _mm_add_ps(_mm_loadu_ps(&orbitAngle[i]), _mm_mul_ps(_mm_loadu_ps(&orbitSpeed[i]), turnDt));
+            angle = _mm_sub_ps(angle, _mm_and_ps(_mm_cmpge_ps(angle, twoPi), twoPi));
+            __m128 radius = _mm_loadu_ps(&orbitRadius[i]);
+            radius = _mm_sub_ps(radius, _mm_div_ps(decay, _mm_mul_ps(radius, radius)));
+            
+            __m128 s, c, ws, wc;
+            sincos4(angle, &s, &c);
+            sincos4(_mm_add_ps(_mm_mul_ps(angle, three), radius), &ws, &wc);
+            
+            __m128 y = _mm_mul_ps(_mm_loadu_ps(&orbitHeight[i]), _mm_mul_ps(radius, heightScale));
+            _mm_storeu_ps(&out.x[i], _mm_mul_ps(c, radius));
+            _mm_storeu_ps(&out.z[i], _mm_mul_ps(s, radius));
+            _mm_storeu_ps(&out.y[i], _mm_add_ps(y, _mm_mul_ps(ws, wobble)));
+            
+            __m128 lifeLeft = _mm_sub_ps(_mm_loadu_ps(&life[i]), vdt);
+            _mm_storeu_ps(&out.angle[i], angle);
+            _mm_storeu_ps(&out.radius[i], radius);
+            _mm_storeu_ps(&life[i], lifeLeft);
+            
+            int respawn = _mm_movemask_ps(_mm_or_ps(_mm_cmple_ps(lifeLeft, zero), _mm_cmplt_ps(radius, horizon)));
+            while (respawn) {
+                respawnParticle(i + __builtin_ctz(respawn), out);
+                respawn &= respawn - 1;
+            }
+        }
+        return i;
+    }
+    
+    BH_TARGET_AVX2 int updateAvx2(float dt, int begin, int end) {
+        const __m256 twoPi = _mm256_set1_ps(BH_PI * 2.0f);
+        const __m256 vdt = _mm256_set1_ps(dt);
+        const __m256 turnDt = _mm256_set1_ps(dt * speedScale());
+        const __m256 decay = _mm256_set1_ps(0.02f * dt * blackHole->mass * 0.01f);
+        const __m256 heightScale = _mm256_set1_ps(1.0f / blackHole->accretionDiskOuter);
+        const __m256 horizon = _mm256_set1_ps(blackHole->eventHorizonRadius);
+        const __m256 three = _mm256_set1_ps(3.0f);
+        const __m256 wobble = _mm256_set1_ps(0.08f);
+        const __m256 zero = _mm256_setzero_ps();
+        const DiskTargets out = targets();
+        
+        int i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256 angle = _mm256_fmadd_ps(_mm256_loadu_ps(&orbitSpeed[i]), turnDt, _mm256_loadu_ps(&orbitAngle[i]));
+            angle = _mm256_sub_ps(angle, _mm256_and_ps(_mm256_cmp_ps(angle, twoPi, _CMP_GE_OQ), twoPi));
+            __m256 radius = _mm256_loadu_ps(&orbitRadius[i]);
+            radius = _mm256_sub_ps(radius, _mm256_div_ps(decay, _mm256_mul_ps(radius, radius)));
+            
+            __m256 s, c, ws, wc;
+            sincos8(angle, &s, &c);
+            sincos8(_mm256_fmadd_ps(angle, three, radius), &ws, &wc);
+            
+            __m256 y = _mm256_mul_ps(_mm256_loadu_ps(&orbitHeight[i]), _mm256_mul_ps(radius, heightScale));
+            _mm256_storeu_ps(&out.x[i], _mm256_mul_ps(c, radius));
+            _mm256_storeu_ps(&out.z[i], _mm256_mul_ps(s, radius));
+            _mm256_storeu_ps(&out.y[i], _mm256_fmadd_ps(ws, wobble, y));
+            
+            __m256 lifeLeft = _mm256_sub_ps(_mm256_loadu_ps(&life[i]), vdt);
+            _mm256_storeu_ps(&out.angle[i], angle);
+            _mm256_storeu_ps(&out.radius[i], radius);
+            _mm256_storeu_ps(&life[i], lifeLeft);
+            
+            int respawn = _mm256_movemask_ps(_mm256_or_ps(
+                _mm256_cmp_ps(lifeLeft, zero, _CMP_LE_OQ), _mm256_cmp_ps(radius, horizon, _CMP_LT_OQ)));
+            while (respawn) {
+                respawnParticle(i + __builtin_ctz(respawn), out);
+                respawn &= respawn - 1;
+            }
+        }
+        return i;
+    }
+#endif
+    
+    // lag: seconds since a multirate particle last stepped, times
+    // speedScale(). The point is turned on along its orbit by that much, to
+    // first order in the angle.
+    void drawParticle(int i, Vector3* positions, Color* colors, float lag = 0) const {
+        float turn = orbitSpeed[i] * lag;
+        float x = posX[i] - posZ[i] * turn;
+        float z = posZ[i] + posX[i] * turn;
+        Color c = colorTable.shade(x, z, orbitRadius[i]);
+        
+        positions[0] = {x, posY[i], z};
+        positions[1] = {x, posY[i], z + 0.1f};
+        colors[0] = c;
+        colors[1] = c;
+    }
+    
+    // With a culler, particles in disk bins that cannot be seen are dropped
+    // before any color or position work. Visible and culled particles are
+    // interleaved in memory, so the survivors are first compacted into an
+    // index list without branches and then drawn from it.
+    void draw(VertexBatch& batch, float time, const Camera3D& camera, ViewCuller* culler = nullptr) {
+        BH_PROFILE_SCOPE("AccretionDisk::draw");
+        colorTable.refresh(blackHole->colorInputs());
+        colorTable.setViewer(camera.position, blackHole->position);
+        if (culler) cullBins.classify(*culler, blackHole->eventHorizonRadius, blackHole->accretionDiskOuter);
+        if (!culler || cullBins.allVisible()) {
+            int first = batch.reserve(activeCount * 2);
+            Vector3* positions = batch.positions.data() + first;
+            Color* colors = batch.colors.data() + first;
+            if (multirate) {
+                float scale = speedScale();
+                for (int i = 0; i < activeCount; i++) {
+                    drawParticle(i, positions + i * 2, colors + i * 2, schedule.lagOf(i, rateSlot.data()) * scale);
+                }
+            } else {
+                for (int i = 0; i < activeCount; i++) drawParticle(i, positions + i * 2, colors + i * 2);
+            }
+            if (culler) culler->count(CULL_DISK, activeCount, 0, DISK_CULL_BINS, 0);
+            return;
+        }
+        
+        drawIndex.resize(activeCount);
+        int n = 0;
+        for (int i = 0; i < activeCount; i++) {
+            drawIndex[n] = i;
+            n += cullBins.visible[cullBins.binOf(orbitRadius[i], orbitAngle[i])];
+        }
+        
+        int first = batch.reserve(n * 2);
+        Vector3* positions = batch.positions.data() + first;
+        Color* colors = batch.colors.data() + first;
+        float scale = multirate ? speedScale() : 0.0f;
+        for (int k = 0; k < n; k++) {
+            int i = drawIndex[k];
+            drawParticle(i, positions + k * 2, colors + k * 2, multirate ? schedule.lagOf(i, rateSlot.data()) * scale : 0.0f);
+        }
+        culler->count(CULL_DISK, n, activeCount - n, DISK_CULL_BINS, DISK_CULL_BINS - cullBins.visibleBins);
+    }
+};
+
+const int INFALL_TRAIL_LENGTH = 30;
+const int INFALL_UPDATE_GRAIN = 4096;
+
+// Trails live in one pooled ring-buffer store: streamer i owns the fixed
+// slot [i * trailCapacity, (i + 1) * trailCapacity), written round-robin at
+// trailHead. A step overwrites the oldest point instead of shifting the
+// trail, and a respawn only resets trailLength.
+//
+// With selfGravity on, the scheduler update also rebuilds a Barnes-Hut tree
+// over the streamers each step, so the gas (selfGravityMass in total, split
+// evenly) attracts itself as well as falling into the hole.
+class InfallingMatter {
+public:
+    struct Streamer {
+        Vector3 pos;
+        Vector3 vel;
+        int trailHead;
+        int trailLength;
+        Color color;
+        bool active;
+        float life;
+        uint32_t generation;
+    };
+    
+    std::vector<Streamer> streamers;
+    AlignedBuffer<Vector3> trailPool;
+    int trailCapacity;
+    BlackHole* blackHole;
+    int maxStreamers;
+    CounterRng rng;
+    
+    bool selfGravity;
+    float selfGravityMass;
+    BarnesHutTree tree;
+    AlignedBuffer<float> bodyX;
+    AlignedBuffer<float> bodyY;
+    AlignedBuffer<float> bodyZ;
+    AlignedBuffer<float> selfAccX;
+    AlignedBuffer<float> selfAccY;
+    AlignedBuffer<float> selfAccZ;
+    
+    // Leapfrog substeps shrink with the free-fall time near the horizon.
+    LeapfrogControl integrator;
+    std::atomic<long long> forceEvaluations;
+    
+    // How streamers have ended since construction.
+    std::atomic<long long> absorbed;   // crossed the horizon
+    std::atomic<long long> expired;    // ran out of life
+    std::atomic<long long> escaped;    // left the 50-unit sphere
+    
+    // Pipelined mode: draw() reads these copies, which swapBuffers()
+    // refreshes between steps. Streamers are few, so a copy is cheaper than
+    // double-buffering the trail ring.
+    bool pipelined;
+    std::vector<Streamer> frontStreamers;
+    AlignedBuffer<Vector3> frontTrails;
+    
+    InfallingMatter(BlackHole* bh, int count) {
+        blackHole = bh;
+        maxStreamers = count;
+        trailCapacity = INFALL_TRAIL_LENGTH;
+        selfGravity = false;
+        selfGravityMass = 10.0f;
+        rng = CounterRng(bh->seed, RNG_STREAM_INFALL);
+        forceEvaluations = 0;
+        absorbed = 0;
+        expired = 0;
+        escaped = 0;
+        pipelined = false;
+        
+        streamers.resize(maxStreamers);
+        trailPool.resize((size_t)maxStreamers * trailCapacity);
+        for (int i = 0; i < maxStreamers; i++) {
+            spawnStreamer(i);
+        }
+    }
+    
+    // Places streamer `index` on its spawn shell for its current generation.
+    void launchStreamer(Streamer& s, uint32_t index) {
+        RandomBlock r = rng.block(index, s.generation, 0);
+        float angle = r.uniform(0) * BH_PI * 2.0f;
+        float dist = 18.0f + r.uniform(1) * 12.0f;
+        float height = (r.uniform(2) - 0.5f) * 8.0f;
+        
+        s.pos = {cosf(angle) * dist, height, sinf(angle) * dist};
+        
+        Vector3 toCenter = Vector3Normalize(Vector3Subtract(blackHole->position, s.pos));
+        Vector3 perpendicular = Vector3CrossProduct(toCenter, {0, 1, 0});
+        perpendicular = Vector3Normalize(perpendicular);
+        
+        float tangentStrength = 0.5f + r.uniform(3) * 0.5f;
+        s.vel = Vector3Add(
+            Vector3Scale(toCenter, 2.0f),
+            Vector3Scale(perpendicular, tangentStrength * 3.0f)
+        );
+        
+        s.life = 15.0f + rng.uniform(index, s.generation, 1, 0) * 10.0f;
+    }
+    
+    void spawnStreamer(int index) {
+        Streamer& s = streamers[index];
+        s.generation = 0;
+        launchStreamer(s, (uint32_t)index);
+        
+        s.trailHead = 0;
+        s.trailLength = 0;
+        s.active = true;
+        
+        float colorChoice = rng.uniform((uint32_t)index, 0, 1, 1);
+        if (colorChoice > 0.7f) {
+            s.color = {255, 220, 150, 255};
+        } else if (colorChoice > 0.4f) {
+            s.color = {255, 160, 80, 255};
+        } else {
+            s.color = {255, 100, 50, 255};
+        }
+    }
+    
+    void update(float dt) {
+        BH_PROFILE_SCOPE("InfallingMatter::update");
+        updateRange(dt, 0, (int)streamers.size());
+    }
+    
+    void update(float dt, TaskScheduler& scheduler) {
+        BH_PROFILE_SCOPE("InfallingMatter::update");
+        bool withSelfGravity = selfGravity && streamers.size() > 1;
+        if (withSelfGravity) computeSelfGravity(scheduler);
+        scheduler.parallelFor(0, (int)streamers.size(), INFALL_UPDATE_GRAIN, [this, dt, withSelfGravity](int begin, int end) {
+            updateRange(dt, begin, end, withSelfGravity);
+        });
+    }
+    
+    void computeSelfGravity(TaskScheduler& scheduler) {
+        BH_PROFILE_SCOPE("InfallingMatter::selfGravity");
+        int count = (int)streamers.size();
+        bodyX.resize(count);
+        bodyY.resize(count);
+        bodyZ.resize(count);
+        selfAccX.resize(count);
+        selfAccY.resize(count);
+        selfAccZ.resize(count);
+        for (int i = 0; i < count; i++) {
+            bodyX[i] = streamers[i].pos.x;
+            bodyY[i] = streamers[i].pos.y;
+            bodyZ[i] = streamers[i].pos.z;
+        }
+        tree.build(bodyX.data(), bodyY.data(), bodyZ.data(), nullptr, selfGravityMass / count, count, scheduler);
+        tree.computeAccelerations(scheduler, selfAccX.data(), selfAccY.data(), selfAccZ.data());
+    }
+    
+    void updateRange(float dt, int begin, int end, bool withSelfGravity = false) {
+        long long rangeAbsorbed = 0, rangeExpired = 0, rangeEscaped = 0, rangeEvaluations = 0;
+        const float horizon = blackHole->eventHorizonRadius;
+        for (int i = begin; i < end; i++) {
+            Streamer& s = streamers[i];
+            
+            if (!s.active) continue;
+            
+            // The gas's own pull is held at its start-of-frame value.
+            Vector3 selfAcc = withSelfGravity ? Vector3{selfAccX[i], selfAccY[i], selfAccZ[i]} : Vector3{0, 0, 0};
+            rangeEvaluations += integrateLeapfrog(s.pos, s.vel, dt, blackHole->position, blackHole->mass, integrator,
+                [this, selfAcc](Vector3 p) { return Vector3Add(blackHole->getGravity(p), selfAcc); },
+                [horizon](Vector3 p) { return Vector3Length(p) < horizon; });
+            
+            trailPool[(size_t)i * trailCapacity + s.trailHead] = s.pos;
+            s.trailHead = s.trailHead + 1 == trailCapacity ? 0 : s.trailHead + 1;
+            if (s.trailLength < trailCapacity) s.trailLength++;
+            
+            s.life -= dt;
+            
+            float dist = Vector3Length(s.pos);
+            if (dist < horizon || s.life <= 0 || dist > 50.0f) {
+                if (dist < horizon) rangeAbsorbed++;
+                else if (s.life <= 0) rangeExpired++;
+                else rangeEscaped++;
+                s.trailLength = 0;
+                s.generation++;
+                launchStreamer(s, (uint32_t)i);
+            }
+        }
+        forceEvaluations.fetch_add(rangeEvaluations, std::memory_order_relaxed);
+        if (rangeAbsorbed) absorbed.fetch_add(rangeAbsorbed, std::memory_order_relaxed);
+        if (rangeExpired) expired.fetch_add(rangeExpired, std::memory_order_relaxed);
+        if (rangeEscaped) escaped.fetch_add(rangeEscaped, std::memory_order_relaxed);
+    }
+    
+    void setPipelined(bool enabled) {
+        pipelined = enabled;
+        std::vector<Streamer>().swap(frontStreamers);
+        frontTrails = AlignedBuffer<Vector3>();
+        swapBuffers();
+    }
+    
+    void swapBuffers() {
+        if (!pipelined) return;
+        frontStreamers = streamers;
+        frontTrails = trailPool;
+    }
+    
+    size_t pipelineBytes() const {
+        return frontStreamers.size() * sizeof(Streamer) + frontTrails.size() * sizeof(Vector3);
+    }
+    
+    // Trails fade from dim and transparent at the tail to full color at the
+    // head, capped by a point at the streamer.
+    void draw(VertexBatch& batch) {
+        BH_PROFILE_SCOPE("InfallingMatter::draw");
+        const std::vector<Streamer>& streamers = pipelined ? frontStreamers : this->streamers;
+        const AlignedBuffer<Vector3>& trailPool = pipelined ? frontTrails : this->trailPool;
+        int vertices = 0;
+        for (const Streamer& s : streamers) {
+            if (s.active && s.trailLength >= 2) vertices += s.trailLength * 2;
+        }
+        int first = batch.reserve(vertices);
+        Vector3* positions = batch.positions.data() + first;
+        Color* colors = batch.colors.data() + first;
+        
+        int v = 0;
+        for (int i = 0; i < (int)streamers.size(); i++) {
+            const Streamer& s = streamers[i];
+            if (!s.active || s.trailLength < 2) continue;
+            
+            const Vector3* slot = trailPool.data() + (size_t)i * trailCapacity;
+            int k = s.trailHead - s.trailLength;
+            if (k < 0) k += trailCapacity;
+            Vector3 prev = slot[k];
+            float invLength = 1.0f / s.trailLength;
+            for (int j = 1; j < s.trailLength; j++) {
+                if (++k == trailCapacity) k = 0;
+                float t = j * invLength;
+                Color c = {
+                    (unsigned char)(s.color.r * (0.3f + t * 0.7f)),
+                    (unsigned char)(s.color.g * (0.2f + t * 0.8f)),
+                    (unsigned char)(s.color.b * (0.1f + t * 0.9f)),
+                    (unsigned char)(t * 255)
+                };
+                positions[v] = prev;
+                positions[v + 1] = slot[k];
+                colors[v] = c;
+                colors[v + 1] = c;
+                prev = slot[k];
+                v += 2;
+            }
+            
+            positions[v] = s.pos;
+            positions[v + 1] = {s.pos.x, s.pos.y, s.pos.z + 0.1f};
+            colors[v] = s.color;
+            colors[v + 1] = s.color;
+            v += 2;
+        }
+    }
+};
+
+class JetStream {
+public:
+    struct JetParticle {
+        Vector3 pos;
+        Vector3 vel;
+        float life;
+        float maxLife;
+        uint32_t generation;
+    };
+    
+    // Culling bins: slabs of JET_SLAB_LENGTH along the jet, the last one open
+    // ended, each with the box of its particles refreshed every update.
+    static const int JET_SLABS = 8;
+    static constexpr float JET_SLAB_LENGTH = 8.0f;
+    
+    std::vector<JetParticle> particles;
+    BlackHole* blackHole;
+    int maxParticles;
+    bool topJet;
+    CounterRng rng;
+    Vector3 slabMin[JET_SLABS];
+    Vector3 slabMax[JET_SLABS];
+    
+    // Pipelined mode: what draw() reads, copied by swapBuffers().
+    bool pipelined;
+    std::vector<JetParticle> frontParticles;
+    Vector3 frontSlabMin[JET_SLABS];
+    Vector3 frontSlabMax[JET_SLABS];
+    
+    JetStream(BlackHole* bh, bool top, int count) {
+        blackHole = bh;
+        topJet = top;
+        maxParticles = count;
+        rng = CounterRng(bh->seed, top ? RNG_STREAM_JET_TOP : RNG_STREAM_JET_BOTTOM);
+        particles.reserve(maxParticles);
+        pipelined = false;
+        clearSlabs();
+    }
+    
+    void clearSlabs() {
+        for (int k = 0; k < JET_SLABS; k++) {
+            slabMin[k] = {1e30f, 1e30f, 1e30f};
+            slabMax[k] = {-1e30f, -1e30f, -1e30f};
+        }
+    }
+    
+    int slabOf(Vector3 pos) const {
+        float along = topJet ? pos.y - blackHole->position.y : blackHole->position.y - pos.y;
+        return std::max(0, std::min((int)(along / JET_SLAB_LENGTH), JET_SLABS - 1));
+    }
+    
+    // Emits particle `index` from the base of the jet for its current generation.
+    void launchParticle(JetParticle& p, uint32_t index) {
+        RandomBlock r = rng.block(index, p.generation);
+        float angle = r.uniform(0) * BH_PI * 2.0f;
+        float radius = 0.2f + r.uniform(1) * 0.4f;
+        
+        p.pos = blackHole->position;
+        p.pos.x += cosf(angle) * radius;
+        p.pos.z += sinf(angle) * radius;
+        p.pos.y += topJet ? blackHole->eventHorizonRadius : -blackHole->eventHorizonRadius;
+        
+        float speed = 10.0f + r.uniform(2) * 5.0f;
+        float spread = 0.15f;
+        p.vel = {
+            (r.uniform(3) - 0.5f) * spread,
+            topJet ? speed : -speed,
+            (rng.uniform(index, p.generation, 1, 0) - 0.5f) * spread
+        };
+    }
+    
+    void update(float dt, float time) {
+        BH_PROFILE_SCOPE("JetStream::update");
+        if ((int)particles.size() < maxParticles) {
+            JetParticle p;
+            uint32_t index = (uint32_t)particles.size();
+            p.generation = 0;
+            launchParticle(p, index);
+            
+            p.maxLife = 2.5f + rng.uniform(index, 0, 1, 1) * 1.5f;
+            p.life = p.maxLife;
+            
+            particles.push_back(p);
+        }
+        
+        clearSlabs();
+        for (size_t i = 0; i < particles.size(); i++) {
+            JetParticle& p = particles[i];
+            
+            p.pos = Vector3Add(p.pos, Vector3Scale(p.vel, dt));
+            p.life -= dt;
+            
+            p.vel.x += sinf(time * 6.0f + p.pos.y) * 0.08f * dt;
+            p.vel.z += cosf(time * 6.0f + p.pos.y) * 0.08f * dt;
+            
+            if (p.life <= 0) {
+                p.life = p.maxLife;
+                p.generation++;
+                launchParticle(p, (uint32_t)i);
+            }
+            
+            int k = slabOf(p.pos);
+            slabMin[k] = Vector3Min(slabMin[k], p.pos);
+            slabMax[k] = Vector3Max(slabMax[k], p.pos);
+        }
+    }
+    
+    void setPipelined(bool enabled) {
+        pipelined = enabled;
+        std::vector<JetParticle>().swap(frontParticles);
+        swapBuffers();
+    }
+    
+    void swapBuffers() {
+        if (!pipelined) return;
+        frontParticles = particles;
+        std::copy(slabMin, slabMin + JET_SLABS, frontSlabMin);
+        std::copy(slabMax, slabMax + JET_SLABS, frontSlabMax);
+    }
+    
+    size_t pipelineBytes() const {
+        if (!pipelined) return 0;
+        return frontParticles.capacity() * sizeof(JetParticle) + sizeof(frontSlabMin) + sizeof(frontSlabMax);
+    }
+    
+    void draw(ViewCuller* culler = nullptr);
+};
@@ -0,0 +1,399 @@
+#pragma once
+
+#include "simulation.h"
+#include "scene_geometry.h"
+#include "compact_disk.h"
+#include "platform.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Scene snapshots: the black hole, every particle system and the camera in
+// one file, for instant startup and for resuming a warmed-up scene. The file
+// is a header, a table of sections and the section data, each section a raw
+// array padded to SNAPSHOT_ALIGNMENT. Loading maps the file copy-on-write and
+// points the large particle arrays straight at it, so a scene of any size
+// loads in the time it takes to read the header; pages are faulted in as the
+// first update touches them, and written pages become private copies.
+// Structs are stored as they are laid out in memory, so any change to one
+// needs a new SNAPSHOT_VERSION.
+
+const uint32_t SNAPSHOT_VERSION = 2;
+const size_t SNAPSHOT_ALIGNMENT = 64;
+static_assert(SIMD_ALIGNMENT <= SNAPSHOT_ALIGNMENT, "mapped arrays must satisfy AlignedBuffer's alignment");
+
+enum SnapshotSectionId : uint32_t {
+    SNAPSHOT_VIEW = 1,
+    SNAPSHOT_BLACK_HOLE,
+    SNAPSHOT_DISK_ANGLE,
+    SNAPSHOT_DISK_RADIUS,
+    SNAPSHOT_DISK_HEIGHT,
+    SNAPSHOT_DISK_SPEED,
+    SNAPSHOT_DISK_LIFE,
+    SNAPSHOT_DISK_MAX_LIFE,
+    SNAPSHOT_DISK_POS_X,
+    SNAPSHOT_DISK_POS_Y,
+    SNAPSHOT_DISK_POS_Z,
+    SNAPSHOT_DISK_GENERATION,
+    SNAPSHOT_COMPACT_ANGLE,
+    SNAPSHOT_COMPACT_RADIUS,
+    SNAPSHOT_COMPACT_HEIGHT,
+    SNAPSHOT_COMPACT_LIFE,
+    SNAPSHOT_COMPACT_GENERATION,
+    SNAPSHOT_COMPACT_STEP,
+    SNAPSHOT_STARS,
+    SNAPSHOT_PHOTON_ANGLE,
+    SNAPSHOT_PHOTON_SPEED,
+    SNAPSHOT_PHOTON_PHASE,
+    SNAPSHOT_STREAMERS,
+    SNAPSHOT_TRAILS,
+    SNAPSHOT_JET_TOP,
+    SNAPSHOT_JET_BOTTOM,
+    SNAPSHOT_DISK_ID,
+    SNAPSHOT_DISK_SPEED_MASS,
+    SNAPSHOT_COMPACT_RADIUS_MIN,
+    SNAPSHOT_COMPACT_RADIUS_STEP
+};
+
+struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerBytes;
+    uint32_t sectionCount;
+    uint64_t fileBytes;
+};
+
+struct SnapshotSection {
+    uint32_t id;
+    uint32_t elementBytes;
+    uint64_t offset;
+    uint64_t count;
+};
+
+// Interactive state outside the simulation objects.
+struct SnapshotView {
+    Camera3D camera;
+    float time;
+    float cameraAngle;
+    float cameraHeight;
+    float cameraDistance;
+    float autoRotateSpeed;
+    int32_t autoRotate;
+};
+
+inline uint64_t snapshotAlign(uint64_t offset) {
+    return (offset + SNAPSHOT_ALIGNMENT - 1) & ~(uint64_t)(SNAPSHOT_ALIGNMENT - 1);
+}
+
+// Collects sections by reference, then streams them to disk in one pass
+// with no staging copy. The arrays must stay unchanged until write().
+class SnapshotWriter {
+public:
+    template <typename T>
+    void add(SnapshotSectionId id, const T* data, size_t count) {
+        sections.push_back({id, (uint32_t)sizeof(T), data, count});
+    }
+
+    template <typename T>
+    void add(SnapshotSectionId id, const AlignedBuffer<T>& buffer) {
+        add(id, buffer.data(), buffer.size());
+    }
+
+    template <typename T>
+    void add(SnapshotSectionId id, const std::vector<T>& values) {
+        add(id, values.data(), values.size());
+    }
+
+    uint64_t bytes() const {
+        uint64_t offset = sizeof(SnapshotHeader) + sections.size() * sizeof(SnapshotSection);
+        for (const Pending& p : sections) offset = snapshotAlign(offset) + p.count * p.elementBytes;
+        return offset;
+    }
+
+    // Writes `path`.tmp and renames it over `path`, so a crash mid-write
+    // never leaves a truncated snapshot behind.
+    bool write(const char* path) const {
+        std::string temp = std::string(path) + ".tmp";
+        FILE* f = fopen(temp.c_str(), "wb");
+        if (!f) return false;
+        setvbuf(f, nullptr, _IOFBF, 1 << 20);
+
+        std::vector<SnapshotSection> table(sections.size());
+        uint64_t offset = sizeof(SnapshotHeader) + sections.size() * sizeof(SnapshotSection);
+        for (size_t i = 0; i < sections.size(); i++) {
+            offset = snapshotAlign(offset);
+            table[i] = {sections[i].id, sections[i].elementBytes, offset, (uint64_t)sections[i].count};
+            offset += sections[i].count * sections[i].elementBytes;
+        }
+        SnapshotHeader header;
+        memcpy(header.magic, "BHSS", 4);
+        header.version = SNAPSHOT_VERSION;
+        header.headerBytes = sizeof(SnapshotHeader);
+        header.sectionCount = (uint32_t)sections.size();
+        header.fileBytes = offset;
+
+        static const char padding[SNAPSHOT_ALIGNMENT] = {0};
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        ok = ok && (table.empty() || fwrite(table.data(), sizeof(SnapshotSection), table.size(), f) == table.size());
+        uint64_t written = sizeof(SnapshotHeader) + table.size() * sizeof(SnapshotSection);
+        for (size_t i = 0; ok && i < sections.size(); i++) {
+            size_t pad = (size_t)(table[i].offset - written);
+            size_t bytes = sections[i].count * sections[i].elementBytes;
+            ok = (pad == 0 || fwrite(padding, 1, pad, f) == pad) &&
+                 (bytes == 0 || fwrite(sections[i].data, 1, bytes, f) == bytes);
+            written = table[i].offset + bytes;
+        }
+        ok = fclose(f) == 0 && ok;
+        if (ok && rename(temp.c_str(), path) != 0) {
+            remove(path);
+            ok = rename(temp.c_str(), path) == 0;
+        }
+        if (!ok) remove(temp.c_str());
+        return ok;
+    }
+
+private:
+    struct Pending {
+        SnapshotSectionId id;
+        uint32_t elementBytes;
+        const void* data;
+        size_t count;
+    };
+    std::vector<Pending> sections;
+};
+
+// Maps a snapshot copy-on-write. Large arrays are lent to AlignedBuffers in
+// place; small ones are copied. The reader must outlive every buffer it lent
+// to, or detach() them first.
+class SnapshotReader {
+public:
+    bool open(const char* path) {
+        close();
+        if (!mapped.open(path, true)) return false;
+        SnapshotHeader header;
+        if (mapped.size() < sizeof(header)) return fail();
+        memcpy(&header, mapped.data(), sizeof(header));
+        uint64_t tableEnd = sizeof(header) + (uint64_t)header.sectionCount * sizeof(SnapshotSection);
+        if (memcmp(header.magic, "BHSS", 4) != 0 || header.version != SNAPSHOT_VERSION ||
+            header.headerBytes != sizeof(SnapshotHeader) || header.fileBytes != mapped.size() ||
+            tableEnd > mapped.size()) {
+            return fail();
+        }
+        table.resize(header.sectionCount);
+        memcpy(table.data(), (const char*)mapped.data() + sizeof(header), table.size() * sizeof(SnapshotSection));
+        for (const SnapshotSection& s : table) {
+            if (s.offset % SNAPSHOT_ALIGNMENT != 0 || s.offset < tableEnd || s.elementBytes == 0 ||
+                s.count > (mapped.size() - s.offset) / s.elementBytes) {
+                return fail();
+            }
+        }
+        return true;
+    }
+
+    bool valid() const { return mapped.data() != nullptr; }
+    size_t bytes() const { return mapped.size(); }
+
+    // Elements in section `id` if it holds T, else -1.
+    template <typename T>
+    long long count(SnapshotSectionId id) const {
+        const SnapshotSection* s = find(id);
+        return s && s->elementBytes == sizeof(T) ? (long long)s->count : -1;
+    }
+
+    template <typename T>
+    T* array(SnapshotSectionId id) const {
+        const SnapshotSection* s = find(id);
+        return s ? (T*)((char*)mapped.writableData() + s->offset) : nullptr;
+    }
+
+    // Callers check count<T>() first; these only move the data.
+    template <typename T>
+    void borrow(SnapshotSectionId id, AlignedBuffer<T>& buffer) {
+        buffer.borrow(array<T>(id), (size_t)count<T>(id));
+        lent.push_back([&buffer]() { buffer.own(); });
+    }
+
+    template <typename T>
+    void copy(SnapshotSectionId id, std::vector<T>& values) const {
+        const T* source = array<T>(id);
+        values.assign(source, source + count<T>(id));
+    }
+
+    template <typename T>
+    bool value(SnapshotSectionId id, T& out) const {
+        if (count<T>(id) != 1) return false;
+        memcpy(&out, array<T>(id), sizeof(T));
+        return true;
+    }
+
+    // Copies every lent array into memory of its own and unmaps the file, so
+    // it can be overwritten (Windows cannot replace a mapped file).
+    void detach() {
+        for (const std::function<void()>& own : lent) own();
+        close();
+    }
+
+    // Only once no buffer still borrows from the mapping.
+    void close() {
+        lent.clear();
+        table.clear();
+        mapped.close();
+    }
+
+private:
+    const SnapshotSection* find(SnapshotSectionId id) const {
+        for (const SnapshotSection& s : table) {
+            if (s.id == id) return &s;
+        }
+        return nullptr;
+    }
+
+    bool fail() {
+        close();
+        return false;
+    }
+
+    MappedFile mapped;
+    std::vector<SnapshotSection> table;
+    std::vector<std::function<void()>> lent;
+};
+
+// Per-subsystem sections. Each load checks all of its sections before it
+// changes anything, and returns false on a missing or mismatched one.
+
+inline void snapshotSave(SnapshotWriter& writer, const BlackHole& blackHole) {
+    writer.add(SNAPSHOT_BLACK_HOLE, &blackHole, 1);
+}
+
+inline bool snapshotLoad(SnapshotReader& reader, BlackHole& blackHole) {
+    return reader.value(SNAPSHOT_BLACK_HOLE, blackHole);
+}
+
+inline void snapshotSave(SnapshotWriter& writer, const SnapshotView& view) {
+    writer.add(SNAPSHOT_VIEW, &view, 1);
+}
+
+inline bool snapshotLoad(SnapshotReader& reader, SnapshotView& view) {
+    return reader.value(SNAPSHOT_VIEW, view);
+}
+
+inline void snapshotSave(SnapshotWriter& writer, const AccretionDisk& disk) {
+    writer.add(SNAPSHOT_DISK_ANGLE, disk.orbitAngle);
+    writer.add(SNAPSHOT_DISK_RADIUS, disk.orbitRadius);
+    writer.add(SNAPSHOT_DISK_HEIGHT, disk.orbitHeight);
+    writer.add(SNAPSHOT_DISK_SPEED, disk.orbitSpeed);
+    writer.add(SNAPSHOT_DISK_LIFE, disk.life);
+    writer.add(SNAPSHOT_DISK_MAX_LIFE, disk.maxLife);
+    writer.add(SNAPSHOT_DISK_POS_X, disk.posX);
+    writer.add(SNAPSHOT_DISK_POS_Y, disk.posY);
+    writer.add(SNAPSHOT_DISK_POS_Z, disk.posZ);
+    writer.add(SNAPSHOT_DISK_GENERATION, disk.generation);
+    // Only once multirate stepping has reordered the particles.
+    if (!disk.particleId.empty()) writer.add(SNAPSHOT_DISK_ID, disk.particleId);
+    writer.add(SNAPSHOT_DISK_SPEED_MASS, &disk.speedMass, 1);
+}
+
+// The disk must be built on the restored black hole, for its RNG stream.
+inline bool snapshotLoad(SnapshotReader& reader, AccretionDisk& disk) {
+    const SnapshotSectionId floats[] = {
+        SNAPSHOT_DISK_ANGLE, SNAPSHOT_DISK_RADIUS, SNAPSHOT_DISK_HEIGHT, SNAPSHOT_DISK_SPEED,
+        SNAPSHOT_DISK_LIFE, SNAPSHOT_DISK_MAX_LIFE, SNAPSHOT_DISK_POS_X, SNAPSHOT_DISK_POS_Y, SNAPSHOT_DISK_POS_Z
+    };
+    long long n = reader.count<uint32_t>(SNAPSHOT_DISK_GENERATION);
+    if (n < 0 || n > INT32_MAX) return false;
+    for (SnapshotSectionId id : floats) {
+        if (reader.count<float>(id) != n) return false;
+    }
+    if (!reader.value(SNAPSHOT_DISK_SPEED_MASS, disk.speedMass)) return false;
+    reader.borrow(SNAPSHOT_DISK_ANGLE, disk.orbitAngle);
+    reader.borrow(SNAPSHOT_DISK_RADIUS, disk.orbitRadius);
+    reader.borrow(SNAPSHOT_DISK_HEIGHT, disk.orbitHeight);
+    reader.borrow(SNAPSHOT_DISK_SPEED, disk.orbitSpeed);
+    reader.borrow(SNAPSHOT_DISK_LIFE, disk.life);
+    reader.borrow(SNAPSHOT_DISK_MAX_LIFE, disk.maxLife);
+    reader.borrow(SNAPSHOT_DISK_POS_X, disk.posX);
+    reader.borrow(SNAPSHOT_DISK_POS_Y, disk.posY);
+    reader.borrow(SNAPSHOT_DISK_POS_Z, disk.posZ);
+    reader.borrow(SNAPSHOT_DISK_GENERATION, disk.generation);
+    if (reader.count<uint32_t>(SNAPSHOT_DISK_ID) == n) reader.borrow(SNAPSHOT_DISK_ID, disk.particleId);
+    disk.particleCount = (int)n;
+    disk.activeCount = (int)n;
+    return true;
+}
+
+inline void snapshotSave(SnapshotWriter& writer, const CompactAccretionDisk& disk) {
+    writer.add(SNAPSHOT_COMPACT_ANGLE, disk.angle);
+    writer.add(SNAPSHOT_COMPACT_RADIUS, disk.radius);
+    writer.add(SNAPSHOT_COMPACT_HEIGHT, disk.height);
+    writer.add(SNAPSHOT_COMPACT_LIFE, disk.life);
+    writer.add(SNAPSHOT_COMPACT_GENERATION, disk.generation);
+    writer.add(SNAPSHOT_COMPACT_STEP, &disk.stepCount, 1);
+    writer.add(SNAPSHOT_COMPACT_RADIUS_MIN, &disk.radiusMin, 1);
+    writer.add(SNAPSHOT_COMPACT_RADIUS_STEP, &disk.radiusStep, 1);
+}
+
+inline bool snapshotLoad(SnapshotReader& reader, CompactAccretionDisk& disk) {
+    long long n = reader.count<uint16_t>(SNAPSHOT_COMPACT_ANGLE);
+    if (n < 0 || n > INT32_MAX || reader.count<uint16_t>(SNAPSHOT_COMPACT_RADIUS) != n ||
+        reader.count<int16_t>(SNAPSHOT_COMPACT_HEIGHT) != n || reader.count<uint16_t>(SNAPSHOT_COMPACT_LIFE) != n ||
+        reader.count<uint16_t>(SNAPSHOT_COMPACT_GENERATION) != n || reader.count<float>(SNAPSHOT_COMPACT_RADIUS_MIN) != 1 ||
+        reader.count<float>(SNAPSHOT_COMPACT_RADIUS_STEP) != 1 || !reader.value(SNAPSHOT_COMPACT_STEP, disk.stepCount)) {
+        return false;
+    }
+    // The radii are in the quanta they were saved with; requantize() moves
+    // them if the loaded hole differs.
+    reader.value(SNAPSHOT_COMPACT_RADIUS_MIN, disk.radiusMin);
+    reader.value(SNAPSHOT_COMPACT_RADIUS_STEP, disk.radiusStep);
+    reader.borrow(SNAPSHOT_COMPACT_ANGLE, disk.angle);
+    reader.borrow(SNAPSHOT_COMPACT_RADIUS, disk.radius);
+    reader.borrow(SNAPSHOT_COMPACT_HEIGHT, disk.height);
+    reader.borrow(SNAPSHOT_COMPACT_LIFE, disk.life);
+    reader.borrow(SNAPSHOT_COMPACT_GENERATION, disk.generation);
+    disk.particleCount = (int)n;
+    disk.activeCount = (int)n;
+    return true;
+}
+
+inline void snapshotSave(SnapshotWriter& writer, const Starfield& starfield) {
+    writer.add(SNAPSHOT_STARS, starfield.stars);
+}
+
+inline bool snapshotLoad(SnapshotReader& reader, Starfield& starfield) {
+    long long n = reader.count<Star>(SNAPSHOT_STARS);
+    if (n < 0 || n > INT32_MAX) return false;
+    reader.copy(SNAPSHOT_STARS, starfield.stars);
+    starfield.starCount = (int)n;
+    starfield.activeCount = (int)n;
+    starfield.buildTiles();
+    return true;
+}
+
+inline void snapshotSave(SnapshotWriter& writer, const InfallingMatter& matter) {
+    writer.add(SNAPSHOT_STREAMERS, matter.streamers);
+    writer.add(SNAPSHOT_TRAILS, matter.trailPool);
+}
+
+inline bool snapshotLoad(SnapshotReader& reader, InfallingMatter& matter) {
+    long long n = reader.count<InfallingMatter::Streamer>(SNAPSHOT_STREAMERS);
+    if (n < 0 || n > INT32_MAX || reader.count<Vector3>(SNAPSHOT_TRAILS) != n * matter.trailCapacity) return false;
+    reader.copy(SNAPSHOT_STREAMERS, matter.streamers);
+    reader.borrow(SNAPSHOT_TRAILS, matter.trailPool);
+    matter.maxStreamers = (int)n;
+    return true;
+}
+
+inline void snapshotSave(SnapshotWriter& writer, const JetStream& jet) {
+    writer.add(jet.topJet ? SNAPSHOT_JET_TOP : SNAPSHOT_JET_BOTTOM, jet.particles);
+}
+
+// Jets keep the particle limit they were built with and refill up to it.
+inline bool snapshotLoad(SnapshotReader& reader, JetStream& jet) {
+    SnapshotSectionId id = jet.topJet ? SNAPSHOT_JET_TOP : SNAPSHOT_JET_BOTTOM;
+    if (reader.count<JetStream::JetParticle>(id) < 0) return false;
+    reader.copy(id, jet.particles);
+    if ((int)jet.particles.size() > jet.maxParticles) jet.particles.resize(jet.maxParticles);
+    return true;
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+#include "lensing_table.h"
+#include "platform.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Real star catalogs (HYG, Gaia subsets) in a tiled binary sky format built
+// offline by blackhole_catalog. The sky is split into cube-map tiles, six
+// faces of faceTiles x faceTiles, with equi-angular face coordinates so the
+// tiles are within about 30% of equal area. The file is
+//     StarCatalogHeader
+//     StarCatalogTile[6 * faceTiles^2]     first star and count per tile
+//     CatalogStar[starCount]               grouped by tile, brightest first
+// Loading maps the file and only checks the header, so startup does not
+// depend on the catalog size. Drawing walks the tile table, tests each
+// tile's cone against the view, and reads a visible tile's stars only down
+// to the magnitude limit: a prefix of the tile, so the pages of fainter
+// stars and of tiles off screen are never touched.
+
+const uint32_t STAR_CATALOG_VERSION = 1;
+const int STAR_CATALOG_FACES = 6;
+const float STAR_CATALOG_SKY_RADIUS = 100.0f;   // middle of the generated starfield shell
+const float STAR_CATALOG_FOV = 60.0f;           // field of view the base magnitude applies to
+
+struct StarCatalogHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerBytes;
+    uint32_t faceTiles;
+    uint32_t starCount;
+    float brightestMagnitude;
+    float faintestMagnitude;
+    uint32_t reserved;
+};
+
+struct StarCatalogTile {
+    uint32_t first;
+    uint32_t count;
+};
+
+// 8 bytes: octahedral-encoded direction (about 10 arcseconds), magnitude and
+// B-V color index in thousandths.
+struct CatalogStar {
+    uint16_t octU;
+    uint16_t octV;
+    int16_t magnitude;
+    int16_t colorIndex;
+};
+
+// Catalog entry before conversion; angles in radians.
+struct CatalogEntry {
+    float ra;
+    float dec;
+    float magnitude;
+    float colorIndex;
+};
+
+// Celestial north is +y, so the sky's pole stands over the disk.
+inline Vector3 celestialDirection(float ra, float dec) {
+    return {cosf(dec) * cosf(ra), sinf(dec), cosf(dec) * sinf(ra)};
+}
+
+inline float octahedralSign(float v) { return v < 0 ? -1.0f : 1.0f; }
+
+inline void encodeOctahedral(Vector3 d, uint16_t* u, uint16_t* v) {
+    float sum = fabsf(d.x) + fabsf(d.y) + fabsf(d.z);
+    float x = d.x / sum, y = d.y / sum;
+    if (d.z < 0) {
+        float fx = (1.0f - fabsf(y)) * octahedralSign(x);
+        float fy = (1.0f - fabsf(x)) * octahedralSign(y);
+        x = fx;
+        y = fy;
+    }
+    *u = (uint16_t)lrintf((x * 0.5f + 0.5f) * 65535.0f);
+    *v = (uint16_t)lrintf((y * 0.5f + 0.5f) * 65535.0f);
+}
+
+inline Vector3 decodeOctahedral(uint16_t u, uint16_t v) {
+    float x = u * (2.0f / 65535.0f) - 1.0f;
+    float y = v * (2.0f / 65535.0f) - 1.0f;
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    if (z < 0) {
+        float fx = (1.0f - fabsf(y)) * octahedralSign(x);
+        float fy = (1.0f - fabsf(x)) * octahedralSign(y);
+        x = fx;
+        y = fy;
+    }
+    float inv = 1.0f / sqrtf(x * x + y * y + z * z);
+    return {x * inv, y * inv, z * inv};
+}
+
+// Face f covers the directions whose largest component is axis f / 2 with
+// sign +/- (f even / odd); the other two components, divided by it, are the
+// gnomonic face coordinates, stretched to equal angles by atan.
+const int CUBE_FACE_AXES[3][2] = {{2, 1}, {0, 2}, {0, 1}};
+
+inline int cubeTileOf(Vector3 d, int faceTiles) {
+    float c[3] = {d.x, d.y, d.z};
+    int axis = 0;
+    if (fabsf(c[1]) > fabsf(c[axis])) axis = 1;
+    if (fabsf(c[2]) > fabsf(c[axis])) axis = 2;
+    int face = axis * 2 + (c[axis] < 0);
+    float major = fabsf(c[axis]);
+    float s = atanf(c[CUBE_FACE_AXES[axis][0]] / major) * (4.0f / BH_PI);
+    float t = atanf(c[CUBE_FACE_AXES[axis][1]] / major) * (4.0f / BH_PI);
+    int i = std::max(0, std::min((int)((s + 1.0f) * 0.5f * faceTiles), faceTiles - 1));
+    int j = std::max(0, std::min((int)((t + 1.0f) * 0.5f * faceTiles), faceTiles - 1));
+    return (face * faceTiles + j) * faceTiles + i;
+}
+
+inline Vector3 cubeFaceDirection(int face, float s, float t) {
+    int axis = face / 2;
+    float c[3];
+    c[axis] = face % 2 ? -1.0f : 1.0f;
+    c[CUBE_FACE_AXES[axis][0]] = tanf(s * BH_PI * 0.25f);
+    c[CUBE_FACE_AXES[axis][1]] = tanf(t * BH_PI * 0.25f);
+    return Vector3Normalize({c[0], c[1], c[2]});
+}
+
+// Sorts the entries into tiles, brightest first, and writes the file.
+inline bool writeStarCatalog(const char* path, const std::vector<CatalogEntry>& entries, int faceTiles) {
+    struct Sorted {
+        uint32_t tile;
+        CatalogStar star;
+    };
+    std::vector<Sorted> sorted(entries.size());
+    float brightest = 1e30f, faintest = -1e30f;
+    for (size_t k = 0; k < entries.size(); k++) {
+        const CatalogEntry& e = entries[k];
+        Vector3 d = celestialDirection(e.ra, e.dec);
+        Sorted& s = sorted[k];
+        s.tile = (uint32_t)cubeTileOf(d, faceTiles);
+        encodeOctahedral(d, &s.star.octU, &s.star.octV);
+        s.star.magnitude = (int16_t)lrintf(Clamp(e.magnitude, -30.0f, 30.0f) * 1000.0f);
+        s.star.colorIndex = (int16_t)lrintf(Clamp(e.colorIndex, -30.0f, 30.0f) * 1000.0f);
+        brightest = std::min(brightest, s.star.magnitude * 0.001f);
+        faintest = std::max(faintest, s.star.magnitude * 0.001f);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Sorted& a, const Sorted& b) {
+        return a.tile != b.tile ? a.tile < b.tile : a.star.magnitude < b.star.magnitude;
+    });
+
+    int tileCount = STAR_CATALOG_FACES * faceTiles * faceTiles;
+    std::vector<StarCatalogTile> tiles(tileCount, StarCatalogTile{0, 0});
+    for (const Sorted& s : sorted) tiles[s.tile].count++;
+    uint32_t first = 0;
+    for (StarCatalogTile& tile : tiles) {
+        tile.first = first;
+        first += tile.count;
+    }
+    std::vector<CatalogStar> stars(sorted.size());
+    for (size_t k = 0; k < sorted.size(); k++) stars[k] = sorted[k].star;
+
+    StarCatalogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "BHSC", 4);
+    header.version = STAR_CATALOG_VERSION;
+    header.headerBytes = sizeof(StarCatalogHeader);
+    header.faceTiles = (uint32_t)faceTiles;
+    header.starCount = (uint32_t)stars.size();
+    header.brightestMagnitude = stars.empty() ? 0 : brightest;
+    header.faintestMagnitude = stars.empty() ? 0 : faintest;
+
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(tiles.data(), sizeof(StarCatalogTile), tiles.size(), f) == tiles.size();
+    ok = ok && (stars.empty() || fwrite(stars.data(), sizeof(CatalogStar), stars.size(), f) == stars.size());
+    return fclose(f) == 0 && ok;
+}
+
+class StarCatalog {
+public:
+    int faceTiles;
+    int tileCount;
+    uint32_t starCount;
+    float brightestMagnitude;
+    float faintestMagnitude;
+    float baseMagnitude;        // limit at STAR_CATALOG_FOV
+    float magnitudeOffset;      // added to the limit, e.g. by the quality governor
+    const StarCatalogTile* tiles;
+    const CatalogStar* stars;
+    std::vector<BoundingSphere> tileBounds;
+
+    StarCatalog() {
+        faceTiles = 0;
+        tileCount = 0;
+        starCount = 0;
+        brightestMagnitude = 0;
+        faintestMagnitude = 0;
+        baseMagnitude = 6.5f;
+        magnitudeOffset = 0;
+        tiles = nullptr;
+        stars = nullptr;
+    }
+
+    StarCatalog(const StarCatalog&) = delete;
+    StarCatalog& operator=(const StarCatalog&) = delete;
+
+    bool valid() const { return tiles != nullptr; }
+
+    // Maps the file read-only. Only the header and the size are checked;
+    // fails on a missing, truncated or other-version file.
+    bool load(const char* path) {
+        tiles = nullptr;
+        stars = nullptr;
+        if (!mapped.open(path)) return false;
+        if (mapped.size() < sizeof(StarCatalogHeader)) {
+            mapped.close();
+            return false;
+        }
+        StarCatalogHeader header;
+        memcpy(&header, mapped.data(), sizeof(header));
+        size_t tileEntries = (size_t)STAR_CATALOG_FACES * header.faceTiles * header.faceTiles;
+        if (memcmp(header.magic, "BHSC", 4) != 0 || header.version != STAR_CATALOG_VERSION ||
+            header.headerBytes != sizeof(StarCatalogHeader) || header.faceTiles < 1 || header.faceTiles > 1024 ||
+            mapped.size() != sizeof(header) + tileEntries * sizeof(StarCatalogTile) +
+                             (size_t)header.starCount * sizeof(CatalogStar)) {
+            mapped.close();
+            return false;
+        }
+        faceTiles = (int)header.faceTiles;
+        tileCount = (int)tileEntries;
+        starCount = header.starCount;
+        brightestMagnitude = header.brightestMagnitude;
+        faintestMagnitude = header.faintestMagnitude;
+        const char* base = (const char*)mapped.data() + sizeof(header);
+        tiles = (const StarCatalogTile*)base;
+        stars = (const CatalogStar*)(base + tileEntries * sizeof(StarCatalogTile));
+        buildTileBounds();
+        return true;
+    }
+
+    // Keeps the number of stars per screen area constant: counts grow about
+    // 10^(0.4 m), and a field of view fov covers (fov / STAR_CATALOG_FOV)^2
+    // of the reference sky area, so the limit rises 5 log10 of the zoom.
+    float magnitudeLimit(float fovy) const {
+        return baseMagnitude + magnitudeOffset + 5.0f * log10f(STAR_CATALOG_FOV / std::max(fovy, 0.1f));
+    }
+
+    // Stars of a tile down to `limit`: a prefix, found by binary search.
+    int visibleCount(int tile, float limit) const {
+        const CatalogStar* first = stars + tiles[tile].first;
+        const CatalogStar* last = first + tiles[tile].count;
+        int16_t cut = (int16_t)lrintf(Clamp(limit, -30.0f, 30.0f) * 1000.0f);
+        return (int)(std::upper_bound(first, last, cut, [](int16_t m, const CatalogStar& s) {
+            return m < s.magnitude;
+        }) - first);
+    }
+
+    // Linear in magnitude, which is already logarithmic in flux.
+    static float brightnessOf(float magnitude, float limit) {
+        return Clamp(1.0f - 0.8f * (magnitude + 1.5f) / std::max(limit + 1.5f, 0.1f), 0.2f, 1.0f);
+    }
+
+    // B-V color index to the generated starfield's palette.
+    static Color colorOf(float colorIndex) {
+        if (colorIndex < 0.0f) return {150, 180, 255, 255};
+        if (colorIndex < 0.3f) return {220, 230, 255, 255};
+        if (colorIndex < 0.8f) return {255, 255, 255, 255};
+        if (colorIndex < 1.4f) return {255, 220, 170, 255};
+        return {255, 200, 150, 255};
+    }
+
+    // Same drawing as Starfield::draw, placing each star on a sphere of
+    // STAR_CATALOG_SKY_RADIUS around the origin.
+    void draw(VertexBatch& batch, float time, float fovy, const LensedSky* lensedSky = nullptr,
+              ViewCuller* culler = nullptr) {
+        BH_PROFILE_SCOPE("StarCatalog::draw");
+        if (!valid()) return;
+        float limit = magnitudeLimit(fovy);
+        long long drawn = 0;
+        int tilesCulled = 0;
+        for (int t = 0; t < tileCount; t++) {
+            if (tiles[t].count == 0) continue;
+            if (culler && !tileVisible(t, lensedSky, *culler)) {
+                tilesCulled++;
+                continue;
+            }
+            int count = visibleCount(t, limit);
+            const CatalogStar* first = stars + tiles[t].first;
+            for (int k = 0; k < count; k++) {
+                const CatalogStar& s = first[k];
+                uint32_t index = tiles[t].first + k;
+                Vector3 pos = Vector3Scale(decodeOctahedral(s.octU, s.octV), STAR_CATALOG_SKY_RADIUS);
+                float twinkle = 0.7f + 0.3f * sinf(time * (1.0f + (index % 8) * 0.5f) + index * 0.37f);
+                float b = brightnessOf(s.magnitude * 0.001f, limit) * twinkle;
+                Color base = colorOf(s.colorIndex * 0.001f);
+                Color c = {
+                    (unsigned char)(base.r * b),
+                    (unsigned char)(base.g * b),
+                    (unsigned char)(base.b * b),
+                    255
+                };
+                batch.addPoint(lensedSky ? lensedSky->apparentPosition(pos) : pos, c);
+            }
+            drawn += count;
+        }
+        // Culled tiles are counted as tiles only: finding how many of their
+        // stars pass the limit would touch their pages.
+        if (culler) culler->count(CULL_STARS, drawn, 0, tileCount, tilesCulled);
+    }
+
+private:
+    MappedFile mapped;
+
+    // Cone of each tile from its center to its farthest corner, as a sphere
+    // around the cap it cuts from the sky sphere.
+    void buildTileBounds() {
+        tileBounds.resize(tileCount);
+        for (int face = 0; face < STAR_CATALOG_FACES; face++) {
+            for (int j = 0; j < faceTiles; j++) {
+                for (int i = 0; i < faceTiles; i++) {
+                    float s0 = 2.0f * i / faceTiles - 1.0f, s1 = 2.0f * (i + 1) / faceTiles - 1.0f;
+                    float t0 = 2.0f * j / faceTiles - 1.0f, t1 = 2.0f * (j + 1) / faceTiles - 1.0f;
+                    Vector3 axis = cubeFaceDirection(face, 0.5f * (s0 + s1), 0.5f * (t0 + t1));
+                    float cosMin = 1.0f;
+                    const Vector3 corners[4] = {
+                        cubeFaceDirection(face, s0, t0), cubeFaceDirection(face, s1, t0),
+                        cubeFaceDirection(face, s0, t1), cubeFaceDirection(face, s1, t1)
+                    };
+                    for (const Vector3& corner : corners) cosMin = std::min(cosMin, Vector3DotProduct(axis, corner));
+                    float sinMax = sqrtf(std::max(0.0f, 1.0f - cosMin * cosMin));
+                    BoundingSphere& bound = tileBounds[(face * faceTiles + j) * faceTiles + i];
+                    bound.center = Vector3Scale(axis, STAR_CATALOG_SKY_RADIUS * cosMin);
+                    bound.radius = STAR_CATALOG_SKY_RADIUS * sinMax * 1.001f + CULL_POINT_LENGTH;
+                }
+            }
+        }
+    }
+
+    bool tileVisible(int t, const LensedSky* lensedSky, const ViewCuller& culler) const {
+        const BoundingSphere& bound = tileBounds[t];
+        if (!lensedSky) return culler.sphereVisible(bound);
+        Vector3 axis;
+        float halfAngle;
+        return !lensedSky->imageCone(bound.center, bound.radius, &axis, &halfAngle) ||
+               culler.coneInFrustum(axis, halfAngle);
+    }
+};
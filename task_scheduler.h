@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts outstanding tasks so a caller can wait for a batch it submitted.
+struct TaskGroup {
+    std::atomic<int> pending{0};
+};
+
+// Work-stealing scheduler. Every worker owns a deque; it pops its own work
+// from the back and steals from the front of the others when it runs dry.
+// The thread that calls wait() takes part too (as slot 0), so a scheduler
+// with threadCount N starts N - 1 background workers. A waiting thread only
+// runs tasks of the group it waits on: a frame waiting on its own
+// parallelFor never picks up a simulation step left in flight.
+//
+// Long jobs that must not hold up a frame, such as cache rebuilds, go
+// through runBackground() instead. They are queued for one more dedicated
+// thread that wait() and parallelFor() never take work from.
+class TaskScheduler {
+public:
+    typedef std::function<void()> Task;
+
+    explicit TaskScheduler(int threads = 0) {
+        start(threads);
+    }
+
+    ~TaskScheduler() {
+        stop();
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    int threadCount() const {
+        return (int)queues.size();
+    }
+
+    // Only call between frames, while no tasks are in flight.
+    void resize(int threads) {
+        stop();
+        start(threads);
+    }
+
+    void run(TaskGroup& group, Task task) {
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        int slot = currentSlot();
+        {
+            std::lock_guard<std::mutex> lock(queues[slot]->mutex);
+            queues[slot]->items.push_back({std::move(task), &group});
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        sleepCv.notify_one();
+    }
+
+    // With a single thread nothing would ever pick the job up, so it runs
+    // inline.
+    void runBackground(TaskGroup& group, Task task) {
+        if (threadCount() == 1) {
+            task();
+            return;
+        }
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(backgroundMutex);
+            backgroundItems.push_back({std::move(task), &group});
+        }
+        backgroundCv.notify_one();
+    }
+
+    // Executes the group's queued work (ours first, then stolen) until it
+    // drains.
+    void wait(TaskGroup& group) {
+        int slot = currentSlot();
+        while (group.pending.load(std::memory_order_acquire) > 0) {
+            Item item;
+            if (findWork(slot, item, &group)) {
+                execute(item);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Splits [begin, end) into chunks of at least `grain` elements, about four
+    // per thread so uneven chunks still balance, and blocks until all finish.
+    template <typename F>
+    void parallelFor(int begin, int end, int grain, F&& fn) {
+        int count = end - begin;
+        if (count <= 0) return;
+        int threads = threadCount();
+        int chunk = std::max(grain, (count + threads * 4 - 1) / (threads * 4));
+        if (threads == 1 || chunk >= count) {
+            fn(begin, end);
+            return;
+        }
+        TaskGroup group;
+        for (int b = begin; b < end; b += chunk) {
+            int e = std::min(b + chunk, end);
+            run(group, [&fn, b, e]() { fn(b, e); });
+        }
+        wait(group);
+    }
+
+    static int hardwareThreads() {
+        unsigned n = std::thread::hardware_concurrency();
+        return n ? (int)n : 1;
+    }
+
+private:
+    struct Item {
+        Task fn;
+        TaskGroup* group;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Item> items;
+    };
+
+    void start(int threads) {
+        if (threads <= 0) threads = hardwareThreads();
+        stopping = false;
+        queues.clear();
+        for (int i = 0; i < threads; i++) {
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        }
+        for (int i = 1; i < threads; i++) {
+            workers.emplace_back([this, i]() { workerLoop(i); });
+        }
+        backgroundStopping = false;
+        if (threads > 1) background = std::thread([this]() { backgroundLoop(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCv.notify_all();
+        for (std::thread& t : workers) t.join();
+        workers.clear();
+        {
+            std::lock_guard<std::mutex> lock(backgroundMutex);
+            backgroundStopping = true;
+        }
+        backgroundCv.notify_all();
+        if (background.joinable()) background.join();
+    }
+
+    int currentSlot() const {
+        const TaskScheduler* owner = slotOwner();
+        int slot = slotIndex();
+        return (owner == this && slot < threadCount()) ? slot : 0;
+    }
+
+    // With `only` set, the last (or first) item of that group.
+    bool popBack(int slot, Item& out, const TaskGroup* only) {
+        Queue& q = *queues[slot];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        for (auto it = q.items.end(); it != q.items.begin();) {
+            --it;
+            if (only && it->group != only) continue;
+            out = std::move(*it);
+            q.items.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    bool stealFront(int slot, Item& out, const TaskGroup* only) {
+        Queue& q = *queues[slot];
+        std::unique_lock<std::mutex> lock(q.mutex, std::try_to_lock);
+        if (!lock.owns_lock()) return false;
+        for (auto it = q.items.begin(); it != q.items.end(); ++it) {
+            if (only && it->group != only) continue;
+            out = std::move(*it);
+            q.items.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    bool findWork(int slot, Item& out, const TaskGroup* only) {
+        if (queued.load(std::memory_order_acquire) == 0) return false;
+        bool found = popBack(slot, out, only);
+        int n = threadCount();
+        for (int k = 1; !found && k < n; k++) {
+            found = stealFront((slot + k) % n, out, only);
+        }
+        if (found) queued.fetch_sub(1, std::memory_order_relaxed);
+        return found;
+    }
+
+    void execute(Item& item) {
+        item.fn();
+        item.group->pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    void workerLoop(int slot) {
+        slotOwner() = this;
+        slotIndex() = slot;
+        for (;;) {
+            Item item;
+            if (findWork(slot, item, nullptr)) {
+                execute(item);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCv.wait(lock, [this]() { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping) break;
+        }
+        slotOwner() = nullptr;
+    }
+
+    // Finishes whatever is queued before stopping, so no group is left
+    // pending.
+    void backgroundLoop() {
+        for (;;) {
+            Item item;
+            {
+                std::unique_lock<std::mutex> lock(backgroundMutex);
+                backgroundCv.wait(lock, [this]() { return backgroundStopping || !backgroundItems.empty(); });
+                if (backgroundItems.empty()) break;
+                item = std::move(backgroundItems.front());
+                backgroundItems.pop_front();
+            }
+            execute(item);
+        }
+    }
+
+    static const TaskScheduler*& slotOwner() {
+        static thread_local const TaskScheduler* owner = nullptr;
+        return owner;
+    }
+
+    static int& slotIndex() {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{0};
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+    bool stopping = false;
+    std::thread background;
+    std::mutex backgroundMutex;
+    std::condition_variable backgroundCv;
+    std::deque<Item> backgroundItems;
+    bool backgroundStopping = false;
+};